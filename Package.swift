@@ -15,14 +15,24 @@ let package = Package(
     dependencies: [],
     targets: [
         .target(
-            name: "MMMArrayChanges",
+            name: "MMMArrayChangesCore",
             dependencies: [],
+            path: "Sources/MMMArrayChangesCore"
+		),
+        .target(
+            name: "MMMArrayChanges",
+            dependencies: ["MMMArrayChangesCore"],
             path: "Sources/MMMArrayChanges"
 		),
         .testTarget(
             name: "MMMArrayChangesTests",
             dependencies: ["MMMArrayChanges"],
             path: "Tests/MMMArrayChangesTestCase"
+		),
+        .testTarget(
+            name: "MMMArrayChangesBenchmarks",
+            dependencies: ["MMMArrayChanges"],
+            path: "Tests/MMMArrayChangesBenchmarks"
 		)
     ]
 )
@@ -36,7 +36,8 @@ extension Array {
 		- elementId: Should provide an identifier for any element of the receiver.
 		The identifier has to be compatible with the one returned by `sourceElementId` closure.
 
-		- sourceArray: As it says on the tin.
+		- sourceArray: As it says on the tin. Can be any sequence, e.g. a lazy map over the models, it's traversed
+		only once, so there is no need to materialize it into an array first.
 
 		- sourceElementId: Should provide an identifier for every element of the `sourceArray`.
 		The identifier has to be compatible with the one returned by `elementId`.
@@ -58,70 +59,221 @@ extension Array {
 
 	- Complexity:
 
-		Must be *O(n^2)* because removing elements from a dictionary is quoted at *O(n)*.
+		*O(n + m)*, where *n* and *m* are the sizes of the receiver and the `sourceArray` (assuming hashing of the IDs
+		is *O(1)*). Every ID closure is called exactly once per element, and the receiver is not rebuilt unless
+		elements were added, removed or moved (the index of the IDs is still allocated on every call).
 	*/
+	@inlinable
 	@discardableResult
-	public mutating func diffUpdate<SourceElement, ElementId: Hashable>(
+	public mutating func diffUpdate<SourceElement, Source: Sequence, ElementId: Hashable>(
 		elementId: (_ element: Element) -> ElementId,
-		sourceArray: [SourceElement], sourceElementId: (_ sourceElement: SourceElement) -> ElementId,
+		sourceArray: Source, sourceElementId: (_ sourceElement: SourceElement) -> ElementId,
 		transform: (_ sourceElement: SourceElement) -> Element,
 		update: ((_ element: Element, _ sourceElement: SourceElement) -> Bool)? = nil,
 		remove: ((_ element: Element) -> Void)? = nil
-	) -> Bool {
+	) -> Bool where Source.Element == SourceElement {
 
+		let probe = MMMArrayChanges.Probe.begin(.diffUpdate)
+		defer { probe?.finish() }
+		probe?.enter(.indexing)
+
+		// First building an index of the existing elements, i.e. ID -> index in the receiver.
+		var indexById = Dictionary<ElementId, Int>(minimumCapacity: self.count)
+		for (index, element) in self.enumerated() {
+			let existing = indexById.updateValue(index, forKey: elementId(element))
+			precondition(existing == nil, "Elements of the array cannot have duplicate IDs")
+		}
+
+		// Instead of removing matched elements from the index (which is not cheap) we mark them here.
+		var matched = [Bool](repeating: false, count: self.count)
+
+		// Elements of the updated array. Not populated until the first element that is not at its old position
+		// is found, as most of the time the array stays the same.
+		var result: [Element] = []
+		var rebuilding = false
+
+		// True if elements were added, removed, moved or updated.
 		var changed = false
 
-		// First building an index of the existing elements, i.e. ID -> Element.
-		var elementById = Dictionary<ElementId, Element>(uniqueKeysWithValues: self.map { (elementId($0), $0) })
+		// The number of the source elements seen so far.
+		var newCount = 0
+
+		// For the metrics only.
+		var insertionCount = 0
+		var updateCount = 0
+
+		probe?.enter(.replay)
+		for (newIndex, sourceElement) in sourceArray.enumerated() {
 
-		let result = sourceArray.map { (sourceElement) -> Element in
-			let id = sourceElementId(sourceElement)
-			if let element = elementById[id] {
+			let element: Element
+			let inPlace: Bool
+
+			if let index = indexById[sourceElementId(sourceElement)], !matched[index] {
 				// According to our index the current array already has a matching element, so just keep it...
-				elementById.removeValue(forKey: id)
+				matched[index] = true
+				element = self[index]
 				// ...possibly updating.
 				if update?(element, sourceElement) ?? false {
 					// The update closure indicated that a change in the existing element should be counted
 					// alongside with removals, additions and moves.
 					changed = true
+					updateCount += 1
 				}
-				return element
+				inPlace = index == newIndex
 			} else {
 				// There is no matching element in the current array, let's create it at this position.
-				changed = true
-				return transform(sourceElement)
+				element = transform(sourceElement)
+				inPlace = false
+				insertionCount += 1
+			}
+
+			if !rebuilding && !inPlace {
+				// All the elements before this one are at their old positions.
+				rebuilding = true
+				result.reserveCapacity(Swift.max(self.count, sourceArray.underestimatedCount))
+				result.append(contentsOf: self[0..<newIndex])
 			}
+
+			if rebuilding {
+				result.append(element)
+			}
+
+			newCount += 1
 		}
 
-		// Leftovers in the index mean removed elements and thus that the array had changes.
-		if !elementById.isEmpty {
-			changed = true
+		probe?.count(
+			oldCount: self.count, newCount: newCount,
+			insertions: insertionCount, updates: updateCount
+		)
+
+		if !rebuilding && self.count != newCount {
+			// All the elements are at their places, but the ones in the end are gone.
+			rebuilding = true
+			result = Array(self[0..<newCount])
 		}
 
-		if !changed {
-			// Seems like no additions or removals, but it's possible that the order of elements has changed.
-			assert(self.count == result.count)
-			for i in 0..<self.count {
-				if elementId(self[i]) != elementId(result[i]) {
-					// Right, something is off, report the change and most importantly update the current array.
-					changed = true
-					break
-				}
+		guard rebuilding else {
+			// Nothing was added, removed or moved.
+			return changed
+		}
+
+		let oldArray = self
+		self = result
+
+		// Unmatched elements correspond to the ones missing in the new array, so they have to me marked as gone.
+		if let remove = remove {
+			for (index, element) in oldArray.enumerated() where !matched[index] {
+				remove(element)
 			}
 		}
 
-		if changed {
+		return true
+	}
 
-			self = result
+	/**
+	Same as `diffUpdate()`, but also recording the changes, so they can be replayed onto a `UITableView`.
+
+	The receiver is rebuilt in the same single pass over the `sourceArray` as in `diffUpdate()` (so there is no
+	separate replay of the changes onto the array as in `MMMArrayChanges.byUpdatingArray()`), while the indexes
+	of the matching elements are collected along the way. Only the records are derived from these afterwards,
+	without touching the elements or calling any of the closures again.
+
+	- Parameters:
+
+		- moveDetection: How moved elements are detected, see `MMMArrayChanges.MoveDetection`.
+
+		- update: Same as in `diffUpdate()`; the elements it returns `true` for are recorded as updated.
 
-			// IDs left in the index correspond to elements missing in the new array, so they have to me marked as gone.
+	- Returns: The changes between the old and the new contents of the receiver.
+	*/
+	@discardableResult
+	public mutating func diffUpdateRecordingChanges<SourceElement, Source: Sequence, ElementId: Hashable>(
+		elementId: (_ element: Element) -> ElementId,
+		sourceArray: Source, sourceElementId: (_ sourceElement: SourceElement) -> ElementId,
+		moveDetection: MMMArrayChanges.MoveDetection = .greedy,
+		transform: (_ sourceElement: SourceElement) -> Element,
+		update: ((_ element: Element, _ sourceElement: SourceElement) -> Bool)? = nil,
+		remove: ((_ element: Element) -> Void)? = nil
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+
+		let probe = MMMArrayChanges.Probe.begin(.diffUpdate)
+		defer { probe?.finish() }
+		probe?.enter(.indexing)
+
+		var indexById = Dictionary<ElementId, Int>(minimumCapacity: self.count)
+		for (index, element) in self.enumerated() {
+			let existing = indexById.updateValue(index, forKey: elementId(element))
+			precondition(existing == nil, "Elements of the array cannot have duplicate IDs")
+		}
+
+		// Same as the engine of `MMMArrayChanges` collects, plus the result of `update` for every new index.
+		var survives = [Bool](repeating: false, count: self.count)
+		var oldIndexByNewIndex: [Int] = []
+		oldIndexByNewIndex.reserveCapacity(Swift.max(self.count, sourceArray.underestimatedCount))
+		var updated: [Bool] = []
+		updated.reserveCapacity(oldIndexByNewIndex.capacity)
+
+		var result: [Element] = []
+		var rebuilding = false
+
+		probe?.enter(.replay)
+		for (newIndex, sourceElement) in sourceArray.enumerated() {
+
+			let element: Element
+			let inPlace: Bool
+
+			if let index = indexById[sourceElementId(sourceElement)], !survives[index] {
+				survives[index] = true
+				element = self[index]
+				oldIndexByNewIndex.append(index)
+				updated.append(update?(element, sourceElement) ?? false)
+				inPlace = index == newIndex
+			} else {
+				element = transform(sourceElement)
+				oldIndexByNewIndex.append(NSNotFound)
+				updated.append(false)
+				inPlace = false
+			}
+
+			if !rebuilding && !inPlace {
+				rebuilding = true
+				result.reserveCapacity(oldIndexByNewIndex.capacity)
+				result.append(contentsOf: self[0..<newIndex])
+			}
+
+			if rebuilding {
+				result.append(element)
+			}
+		}
+
+		let newCount = oldIndexByNewIndex.count
+		probe?.countIdCalls(self.count + newCount)
+		probe?.metrics.lookups += self.count + newCount
+
+		if !rebuilding && self.count != newCount {
+			rebuilding = true
+			result = Array(self[0..<newCount])
+		}
+
+		let changes = MMMArrayChanges.changes(
+			oldIndexByNewIndex: oldIndexByNewIndex,
+			survives: survives,
+			moveDetection: moveDetection,
+			concurrent: false,
+			isUpdated: { (_, newIndex) in updated[newIndex] }
+		)
+		probe?.count(changes, oldCount: self.count, newCount: newCount)
+
+		if rebuilding {
+			let oldArray = self
+			self = result
 			if let remove = remove {
-				elementById.forEach { (_, element) in
+				for (index, element) in oldArray.enumerated() where !survives[index] {
 					remove(element)
 				}
 			}
 		}
 
-		return changed
+		return changes
 	}
 }
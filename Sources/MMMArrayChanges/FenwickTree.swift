@@ -0,0 +1,49 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+/// A Fenwick (binary indexed) tree over an array of counters.
+///
+/// Helps answering "how many marked elements are there before the given index" in *O(log(n))*
+/// while the elements are marked and unmarked, which is what we need to locate elements in the intermediate array
+/// without scanning it every time.
+internal struct FenwickTree {
+
+	private var tree: [Int]
+
+	/// Creates a tree with the initial values of all the counters. *O(n)*.
+	internal init(_ values: [Int]) {
+		var tree = [Int](repeating: 0, count: values.count + 1)
+		for i in 1..<tree.count {
+			tree[i] += values[i - 1]
+			let parent = i + (i & -i)
+			if parent < tree.count {
+				tree[parent] += tree[i]
+			}
+		}
+		self.tree = tree
+	}
+
+	/// Adds `delta` to the counter at the given index. *O(log(n))*.
+	internal mutating func add(_ delta: Int, at index: Int) {
+		var i = index + 1
+		while i < tree.count {
+			tree[i] += delta
+			i += i & -i
+		}
+	}
+
+	/// The sum of the counters with indexes in `0..<index`. *O(log(n))*.
+	internal func prefixSum(_ index: Int) -> Int {
+		var result = 0
+		var i = index
+		while i > 0 {
+			result += tree[i]
+			i -= i & -i
+		}
+		return result
+	}
+}
@@ -0,0 +1,355 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+extension MMMArrayChanges {
+
+	/**
+	Accumulates individual edits made to a "live" array and turns them into UITableView-compatible changes relative
+	to the state the array had when the accumulator was created or flushed the last time.
+
+	This is for the cases when changes come as a stream of edits (e.g. deltas pushed by a backend) rather than
+	as snapshots: instead of building the whole new array and diffing it against the old one on every small event,
+	mirror every edit made to your array here and call `flush()` when it's time to update the UI.
+
+	Redundant edits collapse: an element inserted and then removed before a flush is not reported at all,
+	an element moved several times gets a single move (or none if it returns to its place), removed elements
+	don't get updates, etc.
+
+	Only the positions of the elements are needed, not the elements themselves. The cost of every edit is proportional
+	to the number of edits recorded so far and not to the size of the array; the same goes for `flush()`, which
+	additionally pays for every change it reports.
+	*/
+	public struct Accumulator {
+
+		private enum Piece {
+
+			/// Consecutive elements of the old array having indexes in the given range.
+			case old(Range<Int>)
+
+			/// The given number of consecutive elements inserted since the last flush.
+			case inserted(Int)
+
+			var count: Int {
+				switch self {
+				case .old(let range):
+					return range.count
+				case .inserted(let count):
+					return count
+				}
+			}
+		}
+
+		/// The current state of the array as a sequence of runs of elements inserted or coming from the old array.
+		private var pieces: [Piece]
+
+		/// The indexes of the elements of the old array that have been updated.
+		private var updatedOldIndexes = Set<Int>()
+
+		/// The number of elements the array had when the accumulator was created or flushed the last time.
+		public private(set) var oldCount: Int
+
+		/// The current number of elements in the array.
+		public private(set) var count: Int
+
+		/// - Parameter count: The current number of elements in the array.
+		public init(count: Int) {
+			self.oldCount = count
+			self.count = count
+			self.pieces = count > 0 ? [.old(0..<count)] : []
+		}
+
+		/// True, if the edits recorded so far cancel each other out, so `flush()` would return empty changes.
+		public var isEmpty: Bool {
+			guard updatedOldIndexes.isEmpty else {
+				return false
+			}
+			switch pieces.count {
+			case 0:
+				return oldCount == 0
+			case 1:
+				if case .old(let range) = pieces[0] {
+					return range == 0..<oldCount
+				} else {
+					return false
+				}
+			default:
+				return false
+			}
+		}
+
+		/// Records an insertion of a new element at the given index of the current array.
+		public mutating func insert(at index: Int) {
+			precondition(0 <= index && index <= count, "Invalid index of an insertion")
+			insert(.inserted(1), at: index)
+			count += 1
+		}
+
+		/// Records a removal of the element at the given index of the current array.
+		public mutating func remove(at index: Int) {
+			precondition(0 <= index && index < count, "Invalid index of a removal")
+			if case .old(let range) = take(at: index) {
+				updatedOldIndexes.remove(range.lowerBound)
+			}
+			count -= 1
+		}
+
+		/// Records a move of an element within the current array. Same as with arrays the element is first removed
+		/// at `sourceIndex` and then inserted at `targetIndex` of the array without it.
+		public mutating func move(from sourceIndex: Int, to targetIndex: Int) {
+			precondition(0 <= sourceIndex && sourceIndex < count, "Invalid source index of a move")
+			precondition(0 <= targetIndex && targetIndex < count, "Invalid target index of a move")
+			insert(take(at: sourceIndex), at: targetIndex)
+		}
+
+		/// Records a change in the contents of the element at the given index of the current array.
+		/// (Updates of the elements inserted since the last flush are not interesting and thus ignored.)
+		public mutating func update(at index: Int) {
+			precondition(0 <= index && index < count, "Invalid index of an update")
+			let (k, offset) = locate(index)
+			if case .old(let range) = pieces[k] {
+				updatedOldIndexes.insert(range.lowerBound + offset)
+			}
+		}
+
+		/// Returns the changes corresponding to all the edits recorded since the accumulator was created or flushed
+		/// the last time and resets it, so the current state of the array becomes the "old" one.
+		public mutating func flush() -> MMMArrayChanges {
+			let result = changes()
+			self = Accumulator(count: count)
+			return result
+		}
+
+		/// The changes corresponding to all the edits recorded so far, without resetting the accumulator.
+		public func changes() -> MMMArrayChanges {
+
+			// The pieces of the old array that survived in the order of the new one along with their new positions.
+			var oldPieces: [(range: Range<Int>, newIndex: Int)] = []
+
+			// Insertions are simply the positions of the inserted pieces.
+			var insertions: [Insertion] = []
+
+			var newIndex = 0
+			for piece in pieces {
+				switch piece {
+				case .old(let range):
+					oldPieces.append((range, newIndex))
+				case .inserted(let count):
+					for i in newIndex..<(newIndex + count) {
+						insertions.append(.init(i))
+					}
+				}
+				newIndex += piece.count
+			}
+
+			// The same pieces in the order of the old array, i.e. the way they are in the intermediate array
+			// before any moves. The rank of a piece is its index in this order.
+			let oldOrder = oldPieces.indices.sorted { oldPieces[$0].range.lowerBound < oldPieces[$1].range.lowerBound }
+			var rankByPiece = [Int](repeating: 0, count: oldPieces.count)
+			for (rank, k) in oldOrder.enumerated() {
+				rankByPiece[k] = rank
+			}
+
+			// Removals are the gaps between the surviving pieces, in the reverse order as usual.
+			var removals: [Removal] = []
+			var end = oldCount
+			for k in oldOrder.reversed() {
+				let range = oldPieces[k].range
+				for i in (range.upperBound..<end).reversed() {
+					removals.append(.init(i))
+				}
+				end = range.lowerBound
+			}
+			for i in (0..<end).reversed() {
+				removals.append(.init(i))
+			}
+
+			// Only the pieces outside of the heaviest increasing (in terms of their ranks) subsequence are moved.
+			let stays = Self.heaviestIncreasingSubsequence(
+				ranks: rankByPiece,
+				weights: oldPieces.map { $0.range.count }
+			)
+
+			// Similar to `minimalMoves()` every moved element is inserted after the closest piece preceding it
+			// in the new array that stays (or in the very beginning of the array if there is no such piece),
+			// thus forming groups. The intermediate array can then be seen as a sequence of slots, the number
+			// of elements in a slot being its weight: slot 0 is the group of the beginning of the array,
+			// slot 2 * rank + 1 is a piece and slot 2 * rank + 2 is its group.
+			var occupied: FenwickTree = {
+				var weights = [Int](repeating: 0, count: 2 * oldPieces.count + 1)
+				for (k, piece) in oldPieces.enumerated() {
+					weights[2 * rankByPiece[k] + 1] = piece.range.count
+				}
+				return FenwickTree(weights)
+			}()
+
+			var moves: [Move] = []
+			var group = 0
+			for (k, piece) in oldPieces.enumerated() {
+
+				let slot = 2 * rankByPiece[k] + 1
+
+				if stays[k] {
+					group = slot + 1
+					continue
+				}
+
+				for (offset, oldIndex) in piece.range.enumerated() {
+
+					// The elements of a piece are moved in order, so the one being moved is always the first in its slot...
+					let intermediateSourceIndex = occupied.prefixSum(slot)
+					occupied.add(-1, at: slot)
+
+					// ...and goes to the end of its group.
+					let intermediateTargetIndex = occupied.prefixSum(group + 1)
+					occupied.add(1, at: group)
+
+					moves.append(.init(oldIndex, piece.newIndex + offset, intermediateSourceIndex, intermediateTargetIndex))
+				}
+			}
+
+			// Updates, in the order of the new array.
+			let updated = updatedOldIndexes.sorted()
+			var updates: [Update] = []
+			for piece in oldPieces {
+				// The first updated index within the piece, if any.
+				var low = 0
+				var high = updated.count
+				while low < high {
+					let mid = (low + high) / 2
+					if updated[mid] < piece.range.lowerBound {
+						low = mid + 1
+					} else {
+						high = mid
+					}
+				}
+				var i = low
+				while i < updated.count && updated[i] < piece.range.upperBound {
+					updates.append(.init(updated[i], piece.newIndex + updated[i] - piece.range.lowerBound))
+					i += 1
+				}
+			}
+
+			return MMMArrayChanges(removals: removals, insertions: insertions, moves: moves, updates: updates)
+		}
+
+		/// The piece containing the given position of the current array and the offset of the position within it.
+		private func locate(_ index: Int) -> (piece: Int, offset: Int) {
+			var position = 0
+			for (k, piece) in pieces.enumerated() {
+				if index < position + piece.count {
+					return (k, index - position)
+				}
+				position += piece.count
+			}
+			preconditionFailure("Invalid index")
+		}
+
+		/// Splits the pieces so one of them begins at the given position of the current array.
+		/// Returns the index of this piece or the number of the pieces in case the position is the end of the array.
+		private mutating func split(at index: Int) -> Int {
+			var position = 0
+			for k in 0..<pieces.count {
+				if index == position {
+					return k
+				}
+				let piece = pieces[k]
+				if index < position + piece.count {
+					let offset = index - position
+					switch piece {
+					case .old(let range):
+						let middle = range.lowerBound + offset
+						pieces.replaceSubrange(k...k, with: [.old(range.lowerBound..<middle), .old(middle..<range.upperBound)])
+					case .inserted(let count):
+						pieces.replaceSubrange(k...k, with: [.inserted(offset), .inserted(count - offset)])
+					}
+					return k + 1
+				}
+				position += piece.count
+			}
+			precondition(index == position, "Invalid index")
+			return pieces.count
+		}
+
+		/// Removes a single element at the given position of the current array returning it as a piece.
+		private mutating func take(at index: Int) -> Piece {
+			let k = split(at: index)
+			_ = split(at: index + 1)
+			let piece = pieces.remove(at: k)
+			mergeIfPossible(k - 1)
+			return piece
+		}
+
+		private mutating func insert(_ piece: Piece, at index: Int) {
+			let k = split(at: index)
+			pieces.insert(piece, at: k)
+			mergeIfPossible(k)
+			mergeIfPossible(k - 1)
+		}
+
+		/// Joins pieces at `k` and `k + 1` if both are inserted or are adjacent in the old array,
+		/// so edits that cancel each other out do not leave any traces.
+		private mutating func mergeIfPossible(_ k: Int) {
+			guard k >= 0 && k + 1 < pieces.count else {
+				return
+			}
+			switch (pieces[k], pieces[k + 1]) {
+			case let (.old(a), .old(b)) where a.upperBound == b.lowerBound:
+				pieces.replaceSubrange(k...(k + 1), with: [.old(a.lowerBound..<b.upperBound)])
+			case let (.inserted(a), .inserted(b)):
+				pieces.replaceSubrange(k...(k + 1), with: [.inserted(a + b)])
+			default:
+				break
+			}
+		}
+
+		/// Flags the elements of the increasing (in terms of `ranks`, which are all different and within `0..<n`)
+		/// subsequence having the maximum total weight. *O(n * log(n))*.
+		private static func heaviestIncreasingSubsequence(ranks: [Int], weights: [Int]) -> [Bool] {
+
+			let n = ranks.count
+
+			// The maximum total weight of a subsequence ending with the given element and the previous element there.
+			var best = [Int](repeating: 0, count: n)
+			var previous = [Int](repeating: -1, count: n)
+
+			// A Fenwick tree for maximums of `best` among the elements with ranks below the given one.
+			var tree = [(weight: Int, position: Int)](repeating: (0, -1), count: n + 1)
+
+			for k in 0..<n {
+
+				var bestBefore: (weight: Int, position: Int) = (0, -1)
+				var i = ranks[k]
+				while i > 0 {
+					if tree[i].weight > bestBefore.weight {
+						bestBefore = tree[i]
+					}
+					i -= i & -i
+				}
+
+				best[k] = bestBefore.weight + weights[k]
+				previous[k] = bestBefore.position
+
+				i = ranks[k] + 1
+				while i <= n {
+					if best[k] > tree[i].weight {
+						tree[i] = (best[k], k)
+					}
+					i += i & -i
+				}
+			}
+
+			var result = [Bool](repeating: false, count: n)
+			var k = best.indices.max { best[$0] < best[$1] } ?? -1
+			while k >= 0 {
+				result[k] = true
+				k = previous[k]
+			}
+
+			return result
+		}
+	}
+}
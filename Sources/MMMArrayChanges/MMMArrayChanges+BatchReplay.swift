@@ -0,0 +1,245 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+extension MMMArrayChanges {
+
+	/**
+	Replays the changes onto a list in small batches, each taking it from one consistent intermediate state
+	to the next one: the removals first (in descending order, so their indexes stay valid), then the moves
+	(in the same order as in `applyToArray()`) and then the insertions (in ascending order).
+
+	This is what `MMMArrayChangesTableScheduler` drives a table view through, but it can be used on its own
+	to spread any other expensive replay across frames.
+
+	Every batch rewrites only the part of the list it touches: the tail after the last removal or the first
+	insertion of the batch, or the range spanned by its moves. It never walks the whole list unless its changes
+	are spread all over it.
+	*/
+	public struct BatchReplay<Element> {
+
+		/// What it takes to get from the previous state of the list to the current one.
+		public enum Batch: Equatable {
+
+			/// The elements at the given indexes of the previous state are removed, in descending order.
+			case removals([Int])
+
+			/// The elements at `sources` in the previous state are at the corresponding `targets` now,
+			/// the rest keep their relative order. (As `moveRow(at:to:)` of a table view expects them.)
+			case moves(sources: [Int], targets: [Int])
+
+			/// The elements at the given indexes of the current state are inserted, in ascending order.
+			case insertions([Int])
+		}
+
+		private let changes: MMMArrayChanges
+		private let newItems: [Element]
+		private let maxBatchSize: Int
+
+		/// The current state of the list.
+		public private(set) var items: [Element]
+
+		/**
+		- Parameters:
+
+			- changes: The changes between `oldItems` and `newItems`, cannot be a full reload.
+
+			- maxBatchSize: The maximum number of changes per batch.
+		*/
+		public init(changes: MMMArrayChanges, oldItems: [Element], newItems: [Element], maxBatchSize: Int) {
+			precondition(!changes.isFullReload, "Full reloads cannot be replayed in batches")
+			precondition(maxBatchSize > 0)
+			precondition(
+				oldItems.count - changes.removals.count + changes.insertions.count == newItems.count,
+				"The changes do not correspond to the items"
+			)
+			self.changes = changes
+			self.items = oldItems
+			self.newItems = newItems
+			self.maxBatchSize = maxBatchSize
+		}
+
+		private enum Phase {
+			case removals, moves, insertions, finished
+		}
+
+		private var phase: Phase = .removals
+		// The number of records of the current phase applied so far.
+		private var position: Int = 0
+
+		/// True, once all the batches are applied. The elements that were updated are still the old ones
+		/// in `items` then, it's up to the caller to take them from the new list.
+		public var isFinished: Bool {
+			return phase == .finished
+		}
+
+		/// Applies the next batch to `items`, nil if there are no more batches.
+		public mutating func next() -> Batch? {
+			while true {
+				switch phase {
+				case .removals:
+					let batch = nextBatch(count: changes.removals.count, next: .moves)
+					if !batch.isEmpty {
+						return applyRemovals(batch)
+					}
+				case .moves:
+					let batch = nextBatch(count: changes.moves.count, next: .insertions)
+					if !batch.isEmpty {
+						return applyMoves(batch)
+					}
+				case .insertions:
+					let batch = nextBatch(count: changes.insertions.count, next: .finished)
+					if !batch.isEmpty {
+						return applyInsertions(batch)
+					}
+				case .finished:
+					return nil
+				}
+			}
+		}
+
+		/// The range of the records of the current phase to apply next, advancing to the next phase
+		/// after the last batch.
+		private mutating func nextBatch(count: Int, next: Phase) -> Range<Int> {
+			let batch = position..<Swift.min(count, position + maxBatchSize)
+			position = batch.upperBound
+			if position >= count {
+				phase = next
+				position = 0
+			}
+			return batch
+		}
+
+		private mutating func applyRemovals(_ batch: Range<Int>) -> Batch {
+
+			// The removals are in descending order, so the ones left for the next batches are not affected by these
+			// and their indexes in the old array are still the indexes in the current one. Only the tail after
+			// the last (the lowest) removal of the batch changes.
+			let removals = changes.removals
+			let start = removals[batch.upperBound - 1].index
+			var tail: [Element] = []
+			tail.reserveCapacity(items.count - start - batch.count)
+			var next = batch.upperBound - 1
+			for index in start..<items.count {
+				if next >= batch.lowerBound && removals[next].index == index {
+					next -= 1
+				} else {
+					tail.append(items[index])
+				}
+			}
+			items.replaceSubrange(start..<items.count, with: tail)
+
+			return .removals(batch.map { removals[$0].index })
+		}
+
+		private mutating func applyMoves(_ batch: Range<Int>) -> Batch {
+
+			let moves = changes.moves
+
+			// Every move shifts only the elements between its source and target, so the elements outside of the range
+			// spanned by all the moves of the batch stay in place.
+			var lowest = Int.max
+			var highest = Int.min
+			for i in batch {
+				let m = moves[i]
+				lowest = Swift.min(lowest, m.intermediateSourceIndex, m.intermediateTargetIndex)
+				highest = Swift.max(highest, m.intermediateSourceIndex, m.intermediateTargetIndex)
+			}
+			let count = highest - lowest + 1
+
+			// Instead of replaying the moves on the range itself, tracking only the elements moved so far:
+			// their indexes in the range as it was before the batch and their current positions in it.
+			// The rest keep their relative order, so the position of any of them tells which one it is.
+			var moved: [(index: Int, position: Int)] = []
+			// The indexes of the moved elements in ascending order.
+			var taken: [Int] = []
+
+			for i in batch {
+
+				let m = moves[i]
+				let source = m.intermediateSourceIndex - lowest
+				let target = m.intermediateTargetIndex - lowest
+
+				let index: Int
+				if let k = moved.firstIndex(where: { $0.position == source }) {
+					index = moved.remove(at: k).index
+				} else {
+					// The position of the element among the ones not moved yet...
+					var rank = source
+					for e in moved where e.position < source {
+						rank -= 1
+					}
+					// ...which skip the moved ones in the original order.
+					var k = 0
+					while k < taken.count && taken[k] <= rank {
+						rank += 1
+						k += 1
+					}
+					index = rank
+					taken.insert(index, at: k)
+				}
+
+				for k in moved.indices {
+					if moved[k].position > source {
+						moved[k].position -= 1
+					}
+					if moved[k].position >= target {
+						moved[k].position += 1
+					}
+				}
+				moved.append((index, target))
+			}
+
+			// Placing the moved elements and filling the gaps with the rest in their original order.
+			moved.sort { $0.position < $1.position }
+			var range: [Element] = []
+			range.reserveCapacity(count)
+			var nextMoved = 0
+			var nextTaken = 0
+			var nextStaying = 0
+			for position in 0..<count {
+				if nextMoved < moved.count && moved[nextMoved].position == position {
+					range.append(items[lowest + moved[nextMoved].index])
+					nextMoved += 1
+				} else {
+					while nextTaken < taken.count && taken[nextTaken] == nextStaying {
+						nextTaken += 1
+						nextStaying += 1
+					}
+					range.append(items[lowest + nextStaying])
+					nextStaying += 1
+				}
+			}
+			items.replaceSubrange(lowest...highest, with: range)
+
+			return .moves(sources: moved.map { lowest + $0.index }, targets: moved.map { lowest + $0.position })
+		}
+
+		private mutating func applyInsertions(_ batch: Range<Int>) -> Batch {
+
+			// The insertions are in ascending order, so the elements before each of them are final already
+			// and its index in the new array is its index in the current one as well. Only the tail starting
+			// with the first insertion of the batch changes.
+			let insertions = changes.insertions
+			let start = insertions[batch.lowerBound].index
+			var tail: [Element] = []
+			tail.reserveCapacity(items.count - start + batch.count)
+			var next = start
+			for i in batch {
+				let index = insertions[i].index
+				while start + tail.count < index {
+					tail.append(items[next])
+					next += 1
+				}
+				tail.append(newItems[index])
+			}
+			tail.append(contentsOf: items[next...])
+			items.replaceSubrange(start..<items.count, with: tail)
+
+			return .insertions(batch.map { insertions[$0].index })
+		}
+	}
+}
@@ -0,0 +1,93 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+extension MMMArrayChanges {
+
+	/**
+	Limits on the changes (and on the effort finding them) beyond which animating them makes no sense anyway.
+
+	When most of a list changes (e.g. a filter is toggled), thousands of `deleteRows()`/`insertRows()`/`moveRow()`
+	calls are much slower than a simple `reloadData()` and there is not much to see in such an animation either.
+	When a diff exceeds its budget, the engine stops as soon as it notices and returns changes marked
+	as a "full reload" instead (see `isFullReload`), which the table and collection view helpers apply via
+	`reloadData()`. The arrays passed to `byUpdatingArray()` are still updated properly in this case,
+	so the surviving elements are reused.
+	*/
+	public struct Budget {
+
+		/// The maximum number of removed, inserted and moved elements relative to the number of elements
+		/// in the larger of the arrays, e.g. `0.5` to reload when more than a half of the list is affected.
+		public var maxChangeRatio: Double
+
+		/// The maximum number of moves.
+		public var maxMoves: Int
+
+		/// The maximum time to spend finding the changes, in seconds, `nil` for no limit.
+		/// (Checked periodically, so can be overshot a bit.)
+		public var timeLimit: TimeInterval?
+
+		public init(maxChangeRatio: Double = .infinity, maxMoves: Int = .max, timeLimit: TimeInterval? = nil) {
+			self.maxChangeRatio = maxChangeRatio
+			self.maxMoves = maxMoves
+			self.timeLimit = timeLimit
+		}
+
+		/// No limits, the changes are always found in full. This is the default.
+		public static let unlimited = Budget()
+
+		/// The budget in effect for a single diff, i.e. with its clock started.
+		internal struct Tracker {
+
+			let budget: Budget
+
+			private let deadline: UInt64
+
+			init(_ budget: Budget) {
+				self.budget = budget
+				if let timeLimit = budget.timeLimit {
+					self.deadline = DispatchTime.now().uptimeNanoseconds + UInt64(max(0, timeLimit) * 1e9)
+				} else {
+					self.deadline = .max
+				}
+			}
+
+			static let unlimited = Tracker(.unlimited)
+
+			var maxMoves: Int {
+				return budget.maxMoves
+			}
+
+			var isOverTime: Bool {
+				return deadline != .max && DispatchTime.now().uptimeNanoseconds > deadline
+			}
+
+			/// True, if the given number of changed elements is too much for arrays of the given sizes.
+			func isExceeded(changeCount: Int, oldCount: Int, newCount: Int) -> Bool {
+				return Double(changeCount) > budget.maxChangeRatio * Double(Swift.max(oldCount, newCount))
+			}
+		}
+	}
+
+	/// The changes marked as a "full reload" for the given mapping of elements, see `Budget`.
+	///
+	/// The `isUpdated` closure, if any, is still called for every surviving element (its result is ignored
+	/// as everything is going to be reloaded), so the elements are updated by `byUpdatingArray()` as usual.
+	internal static func fullReloadChanges(
+		oldCount: Int,
+		oldIndexByNewIndex: [Int],
+		concurrent: Bool,
+		isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?
+	) -> MMMArrayChanges {
+		if let isUpdated = isUpdated {
+			_ = flags(count: oldIndexByNewIndex.count, concurrent: concurrent) { newIndex in
+				let oldIndex = oldIndexByNewIndex[newIndex]
+				return oldIndex != NSNotFound && isUpdated(oldIndex, newIndex)
+			}
+		}
+		return MMMArrayChanges(fullReload: .init(oldCount: oldCount, oldIndexByNewIndex: oldIndexByNewIndex))
+	}
+}
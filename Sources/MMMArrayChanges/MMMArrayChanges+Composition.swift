@@ -0,0 +1,152 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+extension MMMArrayChanges {
+
+	/**
+	Merges the receiver (the changes between arrays A and B) with the changes that followed it (between B and C)
+	into a single set of changes between A and C, so a burst of updates can be applied as a single batch.
+
+	The arrays themselves are not needed. The moves are detected anew from the combined mapping of the elements
+	of A to the elements of C, so the result is exactly what `byUpdatingArray()` would return for A and C directly
+	using the same `moveDetection` and its intermediate indexes are good for replaying as usual.
+
+	An element surviving in C has an update when it was updated in either of the change sets; the elements
+	that appeared in B only or were inserted in B and then updated are simply insertions.
+
+	Note that identities of the elements are not known here, so an element removed in B and inserted back in C
+	is reported as a removal and an insertion rather than as a move or an update.
+
+	When either of the change sets is marked as a full reload (see `Budget`), then so is the result.
+
+	*O(n log n)*, where `n` is the size of the part of the arrays covered by the records of both change sets,
+	as the moves are detected anew (see `MoveDetection`).
+	*/
+	public func composed(with next: MMMArrayChanges, moveDetection: MoveDetection = .greedy) -> MMMArrayChanges {
+
+		// The sizes of the arrays are not known, but we can assume that every array has enough elements in the end
+		// that are not affected by any of the changes: these simply stay in place and don't contribute any records.
+		// (The sizes are known exactly for a full reload.)
+		let oldCount: Int
+		if let fullReload = self.fullReload {
+			oldCount = fullReload.oldCount
+		} else if let fullReload = next.fullReload {
+			oldCount = fullReload.oldCount + self.removals.count - self.insertions.count
+		} else {
+			let count = max(self.lastIndex, next.lastIndex) + 1
+			oldCount = count + self.removals.count + next.removals.count
+		}
+		let (middleIndexByOldIndex, middleCount) = self.newIndexByOldIndex(oldCount: oldCount)
+		let (newIndexByMiddleIndex, newCount) = next.newIndexByOldIndex(oldCount: middleCount)
+
+		var oldIndexByNewIndex = [Int](repeating: NSNotFound, count: newCount)
+		var survives = [Bool](repeating: false, count: oldCount)
+		for (oldIndex, middleIndex) in middleIndexByOldIndex.enumerated() where middleIndex != NSNotFound {
+			let newIndex = newIndexByMiddleIndex[middleIndex]
+			if newIndex != NSNotFound {
+				survives[oldIndex] = true
+				oldIndexByNewIndex[newIndex] = oldIndex
+			}
+		}
+
+		if isFullReload || next.isFullReload {
+			return MMMArrayChanges(fullReload: .init(oldCount: oldCount, oldIndexByNewIndex: oldIndexByNewIndex))
+		}
+
+		var removals: [Removal] = []
+		for i in (0..<oldCount).reversed() where !survives[i] {
+			removals.append(.init(i))
+		}
+
+		var insertions: [Insertion] = []
+		for i in 0..<newCount where oldIndexByNewIndex[i] == NSNotFound {
+			insertions.append(.init(i))
+		}
+
+		let moves = MMMArrayChanges.detectMoves(
+			oldIndexByNewIndex: oldIndexByNewIndex,
+			survives: survives,
+			moveDetection: moveDetection
+		)
+
+		// Updates are marked by the indexes of the elements in the new array, so they can be listed in its order.
+		var updated = [Bool](repeating: false, count: newCount)
+		for u in self.updates {
+			let newIndex = newIndexByMiddleIndex[u.newIndex]
+			if newIndex != NSNotFound {
+				updated[newIndex] = true
+			}
+		}
+		for u in next.updates where oldIndexByNewIndex[u.newIndex] != NSNotFound {
+			updated[u.newIndex] = true
+		}
+		var updates: [Update] = []
+		for i in 0..<newCount where updated[i] {
+			updates.append(.init(oldIndexByNewIndex[i], i))
+		}
+
+		return MMMArrayChanges(removals: removals, insertions: insertions, moves: moves, updates: updates)
+	}
+
+	/// The largest index mentioned in the records or -1 if there are none.
+	private var lastIndex: Int {
+		var result = -1
+		for r in removals {
+			result = max(result, r.index)
+		}
+		for i in insertions {
+			result = max(result, i.index)
+		}
+		for m in moves {
+			result = max(result, m.oldIndex, m.newIndex)
+		}
+		for u in updates {
+			result = max(result, u.oldIndex, u.newIndex)
+		}
+		return result
+	}
+
+	/// For every element of the old array of the given size the index of the corresponding element in the new one
+	/// (or `NSNotFound` for removed elements) and the size of the new array.
+	private func newIndexByOldIndex(oldCount: Int) -> ([Int], Int) {
+
+		if let fullReload = fullReload {
+			var result = [Int](repeating: NSNotFound, count: oldCount)
+			for (newIndex, oldIndex) in fullReload.oldIndexByNewIndex.enumerated() where oldIndex != NSNotFound {
+				result[oldIndex] = newIndex
+			}
+			return (result, fullReload.oldIndexByNewIndex.count)
+		}
+
+		let newCount = oldCount - removals.count + insertions.count
+
+		var result = [Int](repeating: -1, count: oldCount)
+		var taken = [Bool](repeating: false, count: newCount)
+		for r in removals {
+			result[r.index] = NSNotFound
+		}
+		for i in insertions {
+			taken[i.index] = true
+		}
+		for m in moves {
+			result[m.oldIndex] = m.newIndex
+			taken[m.newIndex] = true
+		}
+
+		// The elements that are neither removed nor moved keep their relative order taking the remaining positions.
+		var newIndex = 0
+		for oldIndex in 0..<oldCount where result[oldIndex] < 0 {
+			while taken[newIndex] {
+				newIndex += 1
+			}
+			result[oldIndex] = newIndex
+			newIndex += 1
+		}
+
+		return (result, newCount)
+	}
+}
@@ -0,0 +1,88 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+extension MMMArrayChanges {
+
+	/// Chunks smaller than this are not worth dispatching to other cores.
+	@usableFromInline
+	internal static let minChunkSize = 256
+
+	/// Splits `0..<count` into ranges processed via `DispatchQueue.concurrentPerform()`.
+	/// There are several chunks per core, so a core that's busy with something else does not delay everything.
+	@usableFromInline
+	internal static func concurrentlyForChunks(count: Int, _ body: (Range<Int>) -> Void) {
+		let chunkCount = 4 * ProcessInfo.processInfo.activeProcessorCount
+		let chunkSize = Swift.max(minChunkSize, (count + chunkCount - 1) / chunkCount)
+		let chunks = (count + chunkSize - 1) / chunkSize
+		DispatchQueue.concurrentPerform(iterations: chunks) { chunk in
+			body((chunk * chunkSize)..<Swift.min(count, (chunk + 1) * chunkSize))
+		}
+	}
+
+	/// Same as `collection.map(transform)`, but optionally calling `transform` concurrently.
+	/// (Inlinable, so the ID closures of the entry points can be inlined into the loop at the call site.)
+	@inlinable
+	internal static func map<C: RandomAccessCollection, R>(
+		_ collection: C,
+		concurrent: Bool,
+		_ transform: (C.Element) -> R
+	) -> [R] {
+		let count = collection.count
+		guard concurrent, count > minChunkSize else {
+			return collection.map(transform)
+		}
+		return [R](unsafeUninitializedCapacity: count) { (buffer, initializedCount) in
+			let base = buffer.baseAddress!
+			let done: Void? = collection.withContiguousStorageIfAvailable { source in
+				concurrentlyForChunks(count: count) { range in
+					for i in range {
+						(base + i).initialize(to: transform(source[i]))
+					}
+				}
+			}
+			if done == nil {
+				// Not backed by an array, e.g. a lazy map, but still random access.
+				concurrentlyForChunks(count: count) { range in
+					for i in range {
+						(base + i).initialize(to: transform(collection[offset: i]))
+					}
+				}
+			}
+			initializedCount = count
+		}
+	}
+
+	/// For every element of `0..<count` tells if `predicate` holds, optionally calling it concurrently.
+	internal static func flags(count: Int, concurrent: Bool, _ predicate: (Int) -> Bool) -> [Bool] {
+		var result = [Bool](repeating: false, count: count)
+		if concurrent && count > minChunkSize {
+			result.withUnsafeMutableBufferPointer { result in
+				let base = result.baseAddress!
+				concurrentlyForChunks(count: count) { range in
+					for i in range where predicate(i) {
+						base[i] = true
+					}
+				}
+			}
+		} else {
+			for i in 0..<count where predicate(i) {
+				result[i] = true
+			}
+		}
+		return result
+	}
+}
+
+extension RandomAccessCollection {
+
+	/// The element at the given distance from `startIndex`, which is *O(1)* here.
+	/// (The engines work with offsets, while the indexes of slices and other collections don't have to start at 0.)
+	@inlinable
+	internal subscript(offset offset: Int) -> Element {
+		return self[index(startIndex, offsetBy: offset)]
+	}
+}
@@ -0,0 +1,116 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+// (A separate module with SwiftPM; with CocoaPods the core is compiled into the same one.)
+#if canImport(MMMArrayChangesCore)
+import MMMArrayChangesCore
+#endif
+
+extension MMMArrayChanges {
+
+	/// What `byUpdatingArray()` and friends do when several elements of the same array have the same ID.
+	public enum DuplicatePolicy {
+
+		/// Duplicate IDs are a programming error and trigger a precondition failure. This is the default.
+		case precondition
+
+		/// Only the first element with the same ID is matched: the rest of the duplicates in the old array
+		/// are removed and the ones in the new array are inserted. Use this to diff data that cannot be trusted,
+		/// e.g. coming from a backend, without deduplicating it first.
+		///
+		/// The duplicates are detected while indexing the IDs anyway, so this costs nothing when there are none.
+		case keepFirst
+	}
+
+	/// Applies the given policy to the duplicates found by `coreMatch()`.
+	internal static func check(_ result: MMMArrayChangesCoreResult, duplicates: DuplicatePolicy) {
+		switch duplicates {
+		case .precondition:
+			precondition(result.oldDuplicateCount == 0, "Elements in the `oldArray` cannot have duplicate IDs")
+			precondition(result.newDuplicateCount == 0, "Elements in the `newArray` cannot have duplicate IDs")
+		case .keepFirst:
+			break
+		}
+		Probe.current?.metrics.duplicates += result.oldDuplicateCount + result.newDuplicateCount
+	}
+
+	/// Matches the elements of both arrays by their IDs via the C core shared with the ObjC engine
+	/// (see `MMMArrayChangesCore.h`). The containers are cleared first, so the ones used before can be passed here
+	/// again to reuse their storage (see `MMMArrayChangesContext`).
+	///
+	/// - Parameters:
+	///   - key: The hash of an ID. Equal IDs must have equal keys, different ones should rarely collide.
+	///   - keys: Scratch storage for the keys of both arrays.
+	///   - slots: Scratch storage for the hash table.
+	///   - oldIndexByNewIndex: For every element of the `newArray` the index of the corresponding element
+	///     in the `oldArray`, or `NSNotFound` for the new ones.
+	///   - survives: True for the elements of the `oldArray` that have a corresponding one in the `newArray`.
+	/// - Returns: The duplicates found (only the first element with the same ID is matched) and the number
+	///   of the slots probed.
+	@_specialize(where ElementId == String)
+	@_specialize(where ElementId == Int)
+	@_specialize(where ElementId == UUID)
+	@_specialize(where ElementId == ObjectIdentifier)
+	internal static func coreMatch<ElementId: Equatable>(
+		oldIds: [ElementId],
+		newIds: [ElementId],
+		key: (ElementId) -> UInt64,
+		keys: inout [UInt64],
+		slots: inout [Int],
+		oldIndexByNewIndex: inout [Int],
+		survives: inout [Bool]
+	) -> MMMArrayChangesCoreResult {
+
+		let oldCount = oldIds.count
+		let newCount = newIds.count
+
+		keys.removeAll(keepingCapacity: true)
+		keys.reserveCapacity(oldCount + newCount)
+		for id in oldIds {
+			keys.append(key(id))
+		}
+		for id in newIds {
+			keys.append(key(id))
+		}
+
+		let slotCount = MMMArrayChangesCoreSlotCount(oldCount, newCount)
+		if slots.count < slotCount {
+			slots = [Int](repeating: 0, count: slotCount)
+		}
+		oldIndexByNewIndex.removeAll(keepingCapacity: true)
+		oldIndexByNewIndex.append(contentsOf: repeatElement(NSNotFound, count: newCount))
+		survives.removeAll(keepingCapacity: true)
+		survives.append(contentsOf: repeatElement(false, count: oldCount))
+
+		// The indexes are in the joint space of both arrays, see `MMMArrayChangesCoreEqual`.
+		var equal: (Int, Int) -> Bool = { (a, b) in
+			return (a < oldCount ? oldIds[a] : newIds[a - oldCount]) == (b < oldCount ? oldIds[b] : newIds[b - oldCount])
+		}
+
+		return withUnsafeMutablePointer(to: &equal) { equal in
+			keys.withUnsafeBufferPointer { keys in
+				slots.withUnsafeMutableBufferPointer { slots in
+					oldIndexByNewIndex.withUnsafeMutableBufferPointer { oldIndexByNewIndex in
+						survives.withUnsafeMutableBufferPointer { survives in
+							MMMArrayChangesCoreMatch(
+								keys.baseAddress, oldCount,
+								keys.baseAddress.map { $0 + oldCount }, newCount,
+								{ (context, a, b) in
+									context!.assumingMemoryBound(to: ((Int, Int) -> Bool).self).pointee(a, b)
+								},
+								equal,
+								slots.baseAddress,
+								oldIndexByNewIndex.baseAddress,
+								survives.baseAddress
+							)
+						}
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,326 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+// (`Identifiable` is in the standard library since Swift 5.1, while the pod can still be built in 4.2 mode.)
+#if compiler(>=5.1)
+
+/**
+An element that can tell not only its identity, but also the version of its contents, so the elements of two lists
+having the same ID can be compared without looking at any of their other fields.
+
+```
+struct CookieFromAPI: MMMDiffable {
+	let id: String
+	let name: String
+	let updatedAt: Date
+	var contentVersion: Date { return updatedAt }
+}
+```
+*/
+@available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *)
+public protocol MMMDiffable: Identifiable {
+
+	associatedtype ContentVersion: Equatable
+
+	/// A cheap "content version" of the element, like a modification date or a version counter maintained
+	/// by the backend. Equal versions of elements with the same ID mean the element has not changed.
+	var contentVersion: ContentVersion { get }
+}
+
+/**
+Shortcuts for elements conforming to `Identifiable`, so there is no need to pass the ID closures around.
+
+All of them are inlinable, so once specialized for the concrete types of the elements, accessing the IDs
+is inlined instead of going through closure contexts. (The IDs are still compared by the engines behind them:
+the integer one for `MMMArrayChangesIntegerId` IDs, picked by the corresponding overloads here, and the generic
+one otherwise.)
+*/
+@available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *)
+extension MMMArrayChanges {
+
+	/// Same as `byUpdatingArray(_:elementId:sourceArray:sourceElementId:...)`, but for `Identifiable` elements.
+	@inlinable
+	public static func byUpdatingArray<Element: Identifiable, SourceElement: Identifiable, Source: RandomAccessCollection>(
+		_ array: inout [Element],
+		sourceArray: Source,
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where Source.Element == SourceElement, Element.ID == SourceElement.ID {
+		return byUpdatingArray(
+			&array, elementId: { $0.id },
+			sourceArray: sourceArray, sourceElementId: { $0.id },
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: budget,
+			duplicates: duplicates,
+			update: update,
+			remove: remove,
+			transform: transform
+		)
+	}
+
+	/// Same as `byUpdatingArray(_:sourceArray:...)` for `Identifiable` elements, but for integer-like IDs,
+	/// see `MMMArrayChangesIntegerId`.
+	@inlinable
+	public static func byUpdatingArray<Element: Identifiable, SourceElement: Identifiable, Source: RandomAccessCollection>(
+		_ array: inout [Element],
+		sourceArray: Source,
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where
+		Source.Element == SourceElement,
+		Element.ID == SourceElement.ID,
+		Element.ID: MMMArrayChangesIntegerId
+	{
+		return byUpdatingArray(
+			&array, elementId: { $0.id },
+			sourceArray: sourceArray, sourceElementId: { $0.id },
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: budget,
+			duplicates: duplicates,
+			update: update,
+			remove: remove,
+			transform: transform
+		)
+	}
+
+	/**
+	Same as `byUpdatingArray(_:sourceArray:...)` for `Identifiable` elements, but the elements with the same ID
+	are compared by their `contentVersion` first: only the ones with different versions are recorded as updated
+	and passed to `update`.
+
+	- Parameters:
+
+		- update: Optional closure bringing the element up to date with its source element,
+			called only for the elements whose versions differ.
+	*/
+	@inlinable
+	public static func byUpdatingArray<Element: MMMDiffable, SourceElement: MMMDiffable, Source: RandomAccessCollection>(
+		_ array: inout [Element],
+		sourceArray: Source,
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Void)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where
+		Source.Element == SourceElement,
+		Element.ID == SourceElement.ID,
+		Element.ContentVersion == SourceElement.ContentVersion
+	{
+		return byUpdatingArray(
+			&array, elementId: { $0.id },
+			sourceArray: sourceArray, sourceElementId: { $0.id },
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: budget,
+			duplicates: duplicates,
+			update: { (element, oldIndex, sourceElement, newIndex) -> Bool in
+				guard element.contentVersion != sourceElement.contentVersion else {
+					return false
+				}
+				update?(element, oldIndex, sourceElement, newIndex)
+				return true
+			},
+			remove: remove,
+			transform: transform
+		)
+	}
+
+	/// Same as `byUpdatingArray(_:sourceArray:...)` for `MMMDiffable` elements, but for integer-like IDs,
+	/// see `MMMArrayChangesIntegerId`.
+	@inlinable
+	public static func byUpdatingArray<Element: MMMDiffable, SourceElement: MMMDiffable, Source: RandomAccessCollection>(
+		_ array: inout [Element],
+		sourceArray: Source,
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Void)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where
+		Source.Element == SourceElement,
+		Element.ID == SourceElement.ID,
+		Element.ContentVersion == SourceElement.ContentVersion,
+		Element.ID: MMMArrayChangesIntegerId
+	{
+		return byUpdatingArray(
+			&array, elementId: { $0.id },
+			sourceArray: sourceArray, sourceElementId: { $0.id },
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: budget,
+			duplicates: duplicates,
+			update: { (element, oldIndex, sourceElement, newIndex) -> Bool in
+				guard element.contentVersion != sourceElement.contentVersion else {
+					return false
+				}
+				update?(element, oldIndex, sourceElement, newIndex)
+				return true
+			},
+			remove: remove,
+			transform: transform
+		)
+	}
+
+	/// Changes between two arrays of `Identifiable` elements, matched by their IDs. No updates are recorded.
+	///
+	/// (Disfavored, so `Hashable` elements are still compared as a whole by `betweenSimpleArrays<Element: Hashable>`.)
+	@inlinable
+	@_disfavoredOverload
+	public static func betweenSimpleArrays<Element: Identifiable>(
+		oldArray: [Element], newArray: [Element],
+		moveDetection: MoveDetection = .greedy
+	) -> MMMArrayChanges {
+		var tempArray = oldArray
+		return byUpdatingArray(
+			&tempArray,
+			oldIds: oldArray.map { $0.id },
+			sourceArray: newArray,
+			newIds: newArray.map { $0.id },
+			moveDetection: moveDetection,
+			transform: { (newElement, _) -> Element in newElement }
+		)
+	}
+
+	/// Same as `betweenSimpleArrays(oldArray:newArray:moveDetection:)` for `Identifiable` elements,
+	/// but for integer-like IDs, see `MMMArrayChangesIntegerId`.
+	@inlinable
+	@_disfavoredOverload
+	public static func betweenSimpleArrays<Element: Identifiable>(
+		oldArray: [Element], newArray: [Element],
+		moveDetection: MoveDetection = .greedy
+	) -> MMMArrayChanges where Element.ID: MMMArrayChangesIntegerId {
+		var tempArray = oldArray
+		return byUpdatingArray(
+			&tempArray,
+			oldIds: oldArray.map { $0.id },
+			sourceArray: newArray,
+			newIds: newArray.map { $0.id },
+			moveDetection: moveDetection,
+			transform: { (newElement, _) -> Element in newElement }
+		)
+	}
+
+	/// Changes between two arrays of `MMMDiffable` elements, matched by their IDs, with the elements having
+	/// different `contentVersion` recorded as updated.
+	@inlinable
+	@_disfavoredOverload
+	public static func betweenSimpleArrays<Element: MMMDiffable>(
+		oldArray: [Element], newArray: [Element],
+		moveDetection: MoveDetection = .greedy
+	) -> MMMArrayChanges {
+		var tempArray = oldArray
+		return byUpdatingArray(
+			&tempArray,
+			oldIds: oldArray.map { $0.id },
+			sourceArray: newArray,
+			newIds: newArray.map { $0.id },
+			moveDetection: moveDetection,
+			update: { (element, _, sourceElement, _) -> Bool in
+				return element.contentVersion != sourceElement.contentVersion
+			},
+			transform: { (newElement, _) -> Element in newElement }
+		)
+	}
+
+	/// Same as `betweenSimpleArrays(oldArray:newArray:moveDetection:)` for `MMMDiffable` elements,
+	/// but for integer-like IDs, see `MMMArrayChangesIntegerId`.
+	@inlinable
+	@_disfavoredOverload
+	public static func betweenSimpleArrays<Element: MMMDiffable>(
+		oldArray: [Element], newArray: [Element],
+		moveDetection: MoveDetection = .greedy
+	) -> MMMArrayChanges where Element.ID: MMMArrayChangesIntegerId {
+		var tempArray = oldArray
+		return byUpdatingArray(
+			&tempArray,
+			oldIds: oldArray.map { $0.id },
+			sourceArray: newArray,
+			newIds: newArray.map { $0.id },
+			moveDetection: moveDetection,
+			update: { (element, _, sourceElement, _) -> Bool in
+				return element.contentVersion != sourceElement.contentVersion
+			},
+			transform: { (newElement, _) -> Element in newElement }
+		)
+	}
+}
+
+@available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *)
+extension Array where Element: Identifiable {
+
+	/// Same as `diffUpdate(elementId:sourceArray:sourceElementId:transform:update:remove:)`,
+	/// but for `Identifiable` elements.
+	@inlinable
+	@discardableResult
+	public mutating func diffUpdate<SourceElement: Identifiable, Source: Sequence>(
+		sourceArray: Source,
+		transform: (_ sourceElement: SourceElement) -> Element,
+		update: ((_ element: Element, _ sourceElement: SourceElement) -> Bool)? = nil,
+		remove: ((_ element: Element) -> Void)? = nil
+	) -> Bool where Source.Element == SourceElement, SourceElement.ID == Element.ID {
+		return diffUpdate(
+			elementId: { $0.id },
+			sourceArray: sourceArray, sourceElementId: { $0.id },
+			transform: transform,
+			update: update,
+			remove: remove
+		)
+	}
+}
+
+@available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *)
+extension Array where Element: MMMDiffable {
+
+	/// Same as `diffUpdate(sourceArray:transform:update:remove:)` for `Identifiable` elements, but `update`
+	/// is called only for the elements whose `contentVersion` differs from the one of their source elements;
+	/// these count as changes as well.
+	@inlinable
+	@discardableResult
+	public mutating func diffUpdate<SourceElement: MMMDiffable, Source: Sequence>(
+		sourceArray: Source,
+		transform: (_ sourceElement: SourceElement) -> Element,
+		update: ((_ element: Element, _ sourceElement: SourceElement) -> Void)? = nil,
+		remove: ((_ element: Element) -> Void)? = nil
+	) -> Bool where
+		Source.Element == SourceElement,
+		SourceElement.ID == Element.ID,
+		SourceElement.ContentVersion == Element.ContentVersion
+	{
+		return diffUpdate(
+			elementId: { $0.id },
+			sourceArray: sourceArray, sourceElementId: { $0.id },
+			transform: transform,
+			update: { (element, sourceElement) -> Bool in
+				guard element.contentVersion != sourceElement.contentVersion else {
+					return false
+				}
+				update?(element, sourceElement)
+				return true
+			},
+			remove: remove
+		)
+	}
+}
+
+#endif
@@ -0,0 +1,233 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+import os
+
+extension MMMArrayChanges {
+
+	/**
+	What it took to find or apply a diff, see `metricsObserver`.
+	*/
+	public struct Metrics: CustomStringConvertible {
+
+		public enum Operation: String {
+			/// Any of the `byUpdatingArray()` variants (including the ones of `MMMArrayChangesContext`).
+			case byUpdatingArray
+			/// `Array.diffUpdate()`.
+			case diffUpdate
+			/// `applySkippingReloads()`.
+			case applySkippingReloads
+			/// `applyReconfiguringUpdates()`.
+			case applyReconfiguringUpdates
+		}
+
+		/// The parts of an operation timed separately (and marked by signposts).
+		public enum Phase: String {
+			/// Getting the IDs of the elements.
+			case ids
+			/// Checking if the IDs of both arrays are the same.
+			case fastCheck
+			/// Building the index of the elements by their IDs and matching them.
+			case indexing
+			case removals
+			case insertions
+			case moves
+			/// Comparing the contents of the matching elements.
+			case updates
+			/// Applying the changes to the array or the view.
+			case replay
+		}
+
+		public let operation: Operation
+
+		/// The number of elements in the old and new arrays (`NSNotFound` when applying the changes to a view).
+		public internal(set) var oldCount: Int = 0
+		public internal(set) var newCount: Int = 0
+
+		/// How many times the ID closures were called.
+		public internal(set) var idCalls: Int = 0
+
+		/// The number of hash lookups (or insertions), i.e. of the slots of the ID table probed by the engine.
+		public internal(set) var lookups: Int = 0
+
+		/// The number of elements having the same ID as one of the elements before them in the same array,
+		/// see `DuplicatePolicy`.
+		public internal(set) var duplicates: Int = 0
+
+		/// The number of the records found or applied.
+		public internal(set) var removals: Int = 0
+		public internal(set) var insertions: Int = 0
+		public internal(set) var moves: Int = 0
+		public internal(set) var updates: Int = 0
+
+		/// True, if the changes have exceeded their budget, see `Budget`.
+		public internal(set) var isFullReload: Bool = false
+
+		/// The time spent in every phase, in seconds.
+		public internal(set) var durations: [Phase: TimeInterval] = [:]
+
+		/// The time spent in total, in seconds.
+		public internal(set) var elapsed: TimeInterval = 0
+
+		internal init(operation: Operation) {
+			self.operation = operation
+		}
+
+		public var description: String {
+			let phases = durations
+				.sorted { $0.value > $1.value }
+				.map { "\($0.key.rawValue): \(String(format: "%.3f", $0.value * 1000))ms" }
+				.joined(separator: ", ")
+			return "\(operation.rawValue)(\(oldCount) -> \(newCount), ids: \(idCalls), lookups: \(lookups), "
+				+ "-\(removals) +\(insertions) ~\(moves) *\(updates)"
+				+ "\(duplicates > 0 ? ", duplicates: \(duplicates)" : "")\(isFullReload ? ", full reload" : ""), "
+				+ "\(String(format: "%.3f", elapsed * 1000))ms: \(phases))"
+		}
+	}
+
+	/**
+	Opt-in instrumentation: when set, then the metrics of every `byUpdatingArray()`, `Array.diffUpdate()`
+	and `applySkippingReloads()` are passed here, so they can be aggregated into telemetry.
+
+	The closure is called synchronously on the thread of the operation after it completes. Set it (as well as
+	`emitsSignposts`) once early on, e.g. on app launch, these are not synchronized with the diffs running
+	on other threads. When neither is set, the only overhead is checking a flag per operation and per phase.
+	*/
+	public static var metricsObserver: ((_ metrics: Metrics) -> Void)? {
+		didSet {
+			Probe.isEnabled = metricsObserver != nil || emitsSignposts
+		}
+	}
+
+	/// When `true`, then every operation and its phases are marked with `os_signpost()` intervals (iOS 12+)
+	/// under the "MMMArrayChanges" subsystem, so they can be seen in Instruments.
+	public static var emitsSignposts: Bool = false {
+		didSet {
+			Probe.isEnabled = metricsObserver != nil || emitsSignposts
+		}
+	}
+
+	/**
+	Collects the metrics of an operation in progress.
+
+	Only the outermost operation on a thread is measured. It's registered as the current one for the thread,
+	so the internals of the engine can report their phases without threading it through all the calls.
+	*/
+	@usableFromInline
+	internal final class Probe {
+
+		// Follows `metricsObserver` and `emitsSignposts`, checked by every operation.
+		@usableFromInline
+		internal static var isEnabled: Bool = false
+
+		private static let threadKey = "MMMArrayChanges.Probe"
+
+		private static let log = OSLog(subsystem: "MMMArrayChanges", category: "MMMArrayChanges")
+
+		/// The probe of the operation in progress on the current thread, if any.
+		@usableFromInline
+		internal static var current: Probe? {
+			guard isEnabled else {
+				return nil
+			}
+			return Thread.current.threadDictionary[threadKey] as? Probe
+		}
+
+		/// Starts measuring the given operation, unless the instrumentation is off or there is one in progress
+		/// on the current thread already. The caller must `finish()` the probe returned.
+		@usableFromInline
+		internal static func begin(_ operation: Metrics.Operation) -> Probe? {
+			guard isEnabled, current == nil else {
+				return nil
+			}
+			let probe = Probe(operation)
+			Thread.current.threadDictionary[threadKey] = probe
+			return probe
+		}
+
+		internal var metrics: Metrics
+
+		private let observer: ((_ metrics: Metrics) -> Void)?
+		private let signpostId: Any?
+		private let start: UInt64
+		private var phase: Metrics.Phase?
+		private var phaseStart: UInt64
+
+		private init(_ operation: Metrics.Operation) {
+			self.metrics = Metrics(operation: operation)
+			self.observer = MMMArrayChanges.metricsObserver
+			self.start = DispatchTime.now().uptimeNanoseconds
+			self.phaseStart = start
+			if #available(iOS 12, macOS 10.14, tvOS 12, watchOS 5, *), MMMArrayChanges.emitsSignposts {
+				let signpostId = OSSignpostID(log: Probe.log)
+				os_signpost(.begin, log: Probe.log, name: "Operation", signpostID: signpostId, "%{public}s", operation.rawValue)
+				self.signpostId = signpostId
+			} else {
+				self.signpostId = nil
+			}
+		}
+
+		/// Ends the current phase, if any, and begins the given one.
+		@usableFromInline
+		internal func enter(_ phase: Metrics.Phase?) {
+			let now = DispatchTime.now().uptimeNanoseconds
+			if let previous = self.phase {
+				metrics.durations[previous, default: 0] += TimeInterval(now - phaseStart) / 1e9
+				if #available(iOS 12, macOS 10.14, tvOS 12, watchOS 5, *), let signpostId = signpostId as? OSSignpostID {
+					os_signpost(.end, log: Probe.log, name: "Phase", signpostID: signpostId, "%{public}s", previous.rawValue)
+				}
+			}
+			self.phase = phase
+			self.phaseStart = now
+			if let phase = phase {
+				if #available(iOS 12, macOS 10.14, tvOS 12, watchOS 5, *), let signpostId = signpostId as? OSSignpostID {
+					os_signpost(.begin, log: Probe.log, name: "Phase", signpostID: signpostId, "%{public}s", phase.rawValue)
+				}
+			}
+		}
+
+		@usableFromInline
+		internal func countIdCalls(_ count: Int) {
+			metrics.idCalls += count
+		}
+
+		/// Takes the numbers of records from the given changes.
+		internal func count(_ changes: MMMArrayChanges, oldCount: Int, newCount: Int) {
+			metrics.oldCount = oldCount
+			metrics.newCount = newCount
+			metrics.removals = changes.removals.count
+			metrics.insertions = changes.insertions.count
+			metrics.moves = changes.moves.count
+			metrics.updates = changes.updates.count
+			metrics.isFullReload = changes.isFullReload
+		}
+
+		/// Same as `count(_:oldCount:newCount:)`, but for `Array.diffUpdate()`, which does not record the changes.
+		/// Every ID closure is called once per element there and the IDs are looked up once as well.
+		@usableFromInline
+		internal func count(oldCount: Int, newCount: Int, insertions: Int, updates: Int) {
+			metrics.oldCount = oldCount
+			metrics.newCount = newCount
+			metrics.idCalls += oldCount + newCount
+			metrics.lookups += oldCount + newCount
+			metrics.insertions = insertions
+			metrics.removals = oldCount - (newCount - insertions)
+			metrics.updates = updates
+		}
+
+		/// Completes the measurement and passes the metrics to the observer.
+		@usableFromInline
+		internal func finish() {
+			enter(nil)
+			Thread.current.threadDictionary.removeObject(forKey: Probe.threadKey)
+			metrics.elapsed = TimeInterval(DispatchTime.now().uptimeNanoseconds - start) / 1e9
+			if #available(iOS 12, macOS 10.14, tvOS 12, watchOS 5, *), let signpostId = signpostId as? OSSignpostID {
+				os_signpost(.end, log: Probe.log, name: "Operation", signpostID: signpostId, "%{public}s", metrics.operation.rawValue)
+			}
+			observer?(metrics)
+		}
+	}
+}
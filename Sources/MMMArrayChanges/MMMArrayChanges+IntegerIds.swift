@@ -0,0 +1,188 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+/**
+IDs that are plain bit patterns, so the elements can be matched via a flat open-addressing table instead of
+the generic `Dictionary`/`Set` based engine.
+
+`Int`, `Int64`, `UUID` and `ObjectIdentifier` (thus `byUpdatingArrayOfObjects()`) conform already;
+the overloads of `byUpdatingArray()` and `betweenSimpleArrays()` for such IDs are picked automatically.
+*/
+public protocol MMMArrayChangesIntegerId: Hashable {
+
+	/// The bits of the ID folded into a single word. Equal IDs must have equal keys; different IDs may collide
+	/// (they are compared with `==` then), but should rarely do so.
+	var arrayChangesKey: UInt64 { get }
+}
+
+extension Int: MMMArrayChangesIntegerId {
+	@inlinable
+	public var arrayChangesKey: UInt64 { return UInt64(bitPattern: Int64(self)) }
+}
+
+extension Int64: MMMArrayChangesIntegerId {
+	@inlinable
+	public var arrayChangesKey: UInt64 { return UInt64(bitPattern: self) }
+}
+
+extension ObjectIdentifier: MMMArrayChangesIntegerId {
+	@inlinable
+	public var arrayChangesKey: UInt64 { return UInt64(UInt(bitPattern: self)) }
+}
+
+extension UUID: MMMArrayChangesIntegerId {
+	@inlinable
+	public var arrayChangesKey: UInt64 {
+		var uuid = self.uuid
+		var words: (UInt64, UInt64) = (0, 0)
+		withUnsafeBytes(of: &uuid) { source in
+			withUnsafeMutableBytes(of: &words) { $0.copyMemory(from: source) }
+		}
+		return words.0 ^ words.1
+	}
+}
+
+extension MMMArrayChanges {
+
+	/// Same as `byUpdatingArray(_:elementId:sourceArray:sourceElementId:...)`, but for integer-like IDs,
+	/// see `MMMArrayChangesIntegerId`.
+	@inlinable
+	public static func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection, ElementId: MMMArrayChangesIntegerId>(
+		_ array: inout [Element], elementId: (Element) -> ElementId,
+		sourceArray: Source, sourceElementId: (SourceElement) -> ElementId,
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+		let probe = Probe.begin(.byUpdatingArray)
+		defer { probe?.finish() }
+		probe?.enter(.ids)
+		// (Can't map `array` in the call itself as it's passed as `inout` there.)
+		let oldIds = map(array, concurrent: concurrent, elementId)
+		let newIds = map(sourceArray, concurrent: concurrent, sourceElementId)
+		probe?.countIdCalls(oldIds.count + newIds.count)
+		return byUpdatingArray(
+			&array, oldIds: oldIds,
+			sourceArray: sourceArray, newIds: newIds,
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: budget,
+			duplicates: duplicates,
+			update: update,
+			remove: remove,
+			transform: transform
+		)
+	}
+
+	/// Same as `byUpdatingArray(_:oldIds:sourceArray:newIds:...)`, but for integer-like IDs,
+	/// see `MMMArrayChangesIntegerId`.
+	public static func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection, ElementId: MMMArrayChangesIntegerId>(
+		_ array: inout [Element], oldIds: [ElementId],
+		sourceArray: Source, newIds: [ElementId],
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+		return byUpdatingArray(
+			&array, oldIdCount: oldIds.count,
+			sourceArray: sourceArray, newIdCount: newIds.count,
+			update: update,
+			remove: remove,
+			transform: transform
+		) { isUpdated in
+			integerChanges(
+				oldIds: oldIds,
+				newIds: newIds,
+				moveDetection: moveDetection,
+				concurrent: concurrent,
+				budget: budget,
+				duplicates: duplicates,
+				isUpdated: isUpdated
+			)
+		}
+	}
+
+	/// Same as `betweenSimpleArrays(oldArray:newArray:moveDetection:)`, but for integer-like elements,
+	/// see `MMMArrayChangesIntegerId`.
+	@inlinable
+	public static func betweenSimpleArrays<Element: MMMArrayChangesIntegerId>(
+		oldArray: [Element], newArray: [Element],
+		moveDetection: MoveDetection = .greedy
+	) -> MMMArrayChanges {
+		var tempArray = oldArray
+		return byUpdatingArray(
+			&tempArray,
+			oldIds: oldArray,
+			sourceArray: newArray,
+			newIds: newArray,
+			moveDetection: moveDetection,
+			transform: { (newElement, _) -> Element in newElement }
+		)
+	}
+
+	/// Same as `changes(oldIds:newIds:moveDetection:concurrent:isUpdated:)`, but keying the table of the core
+	/// directly by `arrayChangesKey`, which is significantly cheaper than generic hashing.
+	@_specialize(where Id == Int)
+	@_specialize(where Id == Int64)
+	@_specialize(where Id == UUID)
+	@_specialize(where Id == ObjectIdentifier)
+	internal static func integerChanges<Id: MMMArrayChangesIntegerId>(
+		oldIds: [Id],
+		newIds: [Id],
+		moveDetection: MoveDetection,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?
+	) -> MMMArrayChanges {
+
+		let probe = Probe.current
+		probe?.enter(.fastCheck)
+
+		if oldIds == newIds {
+			return unchanged(count: oldIds.count, concurrent: concurrent, isUpdated: isUpdated)
+		}
+
+		probe?.enter(.indexing)
+		let tracker = Budget.Tracker(budget)
+
+		// The same table as for the other IDs, just keyed directly, see `coreMatch()`.
+		var keys: [UInt64] = []
+		var slots: [Int] = []
+		var oldIndexByNewIndex: [Int] = []
+		var survives: [Bool] = []
+		let result = coreMatch(
+			oldIds: oldIds,
+			newIds: newIds,
+			key: { $0.arrayChangesKey },
+			keys: &keys,
+			slots: &slots,
+			oldIndexByNewIndex: &oldIndexByNewIndex,
+			survives: &survives
+		)
+		check(result, duplicates: duplicates)
+
+		probe?.metrics.lookups += result.steps
+
+		return changes(
+			oldIndexByNewIndex: oldIndexByNewIndex,
+			survives: survives,
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: tracker,
+			isUpdated: isUpdated
+		)
+	}
+}
@@ -0,0 +1,230 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+extension MMMArrayChanges {
+
+	/// Determines how moved elements are detected by `byUpdatingArray()` and friends.
+	public enum MoveDetection {
+
+		/// Going through the new array every element that is not in its place in the intermediate array yet
+		/// gets a move. This is cheap, but can produce much more moves than necessary: moving the last element
+		/// to the front results in a single move, while moving the first element to the end results in moves
+		/// of all the other elements.
+		case greedy
+
+		/// The smallest possible set of moves: only the elements outside of the longest increasing subsequence
+		/// of the old indexes of the surviving elements taken in the order of the new array are moved.
+		/// Still *O(n * log(n))*, but with a larger constant. Use this when every move is expensive, e.g. when every
+		/// one of them becomes an animation in a `UITableView`.
+		case minimal
+	}
+
+	/// Moves between two arrays given a mapping of the elements of the new array to the elements of the old one.
+	///
+	/// - Parameters:
+	///   - oldIndexByNewIndex: For every element of the new array the index of the corresponding element in the old
+	///     one or `NSNotFound` for the inserted elements.
+	///   - survives: True for the elements of the old array having a corresponding element in the new one.
+	internal static func detectMoves(
+		oldIndexByNewIndex: [Int],
+		survives: [Bool],
+		moveDetection: MoveDetection
+	) -> [Move] {
+		return detectMoves(
+			oldIndexByNewIndex: oldIndexByNewIndex,
+			survives: survives,
+			moveDetection: moveDetection,
+			budget: .unlimited
+		)!
+	}
+
+	/// Same as `detectMoves(oldIndexByNewIndex:survives:moveDetection:)`, but giving up as soon as there are more
+	/// moves than allowed by the budget or its time is over, `nil` is returned then.
+	internal static func detectMoves(
+		oldIndexByNewIndex: [Int],
+		survives: [Bool],
+		moveDetection: MoveDetection,
+		budget: Budget.Tracker
+	) -> [Move]? {
+		switch moveDetection {
+		case .greedy:
+			return greedyMoves(oldIndexByNewIndex: oldIndexByNewIndex, survives: survives, budget: budget)
+		case .minimal:
+			return minimalMoves(oldIndexByNewIndex: oldIndexByNewIndex, survives: survives, budget: budget)
+		}
+	}
+
+	/// How often the clock of a budget is checked, so it does not slow down the loops.
+	private static let budgetCheckMask = 0xFFF
+
+	private static func greedyMoves(oldIndexByNewIndex: [Int], survives: [Bool], budget: Budget.Tracker) -> [Move]? {
+
+		// We don't maintain the intermediate array (the old one after all the removals and the moves so far) explicitly.
+		// Its first `intermediateTargetIndex` elements are in place already, while the rest are the elements that are not
+		// at their target positions yet, and these always keep their relative order from the old array.
+		// So marking the latter by their old indexes, the number of marked elements preceding an element
+		// tells its position in the intermediate array.
+		var pending = FenwickTree(survives.map { $0 ? 1 : 0 })
+
+		var moves: [Move] = []
+
+		// Going through the new array and checking where each element has moved from.
+		var intermediateTargetIndex: Int = 0
+		for (newIndex, oldIndex) in oldIndexByNewIndex.enumerated() where oldIndex != NSNotFound {
+
+			// Let's see where this element is in the intermediate array.
+			let intermediateSourceIndex = intermediateTargetIndex + pending.prefixSum(oldIndex)
+			if intermediateSourceIndex != intermediateTargetIndex {
+				// A different element here, need a move.
+				moves.append(.init(oldIndex, newIndex, intermediateSourceIndex, intermediateTargetIndex))
+				if moves.count > budget.maxMoves {
+					return nil
+				}
+			}
+			if newIndex & budgetCheckMask == 0 && budget.isOverTime {
+				return nil
+			}
+
+			// Either way it's in place now, which also updates the intermediate array accordingly.
+			pending.add(-1, at: oldIndex)
+
+			intermediateTargetIndex += 1
+		}
+
+		return moves
+	}
+
+	private static func minimalMoves(oldIndexByNewIndex: [Int], survives: [Bool], budget: Budget.Tracker) -> [Move]? {
+
+		// Positions of the surviving elements in the intermediate array before any moves.
+		var intermediateIndexByOldIndex = [Int](repeating: NSNotFound, count: survives.count)
+		var survivorCount = 0
+		for (oldIndex, s) in survives.enumerated() where s {
+			intermediateIndexByOldIndex[oldIndex] = survivorCount
+			survivorCount += 1
+		}
+
+		// The same positions for all the surviving elements taken in the order of the new array.
+		var sequence: [Int] = []
+		sequence.reserveCapacity(survivorCount)
+		for oldIndex in oldIndexByNewIndex where oldIndex != NSNotFound {
+			sequence.append(intermediateIndexByOldIndex[oldIndex])
+		}
+
+		let stays = longestIncreasingSubsequence(sequence)
+		if sequence.count - stays.lazy.filter({ $0 }).count > budget.maxMoves || budget.isOverTime {
+			return nil
+		}
+
+		// Every moved element is inserted right after the closest element preceding it in the new array that stays
+		// (its "anchor") or in the very beginning of the array if there is no such element. The moves are performed
+		// in the order of the new array, so all the elements moved after the same anchor form a group ordered
+		// as in the new array. Thus the intermediate array at any moment can be seen as the following sequence
+		// of slots, some of them being vacant: the group of the beginning, then every element of the intermediate
+		// array before any moves, each followed by its own group (if it stays).
+		//
+		// Groups are indexed by the intermediate index of their anchor plus one, 0 being the group of the beginning.
+		var groupSizes = [Int](repeating: 0, count: survivorCount + 1)
+		var groupByPosition = [Int](repeating: 0, count: sequence.count)
+		var indexInGroupByPosition = [Int](repeating: 0, count: sequence.count)
+		var group = 0
+		for (k, intermediateIndex) in sequence.enumerated() {
+			if stays[k] {
+				group = intermediateIndex + 1
+			} else {
+				groupByPosition[k] = group
+				indexInGroupByPosition[k] = groupSizes[group]
+				groupSizes[group] += 1
+			}
+		}
+
+		var groupStarts = [Int](repeating: 0, count: survivorCount + 1)
+		var elementSlots = [Int](repeating: 0, count: survivorCount)
+		var slotCount = groupSizes[0]
+		for intermediateIndex in 0..<survivorCount {
+			elementSlots[intermediateIndex] = slotCount
+			slotCount += 1
+			groupStarts[intermediateIndex + 1] = slotCount
+			slotCount += groupSizes[intermediateIndex + 1]
+		}
+
+		// Initially only the slots of the elements themselves are occupied. The number of occupied slots
+		// preceding a slot is the position of the corresponding element in the intermediate array.
+		var occupied: FenwickTree = {
+			var marks = [Int](repeating: 0, count: slotCount)
+			for slot in elementSlots {
+				marks[slot] = 1
+			}
+			return FenwickTree(marks)
+		}()
+
+		var moves: [Move] = []
+		var k = 0
+		for (newIndex, oldIndex) in oldIndexByNewIndex.enumerated() where oldIndex != NSNotFound {
+
+			if !stays[k] {
+
+				let sourceSlot = elementSlots[sequence[k]]
+				let intermediateSourceIndex = occupied.prefixSum(sourceSlot)
+				occupied.add(-1, at: sourceSlot)
+
+				let targetSlot = groupStarts[groupByPosition[k]] + indexInGroupByPosition[k]
+				let intermediateTargetIndex = occupied.prefixSum(targetSlot)
+				occupied.add(1, at: targetSlot)
+
+				moves.append(.init(oldIndex, newIndex, intermediateSourceIndex, intermediateTargetIndex))
+			}
+
+			k += 1
+		}
+
+		return moves
+	}
+
+	/// Flags the elements of the given sequence belonging to its longest strictly increasing subsequence.
+	/// *O(n * log(n))*.
+	private static func longestIncreasingSubsequence(_ sequence: [Int]) -> [Bool] {
+
+		// tails[l] is the position of the smallest last element among increasing subsequences of length l + 1 found so far.
+		var tails: [Int] = []
+		// The position of the previous element in the subsequence ending at the given position.
+		var previous = [Int](repeating: -1, count: sequence.count)
+
+		for (i, value) in sequence.enumerated() {
+
+			// Looking for the first tail that is not smaller than the current value.
+			var low = 0
+			var high = tails.count
+			while low < high {
+				let mid = (low + high) / 2
+				if sequence[tails[mid]] < value {
+					low = mid + 1
+				} else {
+					high = mid
+				}
+			}
+
+			if low > 0 {
+				previous[i] = tails[low - 1]
+			}
+			if low == tails.count {
+				tails.append(i)
+			} else {
+				tails[low] = i
+			}
+		}
+
+		var result = [Bool](repeating: false, count: sequence.count)
+		var i = tails.last ?? -1
+		while i >= 0 {
+			result[i] = true
+			i = previous[i]
+		}
+
+		return result
+	}
+}
@@ -0,0 +1,132 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+extension MMMArrayChanges {
+
+	/**
+	A read-only view of the records of one kind (removals, insertions, etc) of `MMMArrayChanges`.
+
+	All the records of a diff are packed into a single buffer of 32-bit indexes, so a diff takes one allocation
+	regardless of the number of changes and half of the memory of the arrays of records. The records are decoded
+	lazily as they are read, use `Array(changes.moves)` in case a regular array is needed.
+	*/
+	public struct Records<Record>: RandomAccessCollection, CustomStringConvertible {
+
+		public typealias Index = Int
+
+		private let buffer: ContiguousArray<Int32>
+		private let offset: Int
+		private let width: Int
+		private let decode: (_ buffer: ContiguousArray<Int32>, _ offset: Int) -> Record
+
+		internal init(
+			_ buffer: ContiguousArray<Int32>, offset: Int, count: Int, width: Int,
+			decode: @escaping (_ buffer: ContiguousArray<Int32>, _ offset: Int) -> Record
+		) {
+			self.buffer = buffer
+			self.offset = offset
+			self.count = count
+			self.width = width
+			self.decode = decode
+		}
+
+		public let count: Int
+
+		public var startIndex: Int { return 0 }
+		public var endIndex: Int { return count }
+
+		public subscript(position: Int) -> Record {
+			precondition(0 <= position && position < count, "Record index is out of range")
+			return decode(buffer, offset + position * width)
+		}
+
+		public var description: String {
+			return "[\(map { String(describing: $0) }.joined(separator: ", "))]"
+		}
+	}
+
+	/// Packs records into the storage of `MMMArrayChanges` as they are found. The storage keeps the records of every
+	/// kind together, so they must come in its order: all removals first, then insertions, moves and updates.
+	internal struct Builder {
+
+		private(set) var buffer = ContiguousArray<Int32>()
+		// 0 for removals, 1 for insertions, 2 for moves and 3 for updates.
+		private var kind = 0
+		// Where the records of every kind but removals begin in the buffer.
+		private(set) var insertionsOffset = 0
+		private(set) var movesOffset = 0
+		private(set) var updatesOffset = 0
+
+		init() {}
+
+		/// Reserves the space for the given number of values in total, 1 per removal/insertion,
+		/// 4 per move and 2 per update.
+		mutating func reserveCapacity(_ count: Int) {
+			buffer.reserveCapacity(count)
+		}
+
+		private mutating func begin(_ kind: Int) {
+			precondition(self.kind <= kind, "Records should be added in the order of the storage")
+			while self.kind < kind {
+				self.kind += 1
+				switch self.kind {
+				case 1:
+					insertionsOffset = buffer.count
+				case 2:
+					movesOffset = buffer.count
+				default:
+					updatesOffset = buffer.count
+				}
+			}
+		}
+
+		private mutating func append(_ index: Int) {
+			// Trapping on overflow: not expecting lists with more than 2^31 elements in the UI.
+			buffer.append(Int32(index))
+		}
+
+		mutating func appendRemoval(_ index: Int) {
+			begin(0)
+			append(index)
+		}
+
+		mutating func appendInsertion(_ index: Int) {
+			begin(1)
+			append(index)
+		}
+
+		mutating func append(_ m: Move) {
+			begin(2)
+			append(m.oldIndex)
+			append(m.newIndex)
+			append(m.intermediateSourceIndex)
+			append(m.intermediateTargetIndex)
+		}
+
+		mutating func appendUpdate(_ oldIndex: Int, _ newIndex: Int) {
+			begin(3)
+			append(oldIndex)
+			append(newIndex)
+		}
+
+		/// Marks the end of the records, so the offsets of the kinds that have not been added yet are set.
+		mutating func finish() {
+			begin(3)
+		}
+
+		func changes() -> MMMArrayChanges {
+			return buffer.isEmpty ? MMMArrayChanges.empty : MMMArrayChanges(self)
+		}
+	}
+}
+
+extension MMMArrayChanges.Records: Equatable where Record: Equatable {
+
+	public static func == (a: MMMArrayChanges.Records<Record>, b: MMMArrayChanges.Records<Record>) -> Bool {
+		return a.elementsEqual(b)
+	}
+}
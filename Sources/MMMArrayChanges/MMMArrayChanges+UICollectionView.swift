@@ -0,0 +1,79 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+#if canImport(UIKit)
+
+import UIKit
+
+extension MMMArrayChanges {
+
+	/**
+	Replays the changes represented by the receiver onto the given collection view.
+
+	Removals, insertions and moves are applied within a single `performBatchUpdates()`. Similar to table views,
+	collection views don't like reloads of the items being moved in the same batch, so the updates
+	(if `reloadUpdated` is `true`) are coalesced into a single `reloadItems()` within another batch performed
+	right after the first one, without waiting for its animations: the index paths of the reloads are valid
+	only until the next batch, and the updated cells should not show the old contents while animating anyway.
+	Nothing is done at all when there are no changes.
+
+	Changes marked as a full reload (see `Budget`) are applied via `reloadData()` instead.
+
+	- Parameters:
+
+		- indexPathForItemIndex: A closure returning an index path corresponding to the index of the element
+			either in the new or the old arrays. I.e. it can only customize the section or provide fixed shift
+			of item indexes.
+
+		- reloadUpdated: `false` to skip the updates, e.g. when the cells observe their view models
+			and update themselves.
+
+		- completion: Called when the animations of the first batch are complete with `finished` being `false`
+			if they were interrupted. Not called when there was nothing to apply.
+
+	- Returns: `true`, if at least one change has been applied.
+	*/
+	@discardableResult
+	public func apply(
+		to collectionView: UICollectionView,
+		indexPathForItemIndex: (_ itemIndex: Int) -> IndexPath,
+		reloadUpdated: Bool = true,
+		completion: ((_ finished: Bool) -> Void)? = nil
+	) -> Bool {
+
+		if isFullReload {
+			collectionView.reloadData()
+			completion?(true)
+			return true
+		}
+
+		let hasOtherChanges = removals.count + insertions.count + moves.count > 0
+		let reloads = reloadUpdated ? updates.map { indexPathForItemIndex($0.newIndex) } : []
+
+		guard hasOtherChanges || !reloads.isEmpty else {
+			return false
+		}
+
+		if hasOtherChanges {
+			collectionView.performBatchUpdates({
+				collectionView.deleteItems(at: removals.map { indexPathForItemIndex($0.index) })
+				collectionView.insertItems(at: insertions.map { indexPathForItemIndex($0.index) })
+				moves.forEach {
+					collectionView.moveItem(at: indexPathForItemIndex($0.oldIndex), to: indexPathForItemIndex($0.newIndex))
+				}
+			}, completion: completion)
+		}
+
+		if !reloads.isEmpty {
+			collectionView.performBatchUpdates({
+				collectionView.reloadItems(at: reloads)
+			}, completion: hasOtherChanges ? nil : completion)
+		}
+
+		return true
+	}
+}
+
+#endif
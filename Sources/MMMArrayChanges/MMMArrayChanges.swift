@@ -101,48 +101,114 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 		}
 	}
 
-	public let removals: [Removal]
-	public let insertions: [Insertion]
-	public let moves: [Move]
-	public let updates: [Update]
+	/// All the records packed together, see `Records`: the indexes of removals, then the ones of insertions,
+	/// then moves and updates taking 4 and 2 values per record correspondingly.
+	private let records: ContiguousArray<Int32>
+	private let insertionsOffset: Int
+	private let movesOffset: Int
+	private let updatesOffset: Int
+
+	/// Set instead of the records for changes marked as a "full reload", see `Budget`. The mapping of the elements
+	/// is still needed to update an array.
+	internal struct FullReload {
+		let oldCount: Int
+		/// For every element of the new array the index of the corresponding one in the old array or `NSNotFound`.
+		let oldIndexByNewIndex: [Int]
+	}
+	internal let fullReload: FullReload?
+
+	/// True, if the changes have exceeded their budget (see `Budget`), so no records are available and the list
+	/// should be simply reloaded. The helpers replaying the changes onto table and collection views
+	/// and arrays handle this automatically.
+	public var isFullReload: Bool {
+		return fullReload != nil
+	}
 
-	public init(removals: [Removal], insertions: [Insertion], moves: [Move], updates: [Update]) {
-		self.removals = removals
-		self.insertions = insertions
-		self.moves = moves
-		self.updates = updates
+	/// Removals in the reverse order of their indexes, so they can be performed one by one without corrections.
+	public var removals: Records<Removal> {
+		return Records(records, offset: 0, count: insertionsOffset, width: 1) { (buffer, i) in
+			Removal(Int(buffer[i]))
+		}
+	}
+
+	public var insertions: Records<Insertion> {
+		return Records(records, offset: insertionsOffset, count: movesOffset - insertionsOffset, width: 1) { (buffer, i) in
+			Insertion(Int(buffer[i]))
+		}
+	}
+
+	public var moves: Records<Move> {
+		return Records(records, offset: movesOffset, count: (updatesOffset - movesOffset) / 4, width: 4) { (buffer, i) in
+			Move(Int(buffer[i]), Int(buffer[i + 1]), Int(buffer[i + 2]), Int(buffer[i + 3]))
+		}
+	}
+
+	public var updates: Records<Update> {
+		return Records(records, offset: updatesOffset, count: (records.count - updatesOffset) / 2, width: 2) { (buffer, i) in
+			Update(Int(buffer[i]), Int(buffer[i + 1]))
+		}
+	}
+
+	public convenience init(removals: [Removal], insertions: [Insertion], moves: [Move], updates: [Update]) {
+		var builder = Builder()
+		builder.reserveCapacity(removals.count + insertions.count + 4 * moves.count + 2 * updates.count)
+		removals.forEach { builder.appendRemoval($0.index) }
+		insertions.forEach { builder.appendInsertion($0.index) }
+		moves.forEach { builder.append($0) }
+		updates.forEach { builder.appendUpdate($0.oldIndex, $0.newIndex) }
+		self.init(builder)
+	}
+
+	/// Shared by all the diffs without changes, so these don't allocate anything.
+	internal static let empty = MMMArrayChanges(Builder())
+
+	internal init(_ builder: Builder) {
+		var builder = builder
+		builder.finish()
+		self.records = builder.buffer
+		self.insertionsOffset = builder.insertionsOffset
+		self.movesOffset = builder.movesOffset
+		self.updatesOffset = builder.updatesOffset
+		self.fullReload = nil
+	}
+
+	internal init(fullReload: FullReload) {
+		self.records = []
+		self.insertionsOffset = 0
+		self.movesOffset = 0
+		self.updatesOffset = 0
+		self.fullReload = fullReload
 	}
 
 	/// True if the receiver represents "no changes" situation.
 	public var isEmpty: Bool {
-		return removals.isEmpty && insertions.isEmpty && moves.isEmpty && updates.isEmpty
+		return records.isEmpty && fullReload == nil
 	}
 
 	// This and related Equatables are for unit-testing only.
 	public static func == (a: MMMArrayChanges, b: MMMArrayChanges) -> Bool {
-		return a.removals == b.removals
-			&& a.insertions == b.insertions
-			&& a.moves == b.moves
-			&& a.updates == b.updates
+		// The packing is unambiguous, so the storage can be compared directly.
+		return a.insertionsOffset == b.insertionsOffset
+			&& a.movesOffset == b.movesOffset
+			&& a.updatesOffset == b.updatesOffset
+			&& a.records == b.records
+			&& a.fullReload?.oldCount == b.fullReload?.oldCount
+			&& a.fullReload?.oldIndexByNewIndex == b.fullReload?.oldIndexByNewIndex
 	}
 
 	public var description: String {
 
-		var changes: [CustomStringConvertible] = []
-		changes.append(contentsOf: removals)
-		changes.append(contentsOf: insertions)
-		changes.append(contentsOf: moves)
-		changes.append(contentsOf: updates)
-
-		var result = ""
-		changes.forEach {
-			if !result.isEmpty {
-				result.append(", ")
-			}
-			result.append(String(describing: $0))
+		guard fullReload == nil else {
+			return "\(String(describing: type(of: self)))(full reload)"
 		}
 
-		return "\(String(describing: type(of: self)))(\(result))"
+		var changes: [String] = []
+		changes.append(contentsOf: removals.map { String(describing: $0) })
+		changes.append(contentsOf: insertions.map { String(describing: $0) })
+		changes.append(contentsOf: moves.map { String(describing: $0) })
+		changes.append(contentsOf: updates.map { String(describing: $0) })
+
+		return "\(String(describing: type(of: self)))(\(changes.joined(separator: ", ")))"
 	}
 
     /**
@@ -156,6 +222,11 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 	3. New items are inserted with `transform` closure making items for the array from items of the `sourceArray`.
 	4. Old items are updated from the new ones by the `update` closure.
 
+	(For changes marked as a full reload every element that is not inserted is updated.)
+
+	(The first three steps are performed in a single *O(n)* pass over the array, but the closures are still called
+	in the above order.)
+
 	- Parameters:
 
 		- array: The array we're replaying changes onto.
@@ -169,34 +240,178 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 
 		- update: Updates the given element from a target array based on the corresponding element from the `sourceArray`.
 	*/
-    public func applyToArray<Element, SourceElement>(
+    public func applyToArray<Element, SourceElement, Source: RandomAccessCollection>(
     	_ array: inout [Element],
-    	sourceArray: [SourceElement],
+    	sourceArray: Source,
     	remove: ((_ element: Element) -> Void),
     	transform: (_ newElement: SourceElement) -> Element,
     	update: ((_ element: Element, _ sourceElement: SourceElement) -> Void)
-	) {
+	) where Source.Element == SourceElement {
+
+		rebuild(
+			&array,
+			sourceArray: sourceArray,
+			remove: { (element, _) in remove(element) },
+			transform: { (newElement, _) in transform(newElement) }
+		)
+
+		if let fullReload = fullReload {
+			for (newIndex, oldIndex) in fullReload.oldIndexByNewIndex.enumerated() where oldIndex != NSNotFound {
+				update(array[newIndex], sourceArray[offset: newIndex])
+			}
+		} else {
+			for u in updates {
+				update(array[u.newIndex], sourceArray[offset: u.newIndex])
+			}
+		}
+	}
+
+	/// Performs removals, moves and insertions represented by the receiver in a single pass over the array instead of
+	/// replaying them one by one via `remove(at:)`/`insert(_:at:)`, which would shift the tail of the array every time.
+	///
+	/// The `remove` closure is called for all the removals first, then `transform` is called for every insertion,
+	/// both in the order of the corresponding records.
+	internal func rebuild<Element, SourceElement, Source: RandomAccessCollection>(
+		_ array: inout [Element],
+		sourceArray: Source,
+		remove: (_ element: Element, _ oldIndex: Int) -> Void,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) where Source.Element == SourceElement {
+
+		if let fullReload = fullReload {
+			rebuild(&array, sourceArray: sourceArray, fullReload: fullReload, remove: remove, transform: transform)
+			return
+		}
+
+		// Nothing to rebuild when there are only updates (or no changes at all), which is the most common case.
+		guard updatesOffset > 0 else {
+			return
+		}
+
+		let newCount = array.count - removals.count + insertions.count
+
+		// True for the elements of the old array that don't simply stay, i.e. removed or moved ones.
+		var displaced = [Bool](repeating: false, count: array.count)
+		// What ends up at every position of the new array: the old index of an element moved there,
+		// `NSNotFound` in case of an insertion or -1 for the next element that simply stays.
+		var sources = [Int](repeating: -1, count: newCount)
 
 		for r in removals {
-			let item = array[r.index]
-			array.remove(at: r.index)
-			remove(item)
+			displaced[r.index] = true
+			remove(array[r.index], r.index)
 		}
 
 		for m in moves {
-			let item = array[m.intermediateSourceIndex]
-			array.remove(at: m.intermediateSourceIndex)
-			array.insert(item, at: m.intermediateTargetIndex)
+			displaced[m.oldIndex] = true
+			sources[m.newIndex] = m.oldIndex
 		}
 
 		for i in insertions {
-			let item = transform(sourceArray[i.index])
-			array.insert(item, at: i.index)
+			sources[i.index] = NSNotFound
+		}
+
+		// The elements that are neither removed nor moved keep their relative order,
+		// so they fill the remaining positions in the order they appear in the old array.
+		var result: [Element] = []
+		result.reserveCapacity(newCount)
+		var next = 0
+		for newIndex in 0..<newCount {
+			let source = sources[newIndex]
+			if source == NSNotFound {
+				result.append(transform(sourceArray[offset: newIndex], newIndex))
+			} else if source >= 0 {
+				result.append(array[source])
+			} else {
+				while displaced[next] {
+					next += 1
+				}
+				result.append(array[next])
+				next += 1
+			}
+		}
+
+		array = result
+	}
+
+	/// Same as `rebuild(_:sourceArray:remove:transform:)`, but for changes marked as a full reload,
+	/// where the mapping of the elements is known directly.
+	private func rebuild<Element, SourceElement, Source: RandomAccessCollection>(
+		_ array: inout [Element],
+		sourceArray: Source,
+		fullReload: FullReload,
+		remove: (_ element: Element, _ oldIndex: Int) -> Void,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) where Source.Element == SourceElement {
+
+		precondition(array.count == fullReload.oldCount, "The changes do not correspond to the array")
+
+		var survives = [Bool](repeating: false, count: array.count)
+		for oldIndex in fullReload.oldIndexByNewIndex where oldIndex != NSNotFound {
+			survives[oldIndex] = true
+		}
+		// In the same order as `removals` would be.
+		for oldIndex in (0..<array.count).reversed() where !survives[oldIndex] {
+			remove(array[oldIndex], oldIndex)
 		}
 
-		for u in updates {
-			update(array[u.newIndex], sourceArray[u.newIndex])
+		var result: [Element] = []
+		result.reserveCapacity(fullReload.oldIndexByNewIndex.count)
+		for (newIndex, oldIndex) in fullReload.oldIndexByNewIndex.enumerated() {
+			if oldIndex == NSNotFound {
+				result.append(transform(sourceArray[offset: newIndex], newIndex))
+			} else {
+				result.append(array[oldIndex])
+			}
+		}
+
+		array = result
+	}
+
+	/// The updated rows touched by `applyReconfiguringUpdates()`, see `visibleUpdatedRows()`.
+	public struct UpdatedRows {
+
+		/// The updates of the rows that are visible.
+		public let updates: [Update]
+
+		/// The index paths of these rows before the changes are applied, as expected by `reconfigureRows()`
+		/// and `cellForRow(at:)` within the transaction.
+		public let oldIndexPaths: [IndexPath]
+
+		/// The index paths of the same rows after the changes are applied, as expected by the reloads
+		/// following the transaction.
+		public let newIndexPaths: [IndexPath]
+	}
+
+	/**
+	Selects the `updates` that `applyReconfiguringUpdates()` reconfigures or reloads: only the ones of the rows
+	visible before the changes are applied, the rest are going to be configured when dequeued anyway.
+
+	- Parameters:
+
+		- visibleIndexPaths: The index paths of the rows on screen, like `indexPathsForVisibleRows` of a table view
+			that has not been updated yet.
+
+		- indexPathForItemIndex: Same as in `applySkippingReloads()`.
+	*/
+	public func visibleUpdatedRows(
+		visibleIndexPaths: [IndexPath],
+		indexPathForItemIndex: (_ itemIndex: Int) -> IndexPath
+	) -> UpdatedRows {
+		let visible = Set(visibleIndexPaths)
+		var updates: [Update] = []
+		var oldIndexPaths: [IndexPath] = []
+		for u in self.updates {
+			let indexPath = indexPathForItemIndex(u.oldIndex)
+			if visible.contains(indexPath) {
+				updates.append(u)
+				oldIndexPaths.append(indexPath)
+			}
 		}
+		return UpdatedRows(
+			updates: updates,
+			oldIndexPaths: oldIndexPaths,
+			newIndexPaths: updates.map { indexPathForItemIndex($0.newIndex) }
+		)
 	}
     
     #if canImport(UIKit)
@@ -213,6 +428,8 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 	3. Replaying the reloads in a separate `beginUpdates()`/`endUpdates()` block just after the insertions/removals
 	   won't lead to nice results anyway, one have to wait for the previous animations to complete.
 
+	Changes marked as a full reload (see `Budget`) are applied via `reloadData()` instead.
+
 	- Returns:
 
 		- `true`, if at least one change has been applied.
@@ -231,6 +448,16 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 		insertionAnimation: UITableView.RowAnimation
 	) -> Bool {
 
+		let probe = Probe.begin(.applySkippingReloads)
+		defer { probe?.finish() }
+		probe?.enter(.replay)
+		probe?.count(self, oldCount: NSNotFound, newCount: NSNotFound)
+
+		if fullReload != nil {
+			tableView.reloadData()
+			return true
+		}
+
 		guard removals.count + insertions.count + moves.count > 0 else {
 			return false
 		}
@@ -255,6 +482,8 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 	have been applied already, i.e. this function works with `newIndex` property of every record in `updates`.
 
 	This is needed for better cell update animations when reloads should happen at the same time as movements/removals/insertions.
+
+	Nothing is done for changes marked as a full reload: `applySkippingReloads()` has reloaded everything already.
 	*/
 	@discardableResult
 	public func applyReloadsAfter(
@@ -295,6 +524,92 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 
 		return true
 	}
+
+	/**
+	Same as `applySkippingReloads()` followed by `applyReloadsAfter()`, but within a single `beginUpdates()`/`endUpdates()`
+	block, so a sync costs one layout pass and one round of animations.
+
+	Reloading the rows being moved in the same block is not possible (see `applySkippingReloads()`), so instead
+	the cells of the updated elements are reconfigured in place: via `reconfigureRows()` on iOS 15 and later
+	or via the `configure` closure, if provided. Either way only the cells visible at the moment are touched,
+	the rest are going to be configured when dequeued anyway.
+
+	(Without `configure` on earlier versions the visible updated rows are reloaded after the block instead.)
+
+	Changes marked as a full reload (see `Budget`) are applied via `reloadData()`.
+
+	- Parameters:
+
+		- indexPathForItemIndex: Same as in `applySkippingReloads()`.
+
+		- configure: Optional closure updating the given visible cell from the element at the given index
+			of the new array. The data source should be showing the new array already.
+
+	- Returns: `true`, if at least one change has been applied.
+	*/
+	@discardableResult
+	public func applyReconfiguringUpdates(
+		tableView: UITableView,
+		indexPathForItemIndex: (_ itemIndex: Int) -> IndexPath,
+		deletionAnimation: UITableView.RowAnimation,
+		insertionAnimation: UITableView.RowAnimation,
+		configure: ((_ cell: UITableViewCell, _ newIndex: Int) -> Void)? = nil
+	) -> Bool {
+
+		let probe = Probe.begin(.applyReconfiguringUpdates)
+		defer { probe?.finish() }
+		probe?.enter(.replay)
+		probe?.count(self, oldCount: NSNotFound, newCount: NSNotFound)
+
+		if fullReload != nil {
+			tableView.reloadData()
+			return true
+		}
+
+		guard !isEmpty else {
+			return false
+		}
+
+		// The table view has not changed yet, so these are the rows visible in the old array.
+		let visibleRows = visibleUpdatedRows(
+			visibleIndexPaths: tableView.indexPathsForVisibleRows ?? [],
+			indexPathForItemIndex: indexPathForItemIndex
+		)
+
+		var reloadAfter: [IndexPath] = []
+
+		tableView.beginUpdates()
+
+		tableView.deleteRows(at: removals.map { indexPathForItemIndex($0.index) }, with: deletionAnimation)
+		tableView.insertRows(at: insertions.map { indexPathForItemIndex($0.index) }, with: insertionAnimation)
+
+		moves.forEach {
+			tableView.moveRow(at: indexPathForItemIndex($0.oldIndex), to: indexPathForItemIndex($0.newIndex))
+		}
+
+		if let configure = configure {
+			for (u, indexPath) in zip(visibleRows.updates, visibleRows.oldIndexPaths) {
+				if let cell = tableView.cellForRow(at: indexPath) {
+					configure(cell, u.newIndex)
+				}
+			}
+		} else if #available(iOS 15, tvOS 15, *) {
+			// Same as with reloads, the index paths are the ones before the updates.
+			tableView.reconfigureRows(at: visibleRows.oldIndexPaths)
+		} else {
+			reloadAfter = visibleRows.newIndexPaths
+		}
+
+		tableView.endUpdates()
+
+		if !reloadAfter.isEmpty {
+			tableView.beginUpdates()
+			tableView.reloadRows(at: reloadAfter, with: .none)
+			tableView.endUpdates()
+		}
+
+		return true
+	}
     
     #endif
 
@@ -304,10 +619,26 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 	in the `sourceArray`.
 
 	The `elementId` and `sourceElementId` closures should be able to provide an ID that can be used to distiniguish
-	elements of the old and new arrays.
+	elements of the old and new arrays. They are called exactly once per element.
+
+	The `sourceArray` can be any random access collection, e.g. a slice or a lazy map over the models,
+	so it does not have to be materialized into an array first.
 
 	- Parameters:
 
+		- moveDetection: How moved elements are detected, see `MoveDetection`.
+
+		- concurrent: When true, then the IDs are obtained and the elements are compared by chunks spread across
+			all the cores via `DispatchQueue.concurrentPerform()`, which pays off for very large arrays or expensive
+			`update` closures. The `elementId`, `sourceElementId` and `update` closures are called concurrently then
+			(though never for the same element twice), so they must be thread-safe; `remove` and `transform`
+			are still called serially. The result is exactly the same as in the serial mode.
+
+		- budget: Limits beyond which the changes are not worth animating, so a "full reload" is returned instead,
+			see `Budget`. The array is updated either way.
+
+		- duplicates: What to do when several elements of the same array have the same ID, see `DuplicatePolicy`.
+
 		- update: Optional closure that's called for every element in the array that was not added to update its contents.
 
 		- remove: Optional closure that's called for every removed element of the array.
@@ -316,151 +647,308 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 		- transform: A closure that should be able to creat a new element of the array from the corresponding element
 			of the source array.
 	*/
-	public static func byUpdatingArray<Element, SourceElement, ElementId: Hashable>(
+	@inlinable
+	public static func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection, ElementId: Hashable>(
 		_ array: inout [Element], elementId: (Element) -> ElementId,
-		sourceArray: [SourceElement], sourceElementId: (SourceElement) -> ElementId,
+		sourceArray: Source, sourceElementId: (SourceElement) -> ElementId,
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
 		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)? = nil,
 		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
 		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
-	) -> MMMArrayChanges {
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+		let probe = Probe.begin(.byUpdatingArray)
+		defer { probe?.finish() }
+		probe?.enter(.ids)
+		// (Can't map `array` in the call itself as it's passed as `inout` there.)
+		let oldIds = map(array, concurrent: concurrent, elementId)
+		let newIds = map(sourceArray, concurrent: concurrent, sourceElementId)
+		probe?.countIdCalls(oldIds.count + newIds.count)
+		return byUpdatingArray(
+			&array, oldIds: oldIds,
+			sourceArray: sourceArray, newIds: newIds,
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: budget,
+			duplicates: duplicates,
+			update: update,
+			remove: remove,
+			transform: transform
+		)
+	}
 
-		// First let's quickly check if the arrays are the same, this should be the most common situation.
-		if array.count == sourceArray.count {
-
-			// Yes, it's like zip().allSatisty().
-			let sameIds: Bool = {
-				for i in 0..<array.count {
-					if elementId(array[i]) != sourceElementId(sourceArray[i]) {
-						return false
-					}
-				}
-				return true
-			}()
-			if sameIds {
-
-				// OK, nothing was moved, added or removed.
-				// But let's check for item updates.
-				var updates: [Update] = []
-				for i in 0..<array.count {
-					if update?(array[i], i, sourceArray[i], i) ?? false {
-						updates.append(.init(i, i))
-					}
-				}
+	/**
+	Same as `byUpdatingArray(_:elementId:sourceArray:sourceElementId:update:remove:transform:)`, but for the case
+	the IDs of the elements of both arrays are known already, e.g. when they are stored alongside the elements anyway.
 
-				return MMMArrayChanges(removals: [], insertions: [], moves: [], updates: updates)
-			}
-		}
+	- Parameters:
 
-		// OK, there seem to be changes, let's index all the items by their IDs.
+		- oldIds: The IDs of the elements of the `array`, in the same order.
 
-		// TODO: Not sure about complexity of creation of these sets, O(N * log(N))?
+		- newIds: The IDs of the elements of the `sourceArray`, in the same order.
+	*/
+	public static func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection, ElementId: Hashable>(
+		_ array: inout [Element], oldIds: [ElementId],
+		sourceArray: Source, newIds: [ElementId],
+		moveDetection: MoveDetection = .greedy,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where Source.Element == SourceElement {
 
-		// All IDs from the `oldArray`.
-		let oldIds = Set<ElementId>.init(array.map(elementId))
-		precondition(oldIds.count == array.count, "Elements in the `oldArray` cannot have duplicate IDs")
+		return byUpdatingArray(
+			&array, oldIdCount: oldIds.count,
+			sourceArray: sourceArray, newIdCount: newIds.count,
+			update: update,
+			remove: remove,
+			transform: transform
+		) { isUpdated in
+			changes(
+				oldIds: oldIds,
+				newIds: newIds,
+				moveDetection: moveDetection,
+				concurrent: concurrent,
+				budget: budget,
+				duplicates: duplicates,
+				isUpdated: isUpdated
+			)
+		}
+	}
 
-		// All IDs from the `newArray`.
-		let newIds = Set<ElementId>(sourceArray.map(sourceElementId))
-		precondition(newIds.count == sourceArray.count, "Elements in the `newArray` cannot have duplicate IDs")
+	/// The common part of `byUpdatingArray()` overloads: calls the given engine with a closure telling
+	/// if an element should be updated (if the `update` closure is provided) and replays the result onto the array.
+	internal static func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection>(
+		_ array: inout [Element], oldIdCount: Int,
+		sourceArray: Source, newIdCount: Int,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)?,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)?,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element,
+		engine: (_ isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?) -> MMMArrayChanges
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+
+		precondition(oldIdCount == array.count, "Expected exactly one ID per element of the `oldArray`")
+		precondition(newIdCount == sourceArray.count, "Expected exactly one ID per element of the `newArray`")
+
+		// Unless measured by the caller already.
+		let ownProbe = Probe.begin(.byUpdatingArray)
+		defer { ownProbe?.finish() }
+		let probe = Probe.current
+
+		let elements = array
+		let changes = engine(update.map { update in
+			{ (oldIndex, newIndex) in update(elements[oldIndex], oldIndex, sourceArray[offset: newIndex], newIndex) }
+		})
+		probe?.enter(.replay)
+		changes.rebuild(
+			&array,
+			sourceArray: sourceArray,
+			remove: { (element, oldIndex) in remove?(element, oldIndex) },
+			transform: transform
+		)
+		probe?.count(changes, oldCount: oldIdCount, newCount: newIdCount)
+		return changes
+	}
 
-		// Removals.
-		var removals: [Removal] = []
-		// intermediate[i] tells where the i-th element was in the `oldArray` before elements to be removed were gone.
-		var intermediate = [Int](0..<array.count)
-		// Removing in the reverse order, so no correction is needed for the indexes.
-		for i in (0..<array.count).reversed() {
-			if !newIds.contains(elementId(array[i])) {
-				removals.append(.init(i))
-				intermediate.remove(at: i)
-			}
-		}
+	/// The core of `byUpdatingArray()` working with the IDs only, so it does not touch the arrays and can be used
+	/// when the elements are not at hand or not safe to access from the current thread.
+	///
+	/// - Parameters:
+	///   - concurrent: True, if `isUpdated` can be called concurrently, see `byUpdatingArray()`.
+	///   - isUpdated: Optional closure telling if the element at the given index of the old array should be
+	///     updated from its counterpart at the given index of the new one.
+	///
+	/// (Integer-like IDs have a faster engine of their own, see `MMMArrayChangesIntegerId`.)
+	@_specialize(where ElementId == String)
+	internal static func changes<ElementId: Hashable>(
+		oldIds: [ElementId],
+		newIds: [ElementId],
+		moveDetection: MoveDetection,
+		concurrent: Bool = false,
+		budget: Budget = .unlimited,
+		duplicates: DuplicatePolicy = .precondition,
+		isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?
+	) -> MMMArrayChanges {
 
-		// Insertions.
-		var insertions: [Insertion] = []
-		for i in 0..<sourceArray.count {
-			if !oldIds.contains(sourceElementId(sourceArray[i])) {
-				insertions.append(.init(i))
-			}
-		}
+		let probe = Probe.current
+		probe?.enter(.fastCheck)
 
-		// Moves and updates.
-		var moves: [Move] = []
-		var updates: [Update] = []
+		// First let's quickly check if the arrays are the same, this should be the most common situation.
+		if oldIds == newIds {
 
-		// Going through the new array and checking where each element has moved from.
-		var intermediateTargetIndex: Int = 0
-		for newIndex in 0..<sourceArray.count {
+			return unchanged(count: oldIds.count, concurrent: concurrent, isUpdated: isUpdated)
+		}
 
-			let newItem = sourceArray[newIndex]
-			let newId = sourceElementId(newItem)
-			if !oldIds.contains(newId) {
-				// This one was just inserted, not interested.
-				continue
-			}
+		// OK, there seem to be changes, let's index all the items by their IDs.
+		probe?.enter(.indexing)
+		let tracker = Budget.Tracker(budget)
+		var keys: [UInt64] = []
+		var slots: [Int] = []
+		var oldIndexByNewIndex: [Int] = []
+		var survives: [Bool] = []
+		let lookups = match(
+			oldIds: oldIds,
+			newIds: newIds,
+			keys: &keys,
+			slots: &slots,
+			oldIndexByNewIndex: &oldIndexByNewIndex,
+			survives: &survives,
+			duplicates: duplicates
+		)
+		probe?.metrics.lookups += lookups
+
+		return changes(
+			oldIndexByNewIndex: oldIndexByNewIndex,
+			survives: survives,
+			moveDetection: moveDetection,
+			concurrent: concurrent,
+			budget: tracker,
+			isUpdated: isUpdated
+		)
+	}
 
-			let oldIndex = intermediate[intermediateTargetIndex]
-			let oldItem = array[oldIndex]
-			let oldId = elementId(oldItem)
-			if oldId == newId {
+	/// Matches the elements of both arrays by their IDs via the core shared with the ObjC engine, see `coreMatch()`.
+	/// The containers are cleared first, so the ones used before can be passed here again to reuse their storage
+	/// (see `MMMArrayChangesContext`).
+	///
+	/// - Parameters:
+	///   - keys: Scratch storage for the hashes of the IDs of both arrays.
+	///   - slots: Scratch storage for the table of the indexes of the elements by their IDs.
+	///   - oldIndexByNewIndex: For every element of the `newArray` the index of the corresponding element
+	///     in the `oldArray`, or `NSNotFound` for the new ones.
+	///   - survives: True for the elements of the `oldArray` that have a corresponding one in the `newArray`.
+	///   - duplicates: What to do about duplicate IDs, see `DuplicatePolicy`.
+	/// - Returns: The number of the slots of the table probed.
+	@_specialize(where ElementId == String)
+	internal static func match<ElementId: Hashable>(
+		oldIds: [ElementId],
+		newIds: [ElementId],
+		keys: inout [UInt64],
+		slots: inout [Int],
+		oldIndexByNewIndex: inout [Int],
+		survives: inout [Bool],
+		duplicates: DuplicatePolicy
+	) -> Int {
+		let result = coreMatch(
+			oldIds: oldIds,
+			newIds: newIds,
+			key: { UInt64(bitPattern: Int64($0.hashValue)) },
+			keys: &keys,
+			slots: &slots,
+			oldIndexByNewIndex: &oldIndexByNewIndex,
+			survives: &survives
+		)
+		check(result, duplicates: duplicates)
+		return result.steps
+	}
 
-				// The item is at its target position already, let's only check if the contents has updated.
-				if update?(oldItem, oldIndex, newItem, newIndex) ?? false {
-					updates.append(.init(oldIndex, newIndex))
-				}
+	/// The changes when the IDs of both arrays are the same: nothing was moved, added or removed,
+	/// but the elements still might need updates.
+	internal static func unchanged(
+		count: Int,
+		concurrent: Bool,
+		isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?
+	) -> MMMArrayChanges {
+		var builder = Builder()
+		if let isUpdated = isUpdated {
+			Probe.current?.enter(.updates)
+			let updated = flags(count: count, concurrent: concurrent) { isUpdated($0, $0) }
+			for i in 0..<count where updated[i] {
+				builder.appendUpdate(i, i)
+			}
+		}
+		return builder.changes()
+	}
 
-			} else {
+	/// The part of the engine after the elements of both arrays are matched by their IDs.
+	///
+	/// - Parameters:
+	///   - oldIndexByNewIndex: For every element of the new array the index of the corresponding element in the old
+	///     one or `NSNotFound` for the inserted elements.
+	///   - survives: True for the elements of the old array having a corresponding element in the new one.
+	///   - budget: The budget of the diff with its clock started before the elements were matched.
+	internal static func changes(
+		oldIndexByNewIndex: [Int],
+		survives: [Bool],
+		moveDetection: MoveDetection,
+		concurrent: Bool,
+		budget: Budget.Tracker = .unlimited,
+		isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?
+	) -> MMMArrayChanges {
 
-				// A different element here, let's see where it's coming from.
-
-				// Let's find where this element is in the old array.
-				// TODO: same as in ObjC, this reverse look up needs to be improved performance-wise.
-				var oldNewIndex: Int = NSNotFound
-				var intermediateSourceIndex: Int = 0
-				while intermediateSourceIndex < intermediate.count {
-					oldNewIndex = intermediate[intermediateSourceIndex]
-					if elementId(array[oldNewIndex]) == newId {
-						break
-					}
-					intermediateSourceIndex += 1
-				}
-				precondition(oldNewIndex != NSNotFound && intermediateSourceIndex < intermediate.count)
+		func reload() -> MMMArrayChanges {
+			return fullReloadChanges(
+				oldCount: survives.count,
+				oldIndexByNewIndex: oldIndexByNewIndex,
+				concurrent: concurrent,
+				isUpdated: isUpdated
+			)
+		}
 
-				// Record a move first.
-				moves.append(.init(oldNewIndex, newIndex, intermediateSourceIndex, intermediateTargetIndex))
+		let probe = Probe.current
 
-				// Then update the intermediate array accordingly.
-				let t = intermediate[intermediateSourceIndex]
-				intermediate.remove(at: intermediateSourceIndex)
-				intermediate.insert(t, at: intermediateTargetIndex)
+		// The records are packed in the order they are found, see `Builder`.
+		var builder = Builder()
 
-				// And finally check if the item has content changes as well.
-				if update?(array[oldNewIndex], oldNewIndex, newItem, newIndex) ?? false {
-					// Yes, record an update, too.
-					updates.append(.init(oldNewIndex, newIndex))
-				}
+		// Removals.
+		// Removing in the reverse order, so no correction is needed for the indexes.
+		probe?.enter(.removals)
+		var changeCount = 0
+		for i in (0..<survives.count).reversed() {
+			if !survives[i] {
+				builder.appendRemoval(i)
+				changeCount += 1
 			}
-
-			intermediateTargetIndex += 1
 		}
 
-		for r in removals {
-			let item = array[r.index]
-			array.remove(at: r.index)
-			remove?(item, r.index)
+		// Insertions.
+		probe?.enter(.insertions)
+		for i in 0..<oldIndexByNewIndex.count {
+			if oldIndexByNewIndex[i] == NSNotFound {
+				builder.appendInsertion(i)
+				changeCount += 1
+			}
 		}
 
-		for m in moves {
-			let item = array[m.intermediateSourceIndex]
-			array.remove(at: m.intermediateSourceIndex)
-			array.insert(item, at: m.intermediateTargetIndex)
+		// Finding the moves is the most expensive part, so checking the budget before and while doing so.
+		if budget.isOverTime
+			|| budget.isExceeded(changeCount: changeCount, oldCount: survives.count, newCount: oldIndexByNewIndex.count)
+		{
+			return reload()
 		}
 
-		for i in insertions {
-			let item = transform(sourceArray[i.index], i.index)
-			array.insert(item, at: i.index)
+		// Moves.
+		probe?.enter(.moves)
+		guard let moves = detectMoves(
+			oldIndexByNewIndex: oldIndexByNewIndex,
+			survives: survives,
+			moveDetection: moveDetection,
+			budget: budget
+		) else {
+			return reload()
+		}
+		if budget.isExceeded(changeCount: changeCount + moves.count, oldCount: survives.count, newCount: oldIndexByNewIndex.count) {
+			return reload()
+		}
+		moves.forEach { builder.append($0) }
+
+		// Updates, checking the contents of all the elements that were not inserted.
+		if let isUpdated = isUpdated {
+			probe?.enter(.updates)
+			let updated = flags(count: oldIndexByNewIndex.count, concurrent: concurrent) { newIndex in
+				let oldIndex = oldIndexByNewIndex[newIndex]
+				return oldIndex != NSNotFound && isUpdated(oldIndex, newIndex)
+			}
+			for (newIndex, oldIndex) in oldIndexByNewIndex.enumerated() where updated[newIndex] {
+				builder.appendUpdate(oldIndex, newIndex)
+			}
 		}
 
-		return MMMArrayChanges(removals: removals, insertions: insertions, moves: moves, updates: updates)
+		return builder.changes()
 	}
 
 	/// A shortcut for the case when both arrays contain objects of reference types and their references can be used as
@@ -468,6 +956,7 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 	////
 	/// - Note: I could name it `byUpdatingArray` as well, but that confuses Swift 4.2, it cannot find a proper method
 	/// even though at least `elementId:` label is not present in this one.
+	@inlinable
 	public static func byUpdatingArrayOfObjects<Element: AnyObject>(
 		_ array: inout [Element],
 		sourceArray: [Element],
@@ -495,17 +984,19 @@ public class MMMArrayChanges: CustomStringConvertible, Equatable {
 	/// Changes between two simple arrays consisting of the same hashable value types, so elements themselves can
 	/// be used as their own identifiers.
 	/// (This is mainly used for testing the receiver using arrays of Int.)
-	public static func betweenSimpleArrays<Element: Hashable>(oldArray: [Element], newArray: [Element]) -> MMMArrayChanges  {
+	@inlinable
+	public static func betweenSimpleArrays<Element: Hashable>(
+		oldArray: [Element], newArray: [Element],
+		moveDetection: MoveDetection = .greedy
+	) -> MMMArrayChanges  {
 		var tempArray = oldArray
 		let result = byUpdatingArray(
 			&tempArray,
-			elementId: { (_ element: Element) -> Element in
-				return element
-			},
+			// The elements are their own IDs, so no need to extract them.
+			oldIds: oldArray,
 			sourceArray: newArray,
-			sourceElementId: { (_ sourceElement: Element) -> Element in
-				return sourceElement
-			},
+			newIds: newArray,
+			moveDetection: moveDetection,
 			update: { (element, oldIndex, sourceElement, newIndex) -> Bool in
 				return false
 			},
@@ -0,0 +1,294 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+/**
+Same as `MMMArrayChanges.byUpdatingArray()`, but keeping the ID buffers and the hash tables of the engine between
+calls, so diffing the same list over and over again (e.g. on every sync) does not allocate them every time.
+They keep their capacity, so once they have grown large enough for the list, a diff that finds no changes
+allocates nothing at all. (A diff that does find changes still allocates its result, of course.)
+
+The context is not thread-safe: use one per list or make sure it's used from a single queue at a time.
+
+```
+private let context = MMMArrayChangesContext<String>()
+...
+let changes = context.byUpdatingArray(
+	&viewModels, elementId: { $0.id },
+	sourceArray: cookies, sourceElementId: { $0.id },
+	update: { viewModel, _, cookie, _ in viewModel.update(cookie) },
+	transform: { cookie, _ in CookieViewModel(cookie) }
+)
+```
+*/
+public final class MMMArrayChangesContext<ElementId: Hashable> {
+
+	public let moveDetection: MMMArrayChanges.MoveDetection
+
+	/// See `MMMArrayChanges.Budget`.
+	public let budget: MMMArrayChanges.Budget
+
+	/// See `MMMArrayChanges.DuplicatePolicy`.
+	public let duplicates: MMMArrayChanges.DuplicatePolicy
+
+	public init(
+		moveDetection: MMMArrayChanges.MoveDetection = .greedy,
+		budget: MMMArrayChanges.Budget = .unlimited,
+		duplicates: MMMArrayChanges.DuplicatePolicy = .precondition
+	) {
+		self.moveDetection = moveDetection
+		self.budget = budget
+		self.duplicates = duplicates
+	}
+
+	// The scratch storage. It is swapped into local variables while in use, so it stays uniquely referenced
+	// and is mutated in place instead of being copied.
+	private var oldIds: [ElementId] = []
+	private var newIds: [ElementId] = []
+	private var keys: [UInt64] = []
+	private var slots: [Int] = []
+	private var oldIndexByNewIndex: [Int] = []
+	private var survives: [Bool] = []
+	private var fingerprints: [Int] = []
+
+	// The IDs and the fingerprints of the elements as of the end of the last call of the fingerprinting version
+	// of `byUpdatingArray()`, nil if there was no such call yet.
+	private var lastIds: [ElementId] = []
+	private var lastFingerprints: [Int]?
+
+	/// Same as `MMMArrayChanges.byUpdatingArray(_:elementId:sourceArray:sourceElementId:...)`, but using
+	/// the storage of the receiver.
+	public func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection>(
+		_ array: inout [Element], elementId: (Element) -> ElementId,
+		sourceArray: Source, sourceElementId: (SourceElement) -> ElementId,
+		update: ((_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool)? = nil,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+
+		let probe = MMMArrayChanges.Probe.begin(.byUpdatingArray)
+		defer { probe?.finish() }
+
+		var oldIds: [ElementId] = []
+		swap(&oldIds, &self.oldIds)
+		var newIds: [ElementId] = []
+		swap(&newIds, &self.newIds)
+		defer {
+			swap(&oldIds, &self.oldIds)
+			swap(&newIds, &self.newIds)
+		}
+
+		probe?.enter(.ids)
+		oldIds.removeAll(keepingCapacity: true)
+		for element in array {
+			oldIds.append(elementId(element))
+		}
+		newIds.removeAll(keepingCapacity: true)
+		for sourceElement in sourceArray {
+			newIds.append(sourceElementId(sourceElement))
+		}
+		probe?.countIdCalls(oldIds.count + newIds.count)
+
+		probe?.enter(.fastCheck)
+		if oldIds == newIds {
+			// The most common case. Calling `update` directly rather than wrapping it into `isUpdated`,
+			// so there is no closure context to allocate either.
+			probe?.enter(.updates)
+			var builder = MMMArrayChanges.Builder()
+			if let update = update {
+				for i in 0..<array.count where update(array[i], i, sourceArray[offset: i], i) {
+					builder.appendUpdate(i, i)
+				}
+			}
+			let changes = builder.changes()
+			probe?.count(changes, oldCount: oldIds.count, newCount: newIds.count)
+			return changes
+		}
+
+		return MMMArrayChanges.byUpdatingArray(
+			&array, oldIdCount: oldIds.count,
+			sourceArray: sourceArray, newIdCount: newIds.count,
+			update: update,
+			remove: remove,
+			transform: transform
+		) { isUpdated in
+			changes(oldIds: oldIds, newIds: newIds, isUpdated: isUpdated)
+		}
+	}
+
+	/**
+	Same as `byUpdatingArray(_:elementId:sourceArray:sourceElementId:update:remove:transform:)`, but the contents
+	of the elements is compared via cheap fingerprints first, so the `update` closure (comparing and updating
+	a dozen of fields perhaps) is only called for the elements whose fingerprints differ.
+
+	The fingerprints of the source elements are retained till the next call, so they don't have to be computed for
+	the old array: if the IDs of the elements of the array are the same as the IDs of the source array
+	in the previous call (i.e. the array was not modified elsewhere in between), then its elements are assumed to
+	correspond to the source elements fingerprinted last time. Otherwise (e.g. on the very first call) the `update`
+	closure is called for every matching element.
+
+	- Parameters:
+
+		- fingerprint: A cheap "content version" of a source element, like a hash of its fields or a version counter
+			maintained by the backend. Equal fingerprints of elements with the same ID mean the element
+			has not changed.
+	*/
+	public func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection>(
+		_ array: inout [Element], elementId: (Element) -> ElementId,
+		sourceArray: Source, sourceElementId: (SourceElement) -> ElementId,
+		fingerprint: (SourceElement) -> Int,
+		update: (_ element: Element, _ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Bool,
+		remove: ((_ element: Element, _ oldIndex: Int) -> Void)? = nil,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+
+		let probe = MMMArrayChanges.Probe.begin(.byUpdatingArray)
+		defer { probe?.finish() }
+		probe?.enter(.ids)
+
+		var oldIds: [ElementId] = []
+		swap(&oldIds, &self.oldIds)
+		oldIds.removeAll(keepingCapacity: true)
+		for element in array {
+			oldIds.append(elementId(element))
+		}
+
+		// The new IDs end up in `lastIds` and the buffer of the former goes back to the scratch `newIds`.
+		var newIds: [ElementId] = []
+		swap(&newIds, &self.newIds)
+		newIds.removeAll(keepingCapacity: true)
+		var newFingerprints: [Int] = []
+		swap(&newFingerprints, &self.fingerprints)
+		newFingerprints.removeAll(keepingCapacity: true)
+		for sourceElement in sourceArray {
+			newIds.append(sourceElementId(sourceElement))
+			newFingerprints.append(fingerprint(sourceElement))
+		}
+		probe?.countIdCalls(oldIds.count + newIds.count)
+
+		var oldFingerprints = lastFingerprints
+		lastFingerprints = nil
+		if let retained = oldFingerprints, oldIds != lastIds {
+			// The array has changed since the last call, the retained fingerprints don't apply.
+			self.fingerprints = retained
+			oldFingerprints = nil
+		}
+
+		let changes: MMMArrayChanges
+		probe?.enter(.fastCheck)
+		if oldIds == newIds {
+			// The most common case, again without wrapping `update` into anything.
+			probe?.enter(.updates)
+			var builder = MMMArrayChanges.Builder()
+			for i in 0..<array.count {
+				if let oldFingerprints = oldFingerprints, oldFingerprints[i] == newFingerprints[i] {
+					continue
+				}
+				if update(array[i], i, sourceArray[offset: i], i) {
+					builder.appendUpdate(i, i)
+				}
+			}
+			changes = builder.changes()
+			probe?.count(changes, oldCount: oldIds.count, newCount: newIds.count)
+		} else {
+			changes = withoutActuallyEscaping(update) { update in
+				MMMArrayChanges.byUpdatingArray(
+					&array, oldIdCount: oldIds.count,
+					sourceArray: sourceArray, newIdCount: newIds.count,
+					update: { [oldFingerprints, newFingerprints] (element, oldIndex, sourceElement, newIndex) in
+						if let oldFingerprints = oldFingerprints, oldFingerprints[oldIndex] == newFingerprints[newIndex] {
+							return false
+						}
+						return update(element, oldIndex, sourceElement, newIndex)
+					},
+					remove: remove,
+					transform: transform
+				) { isUpdated in
+					self.changes(oldIds: oldIds, newIds: newIds, isUpdated: isUpdated)
+				}
+			}
+		}
+
+		// The array corresponds to the source one now, so its IDs and fingerprints are retained,
+		// while the buffers of the previous ones are reused for the next call.
+		swap(&newIds, &lastIds)
+		self.newIds = newIds
+		self.oldIds = oldIds
+		if let oldFingerprints = oldFingerprints {
+			self.fingerprints = oldFingerprints
+		}
+		lastFingerprints = newFingerprints
+
+		return changes
+	}
+
+	/**
+	Changes between two arrays given the IDs of their elements only, using the storage of the receiver.
+
+	- Parameters:
+
+		- isUpdated: Optional closure telling if the element at the given index of the old array should be
+			updated from its counterpart at the given index of the new one.
+	*/
+	public func changes(
+		oldIds: [ElementId],
+		newIds: [ElementId],
+		isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)? = nil
+	) -> MMMArrayChanges {
+
+		let probe = MMMArrayChanges.Probe.current
+		probe?.enter(.fastCheck)
+
+		if oldIds == newIds {
+			var builder = MMMArrayChanges.Builder()
+			if let isUpdated = isUpdated {
+				probe?.enter(.updates)
+				for i in 0..<oldIds.count where isUpdated(i, i) {
+					builder.appendUpdate(i, i)
+				}
+			}
+			return builder.changes()
+		}
+
+		probe?.enter(.indexing)
+		let tracker = MMMArrayChanges.Budget.Tracker(budget)
+
+		var keys: [UInt64] = []
+		swap(&keys, &self.keys)
+		var slots: [Int] = []
+		swap(&slots, &self.slots)
+		var oldIndexByNewIndex: [Int] = []
+		swap(&oldIndexByNewIndex, &self.oldIndexByNewIndex)
+		var survives: [Bool] = []
+		swap(&survives, &self.survives)
+		defer {
+			swap(&keys, &self.keys)
+			swap(&slots, &self.slots)
+			swap(&oldIndexByNewIndex, &self.oldIndexByNewIndex)
+			swap(&survives, &self.survives)
+		}
+
+		let lookups = MMMArrayChanges.match(
+			oldIds: oldIds,
+			newIds: newIds,
+			keys: &keys,
+			slots: &slots,
+			oldIndexByNewIndex: &oldIndexByNewIndex,
+			survives: &survives,
+			duplicates: duplicates
+		)
+		probe?.metrics.lookups += lookups
+
+		return MMMArrayChanges.changes(
+			oldIndexByNewIndex: oldIndexByNewIndex,
+			survives: survives,
+			moveDetection: moveDetection,
+			concurrent: false,
+			budget: tracker,
+			isUpdated: isUpdated
+		)
+	}
+}
@@ -0,0 +1,337 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+/**
+An ID that can be stored in `MMMArrayChangesIdSnapshot`.
+*/
+public protocol MMMArrayChangesSnapshotId: Hashable {
+
+	/// Appends the bytes representing the ID.
+	func appendSnapshotBytes(to data: inout Data)
+
+	/// Restores the ID from the bytes appended by `appendSnapshotBytes()`, nil if they don't make sense.
+	init?(snapshotBytes: UnsafeRawBufferPointer)
+}
+
+extension String: MMMArrayChangesSnapshotId {
+
+	public func appendSnapshotBytes(to data: inout Data) {
+		data.append(contentsOf: utf8)
+	}
+
+	public init?(snapshotBytes: UnsafeRawBufferPointer) {
+		// (Not `init(decoding:as:)`, which silently replaces malformed sequences instead of failing.)
+		guard let string = String(bytes: snapshotBytes, encoding: .utf8) else {
+			return nil
+		}
+		self = string
+	}
+}
+
+extension Int: MMMArrayChangesSnapshotId {
+
+	public func appendSnapshotBytes(to data: inout Data) {
+		Int64(self).appendSnapshotBytes(to: &data)
+	}
+
+	public init?(snapshotBytes: UnsafeRawBufferPointer) {
+		guard let value = Int64(snapshotBytes: snapshotBytes), let result = Int(exactly: value) else {
+			return nil
+		}
+		self = result
+	}
+}
+
+extension Int64: MMMArrayChangesSnapshotId {
+
+	public func appendSnapshotBytes(to data: inout Data) {
+		UInt64(bitPattern: self).appendSnapshotBytes(to: &data)
+	}
+
+	public init?(snapshotBytes: UnsafeRawBufferPointer) {
+		guard let value = UInt64(snapshotBytes: snapshotBytes) else {
+			return nil
+		}
+		self.init(bitPattern: value)
+	}
+}
+
+extension UInt64: MMMArrayChangesSnapshotId {
+
+	public func appendSnapshotBytes(to data: inout Data) {
+		var value = littleEndian
+		withUnsafeBytes(of: &value) { data.append(contentsOf: $0) }
+	}
+
+	public init?(snapshotBytes: UnsafeRawBufferPointer) {
+		guard snapshotBytes.count == MemoryLayout<UInt64>.size else {
+			return nil
+		}
+		var value: UInt64 = 0
+		withUnsafeMutableBytes(of: &value) { $0.copyMemory(from: snapshotBytes) }
+		self.init(littleEndian: value)
+	}
+}
+
+extension UUID: MMMArrayChangesSnapshotId {
+
+	public func appendSnapshotBytes(to data: inout Data) {
+		var uuid = self.uuid
+		withUnsafeBytes(of: &uuid) { data.append(contentsOf: $0) }
+	}
+
+	public init?(snapshotBytes: UnsafeRawBufferPointer) {
+		guard snapshotBytes.count == MemoryLayout<uuid_t>.size else {
+			return nil
+		}
+		var uuid: uuid_t = (0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+		withUnsafeMutableBytes(of: &uuid) { $0.copyMemory(from: snapshotBytes) }
+		self.init(uuid: uuid)
+	}
+}
+
+// The header of the binary representation of `MMMArrayChangesIdSnapshot`.
+private let snapshotMagic: UInt64 = 0x5341_4D4D // "MMAS"
+private let snapshotVersion: UInt64 = 1
+// Set in the word holding the version when the fingerprints are present.
+private let snapshotHasFingerprints: UInt64 = 1 << 32
+
+/**
+The IDs of the elements of a list, optionally along with the fingerprints of their contents, in a compact binary form
+that can be stored next to a cached list.
+
+On a cold start the diff between the cached list and the first fresh one can then be found using the snapshot as
+the old side, before decoding any of the cached elements, and only the elements that survive have to be restored
+from the cache.
+
+```
+// When caching.
+let snapshot = MMMArrayChangesIdSnapshot(cookies, elementId: { $0.id }, fingerprint: { $0.version })
+try snapshot.data.write(to: snapshotURL)
+
+// On launch, the file can be mapped as the snapshot is read in a single pass.
+if let snapshot = MMMArrayChangesIdSnapshot<String>(data: try Data(contentsOf: snapshotURL, options: .alwaysMapped)) {
+	let changes = snapshot.byUpdatingArray(
+		&viewModels,
+		sourceArray: freshCookies, sourceElementId: { $0.id },
+		fingerprint: { $0.version },
+		restore: { oldIndex, cookie, _ in CookieViewModel(cachedCookie(at: oldIndex), updatedFrom: cookie) },
+		transform: { cookie, _ in CookieViewModel(cookie) }
+	)
+}
+```
+
+The format (all numbers are little-endian and 8 bytes wide, so the data is properly aligned when mapped):
+a header (the magic, the version and the flags, the number of elements), then the fingerprints (if any),
+then the offsets of the IDs of every element and of the end of the last one, then the bytes of the IDs themselves.
+*/
+public struct MMMArrayChangesIdSnapshot<ElementId: MMMArrayChangesSnapshotId> {
+
+	/// The IDs of the elements, in the order of the list.
+	public let ids: [ElementId]
+
+	/// The fingerprints of the contents of the elements, same as in `MMMArrayChangesContext`, if provided.
+	public let fingerprints: [Int]?
+
+	public init(ids: [ElementId], fingerprints: [Int]? = nil) {
+		precondition(fingerprints == nil || fingerprints!.count == ids.count, "Expected exactly one fingerprint per ID")
+		self.ids = ids
+		self.fingerprints = fingerprints
+	}
+
+	/// A snapshot of the given list.
+	public init<Element>(_ array: [Element], elementId: (Element) -> ElementId, fingerprint: ((Element) -> Int)? = nil) {
+		self.init(ids: array.map(elementId), fingerprints: fingerprint.map { array.map($0) })
+	}
+
+	/// The binary representation of the snapshot, see `init(data:)`.
+	public var data: Data {
+
+		var data = Data()
+		let count = ids.count
+		data.reserveCapacity(8 * (3 + 2 * count + 1) + 8 * count)
+
+		func append(_ value: UInt64) {
+			value.appendSnapshotBytes(to: &data)
+		}
+
+		append(snapshotMagic)
+		append(snapshotVersion | (fingerprints != nil ? snapshotHasFingerprints : 0))
+		append(UInt64(count))
+		if let fingerprints = fingerprints {
+			for fingerprint in fingerprints {
+				append(UInt64(bitPattern: Int64(fingerprint)))
+			}
+		}
+
+		// The offsets go before the IDs, so reserving their space first and filling them as the IDs are appended.
+		let offsetsStart = data.count
+		data.append(contentsOf: repeatElement(0, count: 8 * (count + 1)))
+		let idsStart = data.count
+		var offsets: [UInt64] = []
+		offsets.reserveCapacity(count + 1)
+		for id in ids {
+			offsets.append(UInt64(data.count - idsStart))
+			id.appendSnapshotBytes(to: &data)
+		}
+		offsets.append(UInt64(data.count - idsStart))
+		offsets.withUnsafeBufferPointer { source in
+			data.withUnsafeMutableBytes { target in
+				for (i, offset) in source.enumerated() {
+					var value = offset.littleEndian
+					withUnsafeBytes(of: &value) {
+						UnsafeMutableRawBufferPointer(rebasing: target[(offsetsStart + 8 * i)...]).copyMemory(from: $0)
+					}
+				}
+			}
+		}
+
+		return data
+	}
+
+	/// Restores the snapshot from its `data`; nil when it's damaged or was stored by an incompatible version.
+	public init?(data: Data) {
+
+		let snapshot: (ids: [ElementId], fingerprints: [Int]?)? = data.withUnsafeBytes { bytes in
+
+			var position = 0
+			func read() -> UInt64? {
+				guard position + 8 <= bytes.count else {
+					return nil
+				}
+				defer { position += 8 }
+				return UInt64(snapshotBytes: UnsafeRawBufferPointer(rebasing: bytes[position..<(position + 8)]))
+			}
+
+			guard read() == snapshotMagic,
+				let flags = read(), flags & ~snapshotHasFingerprints == snapshotVersion,
+				let rawCount = read(), rawCount <= UInt64(bytes.count / 8)
+			else {
+				return nil
+			}
+			let count = Int(rawCount)
+
+			var fingerprints: [Int]?
+			if flags & snapshotHasFingerprints != 0 {
+				var result: [Int] = []
+				result.reserveCapacity(count)
+				for _ in 0..<count {
+					guard let fingerprint = read() else {
+						return nil
+					}
+					result.append(Int(truncatingIfNeeded: Int64(bitPattern: fingerprint)))
+				}
+				fingerprints = result
+			}
+
+			var offsets: [Int] = []
+			offsets.reserveCapacity(count + 1)
+			for _ in 0...count {
+				guard let offset = read(), offset <= UInt64(bytes.count) else {
+					return nil
+				}
+				offsets.append(Int(offset))
+			}
+
+			let idsStart = position
+			var ids: [ElementId] = []
+			ids.reserveCapacity(count)
+			for i in 0..<count {
+				let start = idsStart + offsets[i]
+				let end = idsStart + offsets[i + 1]
+				guard start <= end, end <= bytes.count,
+					let id = ElementId(snapshotBytes: UnsafeRawBufferPointer(rebasing: bytes[start..<end]))
+				else {
+					return nil
+				}
+				ids.append(id)
+			}
+
+			return (ids, fingerprints)
+		}
+
+		guard let snapshot = snapshot else {
+			return nil
+		}
+		self.init(ids: snapshot.ids, fingerprints: snapshot.fingerprints)
+	}
+
+	/**
+	Same as `MMMArrayChanges.byUpdatingArray()`, but with the snapshot taking place of the old array, so its elements
+	don't have to be at hand: only the ones that survive are restored via `restore`, while the new ones are created
+	via `transform` as usual.
+
+	- Parameters:
+
+		- array: Receives the elements corresponding to the `sourceArray`. Should be empty, as the snapshot
+			stands for its old contents.
+
+		- fingerprint: When provided (and the snapshot has fingerprints too), the surviving elements whose
+			fingerprints differ are recorded as updates. Otherwise there are no updates in the changes returned.
+
+		- restore: Creates the element at the given index of the snapshot, e.g. decoding it from the cache,
+			that corresponds to the given element of the `sourceArray`. Called only for the surviving elements.
+	*/
+	public func byUpdatingArray<Element, SourceElement, Source: RandomAccessCollection>(
+		_ array: inout [Element],
+		sourceArray: Source, sourceElementId: (SourceElement) -> ElementId,
+		fingerprint: ((SourceElement) -> Int)? = nil,
+		moveDetection: MMMArrayChanges.MoveDetection = .greedy,
+		duplicates: MMMArrayChanges.DuplicatePolicy = .precondition,
+		restore: (_ oldIndex: Int, _ sourceElement: SourceElement, _ newIndex: Int) -> Element,
+		transform: (_ newElement: SourceElement, _ newIndex: Int) -> Element
+	) -> MMMArrayChanges where Source.Element == SourceElement {
+
+		precondition(array.isEmpty, "The snapshot stands for the old contents of the array")
+
+		let probe = MMMArrayChanges.Probe.begin(.byUpdatingArray)
+		defer { probe?.finish() }
+
+		probe?.enter(.ids)
+		let newIds = sourceArray.map(sourceElementId)
+		let newFingerprints = fingerprint.map { sourceArray.map($0) }
+		probe?.countIdCalls(newIds.count)
+
+		let isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?
+		if let oldFingerprints = fingerprints, let newFingerprints = newFingerprints {
+			isUpdated = { (oldIndex, newIndex) in oldFingerprints[oldIndex] != newFingerprints[newIndex] }
+		} else {
+			isUpdated = nil
+		}
+
+		let changes = MMMArrayChanges.changes(
+			oldIds: ids,
+			newIds: newIds,
+			moveDetection: moveDetection,
+			duplicates: duplicates,
+			isUpdated: isUpdated
+		)
+
+		// Replaying the changes onto the indexes of the elements of the snapshot tells where each of them ends up.
+		probe?.enter(.replay)
+		var oldIndexes = Array(0..<ids.count)
+		changes.rebuild(
+			&oldIndexes,
+			sourceArray: sourceArray,
+			remove: { (_, _) in },
+			transform: { (_, _) in NSNotFound }
+		)
+		array.reserveCapacity(oldIndexes.count)
+		for (newIndex, oldIndex) in oldIndexes.enumerated() {
+			let sourceElement = sourceArray[offset: newIndex]
+			if oldIndex == NSNotFound {
+				array.append(transform(sourceElement, newIndex))
+			} else {
+				array.append(restore(oldIndex, sourceElement, newIndex))
+			}
+		}
+
+		probe?.count(changes, oldCount: ids.count, newCount: newIds.count)
+
+		return changes
+	}
+}
@@ -0,0 +1,243 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+/**
+Finds changes between snapshots of arrays on a background queue and delivers them on the main one, where they can be
+applied to the array (via `applyToArray()`) and the table view (via `applySkippingReloads()`, etc), so the main thread
+pays only for these.
+
+Only the latest snapshot matters: submitting a new one supersedes the computations that are still pending or
+in progress, so their results are never delivered.
+
+Note that the closures passed here are called on the background queue, so they should not modify anything and should
+access only the properties of the elements that are not changed elsewhere while the computation is in progress
+(like their IDs). The actual updates of the elements are supposed to happen in the `update` closure of `applyToArray()`
+on the main thread.
+
+```
+let pipeline = MMMArrayChangesPipeline<CookieViewModel, Cookie, String>(
+	elementId: { $0.id },
+	sourceElementId: { "\($0.id)" },
+	isUpdated: { viewModel, cookie in viewModel.name != cookie.name }
+)
+...
+pipeline.submit(oldArray: viewModels, newArray: cookies) { [weak self] changes in
+	guard let self = self else { return }
+	changes.applyToArray(&self.viewModels, sourceArray: cookies, ...)
+	_ = changes.applySkippingReloads(tableView: self.tableView, ...)
+}
+```
+*/
+public final class MMMArrayChangesPipeline<Element, SourceElement, ElementId: Hashable> {
+
+	private let elementId: (Element) -> ElementId
+	private let sourceElementId: (SourceElement) -> ElementId
+	private let moveDetection: MMMArrayChanges.MoveDetection
+	private let budget: MMMArrayChanges.Budget
+	private let duplicates: MMMArrayChanges.DuplicatePolicy
+	private let isUpdated: ((_ element: Element, _ sourceElement: SourceElement) -> Bool)?
+	private let queue: DispatchQueue
+
+	/**
+	- Parameters:
+
+		- elementId: Same as in `MMMArrayChanges.byUpdatingArray()`, but called on the background queue.
+
+		- sourceElementId: Same as in `MMMArrayChanges.byUpdatingArray()`, but called on the background queue.
+
+		- budget: See `MMMArrayChanges.Budget`; the changes delivered can be marked as a full reload then.
+
+		- duplicates: See `MMMArrayChanges.DuplicatePolicy`.
+
+		- isUpdated: Optional closure telling if an element of the old array that still has a matching element
+			in the new array should be updated from the latter. Called on the background queue.
+
+		- queue: The queue where the changes are computed; a private serial one is used by default.
+	*/
+	public init(
+		elementId: @escaping (Element) -> ElementId,
+		sourceElementId: @escaping (SourceElement) -> ElementId,
+		moveDetection: MMMArrayChanges.MoveDetection = .greedy,
+		budget: MMMArrayChanges.Budget = .unlimited,
+		duplicates: MMMArrayChanges.DuplicatePolicy = .precondition,
+		isUpdated: ((_ element: Element, _ sourceElement: SourceElement) -> Bool)? = nil,
+		queue: DispatchQueue = DispatchQueue(label: "MMMArrayChangesPipeline", qos: .userInitiated)
+	) {
+		self.elementId = elementId
+		self.sourceElementId = sourceElementId
+		self.moveDetection = moveDetection
+		self.budget = budget
+		self.duplicates = duplicates
+		self.isUpdated = isUpdated
+		self.queue = queue
+	}
+
+	private let lock = NSLock()
+
+	/// Incremented with every submission or cancellation, so the computations can tell when they are superseded.
+	/// (Guarded by the `lock`.)
+	private var generation: Int = 0
+
+	private func isCurrent(_ generation: Int) -> Bool {
+		lock.lock()
+		defer { lock.unlock() }
+		return generation == self.generation
+	}
+
+	/**
+	Schedules finding the changes between the given arrays.
+
+	The `completion` is called on the main queue, unless the computation gets superseded by another `submit()`
+	or `cancel()` before that. Should be called on the main queue as well.
+
+	- Parameters:
+
+		- oldArray: The current state of the array. Note that it must still be the same when the completion
+			is called, i.e. the array should be modified only by applying the changes delivered here.
+
+		- newArray: The new state of the source array.
+	*/
+	public func submit(
+		oldArray: [Element],
+		newArray: [SourceElement],
+		completion: @escaping (_ changes: MMMArrayChanges) -> Void
+	) {
+		submit(oldArray: oldArray, newArray: newArray, completion: completion, superseded: {})
+	}
+
+	/// Same as the public version, but calls `superseded` on the main queue instead of `completion`
+	/// in case the computation gets superseded. Returns the generation of the submission, see `cancel(generation:)`.
+	@discardableResult
+	internal func submit(
+		oldArray: [Element],
+		newArray: [SourceElement],
+		completion: @escaping (_ changes: MMMArrayChanges) -> Void,
+		superseded: @escaping () -> Void
+	) -> Int {
+
+		dispatchPrecondition(condition: .onQueue(.main))
+
+		lock.lock()
+		generation += 1
+		let generation = self.generation
+		lock.unlock()
+
+		queue.async { [elementId, sourceElementId, moveDetection, budget, duplicates, isUpdated] in
+
+			let changes: MMMArrayChanges? = {
+
+				// Could have been superseded while waiting in the queue.
+				guard self.isCurrent(generation) else {
+					return nil
+				}
+
+				let oldIds = oldArray.map(elementId)
+				let newIds = newArray.map(sourceElementId)
+
+				// Getting IDs can be a substantial part of the work, so let's check again.
+				guard self.isCurrent(generation) else {
+					return nil
+				}
+
+				return MMMArrayChanges.changes(
+					oldIds: oldIds,
+					newIds: newIds,
+					moveDetection: moveDetection,
+					budget: budget,
+					duplicates: duplicates,
+					isUpdated: isUpdated.map { isUpdated in
+						{ (oldIndex, newIndex) in isUpdated(oldArray[oldIndex], newArray[newIndex]) }
+					}
+				)
+			}()
+
+			DispatchQueue.main.async {
+				// Checking on the main queue, so no other submission can sneak in between this and the completion.
+				if let changes = changes, self.isCurrent(generation) {
+					completion(changes)
+				} else {
+					superseded()
+				}
+			}
+		}
+
+		return generation
+	}
+
+	/// Makes sure that the results of all the computations submitted so far are not delivered.
+	public func cancel() {
+		lock.lock()
+		generation += 1
+		lock.unlock()
+	}
+
+	/// Same as `cancel()`, but only when the given submission is still the latest one, so the ones that followed it
+	/// are not affected.
+	internal func cancel(generation: Int) {
+		lock.lock()
+		if generation == self.generation {
+			self.generation += 1
+		}
+		lock.unlock()
+	}
+}
+
+// (`withTaskCancellationHandler(operation:onCancel:)` is available since Swift 5.7.)
+#if compiler(>=5.7)
+
+@available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *)
+extension MMMArrayChangesPipeline {
+
+	/// Same as `submit(oldArray:newArray:completion:)`, but for Swift concurrency: the changes are returned
+	/// on the main actor, while the computation happens on the pipeline's queue.
+	///
+	/// Throws `CancellationError` when the results are not delivered for any of these reasons:
+	/// - the calling task is cancelled before the changes are delivered (this cancels this computation only);
+	/// - another submission supersedes this one;
+	/// - `cancel()` is called.
+	@MainActor
+	public func changes(oldArray: [Element], newArray: [SourceElement]) async throws -> MMMArrayChanges {
+		let submission = Submission(pipeline: self)
+		return try await withTaskCancellationHandler(
+			operation: {
+				try await withCheckedThrowingContinuation { continuation in
+					let generation = submit(
+						oldArray: oldArray,
+						newArray: newArray,
+						completion: { continuation.resume(returning: $0) },
+						superseded: { continuation.resume(throwing: CancellationError()) }
+					)
+					submission.generation = generation
+					// The task could have been cancelled before the submission, when its generation wasn't known yet.
+					if Task.isCancelled {
+						cancel(generation: generation)
+					}
+				}
+			},
+			onCancel: {
+				// Can be called on any thread, while the generation is accessed on the main queue only.
+				DispatchQueue.main.async {
+					if let generation = submission.generation {
+						submission.pipeline.cancel(generation: generation)
+					}
+				}
+			}
+		)
+	}
+
+	// The submission made by `changes(oldArray:newArray:)`, passed to the cancellation handler instead of the pipeline
+	// itself. Unchecked, because it's touched on the main queue only (the pipeline is guarded by its lock anyway).
+	private final class Submission: @unchecked Sendable {
+		let pipeline: MMMArrayChangesPipeline
+		var generation: Int?
+		init(pipeline: MMMArrayChangesPipeline) {
+			self.pipeline = pipeline
+		}
+	}
+}
+
+#endif
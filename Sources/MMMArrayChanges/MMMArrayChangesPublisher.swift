@@ -0,0 +1,283 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+/**
+Shares the changes between consecutive snapshots of a list among several consumers (a table, a badge, a widget...),
+so the diff of every transition is found only once instead of once per consumer.
+
+The changes of the last `capacity` transitions are kept in a ring buffer indexed by the version of the snapshot
+they lead to. A subscriber remembers the version it has seen last: when it's up to date it simply gets the changes
+of the latest transition, while a slow one, still busy when several snapshots were published, gets the changes
+it has missed composed into one (see `MMMArrayChanges.composed(with:)`), which is much cheaper than diffing again.
+Only a subscriber that has fallen behind by more than `capacity` versions is diffed directly against the latest
+snapshot.
+
+The lock guarding the buffer is held only to read or store a few references: the diffs are found and composed
+outside of it, so publishing never waits for the subscribers and vice versa.
+
+```
+let publisher = MMMArrayChangesPublisher<Cookie, Int>(elementId: { $0.id }, isUpdated: { $0.name != $1.name })
+...
+subscription = publisher.subscribe { [weak self] changes, cookies in
+	guard let self = self else { return }
+	changes.applyToArray(&self.viewModels, sourceArray: cookies, ...)
+	_ = changes.applySkippingReloads(tableView: self.tableView, ...)
+}
+...
+// After every sync.
+publisher.publish(cookies)
+```
+*/
+public final class MMMArrayChangesPublisher<Element, ElementId: Hashable> {
+
+	private let elementId: (Element) -> ElementId
+	private let moveDetection: MMMArrayChanges.MoveDetection
+	private let duplicates: MMMArrayChanges.DuplicatePolicy
+	private let isUpdated: ((_ element: Element, _ newElement: Element) -> Bool)?
+
+	/// The maximum number of transitions a subscriber can be behind and still get the composed changes.
+	public let capacity: Int
+
+	/**
+	- Parameters:
+
+		- elementId: Same as in `MMMArrayChanges.byUpdatingArray()`.
+
+		- isUpdated: Optional closure telling if an element of an old snapshot should be updated from the element
+			with the same ID in the new one.
+
+		- capacity: The number of the latest transitions to keep.
+
+		- snapshot: The initial snapshot, the one with version 0.
+	*/
+	public init(
+		elementId: @escaping (Element) -> ElementId,
+		moveDetection: MMMArrayChanges.MoveDetection = .greedy,
+		duplicates: MMMArrayChanges.DuplicatePolicy = .precondition,
+		isUpdated: ((_ element: Element, _ newElement: Element) -> Bool)? = nil,
+		capacity: Int = 16,
+		snapshot: [Element] = []
+	) {
+		precondition(capacity > 0)
+		self.elementId = elementId
+		self.moveDetection = moveDetection
+		self.duplicates = duplicates
+		self.isUpdated = isUpdated
+		self.capacity = capacity
+		self.state = State(snapshot: snapshot, ids: snapshot.map(elementId))
+		self.ring.reserveCapacity(capacity)
+	}
+
+	fileprivate struct State {
+		var version: Int = 0
+		var snapshot: [Element]
+		var ids: [ElementId]
+		init(snapshot: [Element], ids: [ElementId]) {
+			self.snapshot = snapshot
+			self.ids = ids
+		}
+	}
+
+	private let lock = NSLock()
+
+	// The rest is guarded by the `lock`.
+
+	private var state: State
+
+	/// The changes leading to version `v` are at `(v - 1) % capacity`, for the last `capacity` versions.
+	private var ring: [MMMArrayChanges] = []
+
+	private var subscriptions: [WeakSubscription] = []
+
+	/// The latest snapshot and its version.
+	public var current: (version: Int, snapshot: [Element]) {
+		lock.lock()
+		defer { lock.unlock() }
+		return (state.version, state.snapshot)
+	}
+
+	/**
+	Makes the given array the latest snapshot, finding its changes relative to the previous one and notifying
+	the subscribers.
+
+	Should be called from one queue at a time (any queue though), so the transitions are recorded in order.
+	*/
+	@discardableResult
+	public func publish(_ snapshot: [Element]) -> MMMArrayChanges {
+
+		lock.lock()
+		let old = state
+		lock.unlock()
+
+		var new = State(snapshot: snapshot, ids: snapshot.map(elementId))
+		new.version = old.version + 1
+		let changes = self.changes(from: old, to: new)
+
+		lock.lock()
+		precondition(state.version == old.version, "Snapshots should not be published concurrently")
+		state = new
+		if ring.count < capacity {
+			ring.append(changes)
+		} else {
+			ring[(new.version - 1) % capacity] = changes
+		}
+		// Those still busy with the previous snapshots are going to catch up with this one as well.
+		var pending: [Subscription] = []
+		subscriptions.removeAll { $0.subscription == nil }
+		for weakSubscription in subscriptions {
+			if let subscription = weakSubscription.subscription, !subscription.isScheduled {
+				subscription.isScheduled = true
+				pending.append(subscription)
+			}
+		}
+		lock.unlock()
+
+		for subscription in pending {
+			subscription.queue.async { [weak self, weak subscription] in
+				guard let self = self, let subscription = subscription else {
+					return
+				}
+				self.deliver(to: subscription)
+			}
+		}
+
+		return changes
+	}
+
+	/**
+	The changes from the snapshot with the given version to the latest one, composed from the changes
+	of the transitions in between when they are still in the buffer; nil otherwise.
+	*/
+	public func changes(since version: Int) -> MMMArrayChanges? {
+		lock.lock()
+		precondition(0 <= version && version <= state.version, "Unknown version")
+		let missed = self.missed(since: version)
+		lock.unlock()
+		return missed.map(compose)
+	}
+
+	/**
+	Calls the `handler` on the given queue after a new snapshot is published, with the changes between the snapshot
+	seen by the subscriber the last time (or the latest one at the moment of subscribing) and the latest snapshot.
+
+	When the handler is still running or waiting in the queue, further snapshots don't add more calls,
+	the subscriber gets the changes of all of them at once instead.
+
+	- Parameters:
+
+		- queue: Where to call the `handler`; should be serial.
+
+	- Returns: The subscription, which is active for as long as it is retained and not cancelled.
+	*/
+	public func subscribe(
+		queue: DispatchQueue = .main,
+		handler: @escaping (_ changes: MMMArrayChanges, _ snapshot: [Element]) -> Void
+	) -> Subscription {
+		lock.lock()
+		defer { lock.unlock() }
+		let subscription = Subscription(queue: queue, state: state, handler: handler)
+		subscription.publisher = self
+		subscriptions.append(WeakSubscription(subscription))
+		return subscription
+	}
+
+	public final class Subscription {
+
+		fileprivate let queue: DispatchQueue
+		fileprivate let handler: (_ changes: MMMArrayChanges, _ snapshot: [Element]) -> Void
+
+		// Guarded by the lock of the publisher.
+
+		/// The last snapshot delivered; retained in case the subscriber falls out of the buffer.
+		fileprivate var state: State
+		fileprivate var isScheduled: Bool = false
+		fileprivate var isCancelled: Bool = false
+
+		fileprivate init(
+			queue: DispatchQueue,
+			state: State,
+			handler: @escaping (_ changes: MMMArrayChanges, _ snapshot: [Element]) -> Void
+		) {
+			self.queue = queue
+			self.state = state
+			self.handler = handler
+		}
+
+		fileprivate weak var publisher: MMMArrayChangesPublisher?
+
+		/// Makes sure the handler is not called anymore. Should be called on the queue of the subscription.
+		public func cancel() {
+			guard let publisher = publisher else {
+				isCancelled = true
+				return
+			}
+			publisher.lock.lock()
+			isCancelled = true
+			publisher.lock.unlock()
+		}
+	}
+
+	private struct WeakSubscription {
+		weak var subscription: Subscription?
+		init(_ subscription: Subscription) {
+			self.subscription = subscription
+		}
+	}
+
+	private func deliver(to subscription: Subscription) {
+
+		lock.lock()
+		subscription.isScheduled = false
+		guard !subscription.isCancelled else {
+			lock.unlock()
+			return
+		}
+		let old = subscription.state
+		let new = state
+		let missed = self.missed(since: old.version)
+		subscription.state = new
+		lock.unlock()
+
+		guard new.version != old.version else {
+			return
+		}
+		let changes = missed.map(compose) ?? self.changes(from: old, to: new)
+		subscription.handler(changes, new.snapshot)
+	}
+
+	/// The changes of the transitions since the given version, if they are all still in the buffer.
+	/// (Should be called under the `lock`.)
+	private func missed(since version: Int) -> [MMMArrayChanges]? {
+		// The buffer holds the transitions to the last `ring.count` versions.
+		guard state.version - version <= ring.count else {
+			return nil
+		}
+		return (version..<state.version).map { ring[$0 % capacity] }
+	}
+
+	private func compose(_ changes: [MMMArrayChanges]) -> MMMArrayChanges {
+		guard var result = changes.first else {
+			return MMMArrayChanges.Builder().changes()
+		}
+		for next in changes.dropFirst() {
+			result = result.composed(with: next, moveDetection: moveDetection)
+		}
+		return result
+	}
+
+	private func changes(from old: State, to new: State) -> MMMArrayChanges {
+		return MMMArrayChanges.changes(
+			oldIds: old.ids,
+			newIds: new.ids,
+			moveDetection: moveDetection,
+			duplicates: duplicates,
+			isUpdated: isUpdated.map { isUpdated in
+				{ (oldIndex, newIndex) in isUpdated(old.snapshot[oldIndex], new.snapshot[newIndex]) }
+			}
+		)
+	}
+}
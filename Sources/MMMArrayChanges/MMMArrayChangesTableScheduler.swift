@@ -0,0 +1,275 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+#if canImport(UIKit)
+
+import UIKit
+
+/**
+Applies a large set of changes to a `UITableView` in small consistent batches spread across frames.
+
+`applySkippingReloads()` performs all the deletions, insertions and moves in a single `beginUpdates()`/`endUpdates()`
+block, which is fine for a handful of changes, but with thousands of them committing that single block takes
+several frames. Here the changes are split into batches instead (see `MMMArrayChanges.BatchReplay`): every batch
+is a separate transaction between two intermediate states of the list, re-basing the indexes accordingly,
+and batches are committed for as long as the frame budget allows, the rest waiting for the next frame.
+
+Because the table view asks its data source about each intermediate state, the data source has to show `items`
+of the scheduler (instead of the final array) until the scheduler completes. It should read them on demand rather
+than keep a copy: the intermediate array is updated in place between the batches only while nothing else
+references it.
+
+Finally only the visible rows among `updates` are reloaded: the rest are going to be configured from the new items
+when their cells are dequeued anyway.
+
+Small change sets (not larger than a single batch) and changes marked as a full reload are applied right away.
+
+```
+scheduler = MMMArrayChangesTableScheduler(
+	changes: changes, oldItems: viewModels, newItems: newViewModels,
+	tableView: tableView,
+	indexPathForItemIndex: { IndexPath(row: $0, section: 0) },
+	completion: { [weak self] in self?.scheduler = nil }
+)
+viewModels = newViewModels
+scheduler.start()
+...
+func tableView(_ tableView: UITableView, numberOfRowsInSection section: Int) -> Int {
+	return scheduler?.items.count ?? viewModels.count
+}
+```
+*/
+public final class MMMArrayChangesTableScheduler<Element> {
+
+	private let changes: MMMArrayChanges
+	private let newItems: [Element]
+	private weak var tableView: UITableView?
+	private let indexPathForItemIndex: (_ itemIndex: Int) -> IndexPath
+	private let maxBatchSize: Int
+	private let frameBudget: TimeInterval
+	private let deletionAnimation: UITableView.RowAnimation
+	private let insertionAnimation: UITableView.RowAnimation
+	private let reloadAnimation: UITableView.RowAnimation
+	private var completion: (() -> Void)?
+
+	/**
+	- Parameters:
+
+		- changes: The changes between `oldItems` and `newItems`.
+
+		- oldItems: The items the table view shows now.
+
+		- newItems: The items the table view should show in the end.
+
+		- indexPathForItemIndex: Same as in `applySkippingReloads()`, but applied to intermediate indexes as well,
+			i.e. it can only customize the section or provide fixed shift of row indexes.
+
+		- maxBatchSize: The maximum number of changes per transaction.
+
+		- frameBudget: How much time to spend committing batches per frame, in seconds.
+
+		- completion: Called once all the changes are applied (or the scheduler is cancelled).
+	*/
+	public init(
+		changes: MMMArrayChanges,
+		oldItems: [Element],
+		newItems: [Element],
+		tableView: UITableView,
+		indexPathForItemIndex: @escaping (_ itemIndex: Int) -> IndexPath,
+		maxBatchSize: Int = 100,
+		frameBudget: TimeInterval = 0.008,
+		deletionAnimation: UITableView.RowAnimation = .automatic,
+		insertionAnimation: UITableView.RowAnimation = .automatic,
+		reloadAnimation: UITableView.RowAnimation = .none,
+		completion: (() -> Void)? = nil
+	) {
+		precondition(maxBatchSize > 0)
+		precondition(
+			changes.isFullReload || oldItems.count - changes.removals.count + changes.insertions.count == newItems.count,
+			"The changes do not correspond to the items"
+		)
+
+		self.changes = changes
+		if changes.isFullReload {
+			self.replay = nil
+			self.fullReloadOldItems = oldItems
+		} else {
+			self.replay = MMMArrayChanges.BatchReplay(
+				changes: changes, oldItems: oldItems, newItems: newItems, maxBatchSize: maxBatchSize
+			)
+			self.fullReloadOldItems = []
+		}
+		self.newItems = newItems
+		self.tableView = tableView
+		self.indexPathForItemIndex = indexPathForItemIndex
+		self.maxBatchSize = maxBatchSize
+		self.frameBudget = frameBudget
+		self.deletionAnimation = deletionAnimation
+		self.insertionAnimation = insertionAnimation
+		self.reloadAnimation = reloadAnimation
+		self.completion = completion
+	}
+
+	/// The items the data source should show at the moment.
+	public var items: [Element] {
+		if showsNewItems {
+			return newItems
+		} else {
+			return replay?.items ?? fullReloadOldItems
+		}
+	}
+
+	// True, once the table view is about to be taken to the final state.
+	private var showsNewItems: Bool = false
+
+	// Not keeping a copy of the intermediate items here, so the replay can update them in place.
+	private let fullReloadOldItems: [Element]
+
+	/// True, once all the changes are applied or the scheduler is cancelled.
+	public private(set) var isFinished: Bool = false
+
+	// The intermediate states the table view is taken through, nil for a full reload.
+	private var replay: MMMArrayChanges.BatchReplay<Element>?
+
+	private var displayLink: CADisplayLink?
+
+	/// Applies the first batches right away and schedules the rest, if any. The scheduler retains itself until
+	/// it's finished.
+	public func start() {
+
+		dispatchPrecondition(condition: .onQueue(.main))
+
+		guard !isFinished, displayLink == nil else {
+			return
+		}
+
+		if changes.isFullReload || changes.removals.count + changes.insertions.count + changes.moves.count <= maxBatchSize {
+			applyAtOnce()
+			return
+		}
+
+		step()
+		if !isFinished {
+			// The run loop retains the display link and the latter retains its target, so this keeps us alive.
+			let displayLink = CADisplayLink(
+				target: DisplayLinkTarget { self.step() },
+				selector: #selector(DisplayLinkTarget.fire)
+			)
+			displayLink.add(to: .main, forMode: .common)
+			self.displayLink = displayLink
+		}
+	}
+
+	/// Skips the remaining batches, reloading the table view with `newItems`.
+	public func cancel() {
+
+		dispatchPrecondition(condition: .onQueue(.main))
+
+		guard !isFinished else {
+			return
+		}
+		showsNewItems = true
+		tableView?.reloadData()
+		finish()
+	}
+
+	private func applyAtOnce() {
+		guard let tableView = tableView else {
+			cancel()
+			return
+		}
+		showsNewItems = true
+		changes.applySkippingReloads(
+			tableView: tableView,
+			indexPathForItemIndex: indexPathForItemIndex,
+			deletionAnimation: deletionAnimation,
+			insertionAnimation: insertionAnimation
+		)
+		if !changes.isFullReload {
+			reloadVisibleUpdates(tableView)
+		}
+		finish()
+	}
+
+	private func finish() {
+		isFinished = true
+		showsNewItems = true
+		replay = nil
+		displayLink?.invalidate()
+		displayLink = nil
+		let completion = self.completion
+		self.completion = nil
+		completion?()
+	}
+
+	private func step() {
+
+		guard let tableView = tableView else {
+			cancel()
+			return
+		}
+
+		let deadline = ProcessInfo.processInfo.systemUptime + frameBudget
+		repeat {
+			applyBatch(tableView)
+		} while !isFinished && ProcessInfo.processInfo.systemUptime < deadline
+	}
+
+	private func applyBatch(_ tableView: UITableView) {
+
+		guard let batch = replay?.next() else {
+			showsNewItems = true
+			reloadVisibleUpdates(tableView)
+			finish()
+			return
+		}
+
+		tableView.beginUpdates()
+		switch batch {
+		case .removals(let indexes):
+			tableView.deleteRows(at: indexes.map(indexPathForItemIndex), with: deletionAnimation)
+		case let .moves(sources, targets):
+			for (source, target) in zip(sources, targets) {
+				tableView.moveRow(at: indexPathForItemIndex(source), to: indexPathForItemIndex(target))
+			}
+		case .insertions(let indexes):
+			tableView.insertRows(at: indexes.map(indexPathForItemIndex), with: insertionAnimation)
+		}
+		tableView.endUpdates()
+	}
+
+	/// Reloads the updated rows that are visible, the rest are configured when dequeued.
+	private func reloadVisibleUpdates(_ tableView: UITableView) {
+		guard changes.updates.count > 0, let visible = tableView.indexPathsForVisibleRows, !visible.isEmpty else {
+			return
+		}
+		let visibleSet = Set(visible)
+		let indexPaths = changes.updates.lazy
+			.map { self.indexPathForItemIndex($0.newIndex) }
+			.filter { visibleSet.contains($0) }
+		guard !indexPaths.isEmpty else {
+			return
+		}
+		tableView.beginUpdates()
+		tableView.reloadRows(at: Array(indexPaths), with: reloadAnimation)
+		tableView.endUpdates()
+	}
+}
+
+// Generic classes cannot be targets of a display link, so this one forwards to the scheduler.
+private final class DisplayLinkTarget: NSObject {
+
+	private let action: () -> Void
+
+	init(_ action: @escaping () -> Void) {
+		self.action = action
+	}
+
+	@objc func fire() {
+		action()
+	}
+}
+
+#endif
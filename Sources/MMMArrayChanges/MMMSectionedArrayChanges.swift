@@ -0,0 +1,406 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+#if canImport(UIKit)
+
+import UIKit
+
+#endif
+
+/**
+UITableView/UICollectionView-compatible differences between two arrays of sections, each having its own items.
+
+Unlike running a separate `MMMArrayChanges` per section, items are tracked across sections, so an item that jumps
+from one section into another is reported as a move rather than a removal and an insertion, and all the changes
+can be applied in a single batch update, letting the table or collection view reuse the cells.
+
+The sections themselves are diffed as elements of a flat array (see `sections`), while the records for the items
+follow the rules of batch updates:
+
+- the items of removed sections are not reported, as they are removed with their sections;
+  the same goes for the items of inserted sections;
+- removals and the source index paths of moves are relative to the old sections, while insertions
+  and the target index paths of moves are relative to the new ones;
+- an item coming from a removed section or going into an inserted one is reported as an insertion
+  or a removal correspondingly, as batch updates do not allow moves from or into such sections.
+*/
+public final class MMMSectionedArrayChanges: CustomStringConvertible, Equatable {
+
+	public struct ItemMove: CustomStringConvertible, Equatable {
+
+		/// The index path of the item being moved in the *old* sections.
+		public let oldIndexPath: IndexPath
+
+		/// The index path of the item being moved in the *new* sections.
+		public let newIndexPath: IndexPath
+
+		public init(_ oldIndexPath: IndexPath, _ newIndexPath: IndexPath) {
+			self.oldIndexPath = oldIndexPath
+			self.newIndexPath = newIndexPath
+		}
+
+		public var description: String {
+			return "Move(\(oldIndexPath) -> \(newIndexPath))"
+		}
+	}
+
+	public struct ItemUpdate: CustomStringConvertible, Equatable {
+
+		/// The index path of the changed item in the *old* sections.
+		public let oldIndexPath: IndexPath
+
+		/// The index path of the changed item in the *new* sections.
+		public let newIndexPath: IndexPath
+
+		public init(_ oldIndexPath: IndexPath, _ newIndexPath: IndexPath) {
+			self.oldIndexPath = oldIndexPath
+			self.newIndexPath = newIndexPath
+		}
+
+		public var description: String {
+			return "Update(\(oldIndexPath) -> \(newIndexPath))"
+		}
+	}
+
+	/// Changes of the sections themselves, as if they were elements of a flat array.
+	public let sections: MMMArrayChanges
+
+	/// Index paths of the removed items in the old sections, in the reverse order.
+	public let removals: [IndexPath]
+
+	/// Index paths of the inserted items in the new sections.
+	public let insertions: [IndexPath]
+
+	/// Items that have moved within their section or into another one, in the order of the new sections.
+	public let moves: [ItemMove]
+
+	/// Items having the contents changed, in the order of the new sections.
+	public let updates: [ItemUpdate]
+
+	public init(
+		sections: MMMArrayChanges,
+		removals: [IndexPath],
+		insertions: [IndexPath],
+		moves: [ItemMove],
+		updates: [ItemUpdate]
+	) {
+		self.sections = sections
+		self.removals = removals
+		self.insertions = insertions
+		self.moves = moves
+		self.updates = updates
+	}
+
+	/// True if the receiver represents "no changes" situation.
+	public var isEmpty: Bool {
+		return sections.isEmpty && removals.isEmpty && insertions.isEmpty && moves.isEmpty && updates.isEmpty
+	}
+
+	public static func == (a: MMMSectionedArrayChanges, b: MMMSectionedArrayChanges) -> Bool {
+		return a.sections == b.sections
+			&& a.removals == b.removals
+			&& a.insertions == b.insertions
+			&& a.moves == b.moves
+			&& a.updates == b.updates
+	}
+
+	public var description: String {
+
+		if isEmpty {
+			return "\(String(describing: type(of: self)))(empty)"
+		}
+
+		var result: [String] = []
+		if !sections.isEmpty {
+			result.append("sections: \(sections)")
+		}
+		result.append(contentsOf: removals.map { "Removal(\($0))" })
+		result.append(contentsOf: insertions.map { "Insertion(\($0))" })
+		result.append(contentsOf: moves.map { String(describing: $0) })
+		result.append(contentsOf: updates.map { String(describing: $0) })
+
+		return "\(String(describing: type(of: self)))(\(result.joined(separator: ", ")))"
+	}
+
+	/**
+	Finds the differences between two arrays of sections.
+
+	The `sectionId` and `itemId` closures are called exactly once per section and item. The IDs of the items
+	must be unique across all the sections, not only within their own.
+
+	- Parameters:
+
+		- items: A closure returning the items of the given section.
+
+		- moveDetection: How moved sections and items are detected, see `MMMArrayChanges.MoveDetection`.
+
+		- isSectionUpdated: Optional closure telling if a section that is present in both arrays has changed,
+			so it has to be reloaded as a whole.
+
+		- isItemUpdated: Optional closure telling if an item that is present in both arrays has changed.
+			Not called for the items of removed or inserted sections.
+	*/
+	public static func between<Section, Item, SectionId: Hashable, ItemId: Hashable>(
+		oldSections: [Section],
+		newSections: [Section],
+		sectionId: (Section) -> SectionId,
+		items: (Section) -> [Item],
+		itemId: (Item) -> ItemId,
+		moveDetection: MMMArrayChanges.MoveDetection = .greedy,
+		isSectionUpdated: ((_ oldSection: Section, _ newSection: Section) -> Bool)? = nil,
+		isItemUpdated: ((_ oldItem: Item, _ newItem: Item) -> Bool)? = nil
+	) -> MMMSectionedArrayChanges {
+
+		let oldSectionIds = oldSections.map(sectionId)
+		let newSectionIds = newSections.map(sectionId)
+
+		let sections = MMMArrayChanges.changes(
+			oldIds: oldSectionIds,
+			newIds: newSectionIds,
+			moveDetection: moveDetection,
+			isUpdated: isSectionUpdated.map { isSectionUpdated in
+				{ (oldIndex, newIndex) in isSectionUpdated(oldSections[oldIndex], newSections[newIndex]) }
+			}
+		)
+
+		// The indexes of the corresponding sections or `NSNotFound` for removed/inserted ones.
+		// (The IDs are known to be unique here, it's checked when finding the changes above.)
+		var oldSectionIndexById = Dictionary<SectionId, Int>(minimumCapacity: oldSectionIds.count)
+		for (i, id) in oldSectionIds.enumerated() {
+			oldSectionIndexById[id] = i
+		}
+		var newSectionByOldSection = [Int](repeating: NSNotFound, count: oldSections.count)
+		var oldSectionByNewSection = [Int](repeating: NSNotFound, count: newSections.count)
+		for (i, id) in newSectionIds.enumerated() {
+			if let oldIndex = oldSectionIndexById[id] {
+				newSectionByOldSection[oldIndex] = i
+				oldSectionByNewSection[i] = oldIndex
+			}
+		}
+
+		let oldItems = oldSections.map(items)
+		let newItems = newSections.map(items)
+
+		// All the old items by their IDs, so we can see where the new ones are coming from.
+		var oldIndexPathById = Dictionary<ItemId, (section: Int, row: Int)>()
+		for (section, items) in oldItems.enumerated() {
+			for (row, item) in items.enumerated() {
+				let existing = oldIndexPathById.updateValue((section, row), forKey: itemId(item))
+				precondition(existing == nil, "Items in the `oldSections` cannot have duplicate IDs")
+			}
+		}
+
+		// True for the old items having a counterpart in the new sections.
+		var claimed = oldItems.map { [Bool](repeating: false, count: $0.count) }
+		// True for the old items landing in one of the sections that are not inserted, i.e. not removed per se.
+		var kept = claimed
+		// To check for duplicates among the inserted items.
+		var insertedIds = Set<ItemId>()
+
+		var insertions: [IndexPath] = []
+		var moves: [ItemMove] = []
+		var updates: [ItemUpdate] = []
+
+		for (newSection, items) in newItems.enumerated() {
+
+			let oldSection = oldSectionByNewSection[newSection]
+
+			// Where every item of this section is coming from.
+			var oldIndexPathByRow = [(section: Int, row: Int)?](repeating: nil, count: items.count)
+			for (row, item) in items.enumerated() {
+				let id = itemId(item)
+				if let oldIndexPath = oldIndexPathById[id] {
+					precondition(!claimed[oldIndexPath.section][oldIndexPath.row], "Items in the `newSections` cannot have duplicate IDs")
+					claimed[oldIndexPath.section][oldIndexPath.row] = true
+					oldIndexPathByRow[row] = oldIndexPath
+				} else {
+					let (inserted, _) = insertedIds.insert(id)
+					precondition(inserted, "Items in the `newSections` cannot have duplicate IDs")
+				}
+			}
+
+			guard oldSection != NSNotFound else {
+				// The whole section is inserted along with its items.
+				continue
+			}
+
+			// The items staying in the same section are moved only when they break the order, same as in a flat array.
+			var oldRowByNewRow = [Int](repeating: NSNotFound, count: items.count)
+			var survives = [Bool](repeating: false, count: oldItems[oldSection].count)
+			for (row, oldIndexPath) in oldIndexPathByRow.enumerated() {
+				guard let oldIndexPath = oldIndexPath else {
+					continue
+				}
+				kept[oldIndexPath.section][oldIndexPath.row] = true
+				if oldIndexPath.section == oldSection {
+					oldRowByNewRow[row] = oldIndexPath.row
+					survives[oldIndexPath.row] = true
+				}
+			}
+			var movedWithinSection = [Bool](repeating: false, count: items.count)
+			for m in MMMArrayChanges.detectMoves(
+				oldIndexByNewIndex: oldRowByNewRow,
+				survives: survives,
+				moveDetection: moveDetection
+			) {
+				movedWithinSection[m.newIndex] = true
+			}
+
+			for (row, source) in oldIndexPathByRow.enumerated() {
+
+				let newIndexPath = IndexPath(indexes: [newSection, row])
+
+				guard let source = source, newSectionByOldSection[source.section] != NSNotFound else {
+					// A new item or one coming from a removed section.
+					insertions.append(newIndexPath)
+					continue
+				}
+
+				let oldIndexPath = IndexPath(indexes: [source.section, source.row])
+				if source.section != oldSection || movedWithinSection[row] {
+					moves.append(.init(oldIndexPath, newIndexPath))
+				}
+				if let isItemUpdated = isItemUpdated, isItemUpdated(oldItems[source.section][source.row], items[row]) {
+					updates.append(.init(oldIndexPath, newIndexPath))
+				}
+			}
+		}
+
+		// Items of the remaining sections that are gone or have moved into inserted sections, in the reverse order.
+		var removals: [IndexPath] = []
+		for section in (0..<oldSections.count).reversed() where newSectionByOldSection[section] != NSNotFound {
+			for row in (0..<oldItems[section].count).reversed() where !kept[section][row] {
+				removals.append(IndexPath(indexes: [section, row]))
+			}
+		}
+
+		return MMMSectionedArrayChanges(
+			sections: sections,
+			removals: removals,
+			insertions: insertions,
+			moves: moves,
+			updates: updates
+		)
+	}
+
+	#if canImport(UIKit)
+
+	/**
+	Applies the changes of sections and items within a single `performBatchUpdates()` of the given table view,
+	skipping the updates for the same reasons as `MMMArrayChanges.applySkippingReloads()` does.
+	Use `applyReloadsAfter()` to reload updated cells and sections afterwards, if needed.
+
+	- Returns: `true`, if at least one change has been applied; the completion is not called otherwise.
+	*/
+	@discardableResult
+	public func applySkippingReloads(
+		tableView: UITableView,
+		deletionAnimation: UITableView.RowAnimation,
+		insertionAnimation: UITableView.RowAnimation,
+		completion: ((_ finished: Bool) -> Void)? = nil
+	) -> Bool {
+
+		guard hasChangesOtherThanUpdates else {
+			return false
+		}
+
+		tableView.performBatchUpdates({
+			tableView.deleteSections(IndexSet(sections.removals.map { $0.index }), with: deletionAnimation)
+			tableView.insertSections(IndexSet(sections.insertions.map { $0.index }), with: insertionAnimation)
+			sections.moves.forEach {
+				tableView.moveSection($0.oldIndex, toSection: $0.newIndex)
+			}
+			tableView.deleteRows(at: removals, with: deletionAnimation)
+			tableView.insertRows(at: insertions, with: insertionAnimation)
+			moves.forEach {
+				tableView.moveRow(at: $0.oldIndexPath, to: $0.newIndexPath)
+			}
+		}, completion: completion)
+
+		return true
+	}
+
+	/// Reloads updated sections and items in a separate `performBatchUpdates()` assuming that the rest of the changes
+	/// represented by the receiver have been applied already, i.e. using the new indexes.
+	@discardableResult
+	public func applyReloadsAfter(
+		tableView: UITableView,
+		reloadAnimation: UITableView.RowAnimation,
+		completion: ((_ finished: Bool) -> Void)? = nil
+	) -> Bool {
+
+		guard !sections.updates.isEmpty || !updates.isEmpty else {
+			return false
+		}
+
+		tableView.performBatchUpdates({
+			tableView.reloadSections(IndexSet(sections.updates.map { $0.newIndex }), with: reloadAnimation)
+			tableView.reloadRows(at: reloadedItemsAfter, with: reloadAnimation)
+		}, completion: completion)
+
+		return true
+	}
+
+	/// Same as `applySkippingReloads(tableView:...)`, but for a collection view.
+	@discardableResult
+	public func applySkippingReloads(
+		collectionView: UICollectionView,
+		completion: ((_ finished: Bool) -> Void)? = nil
+	) -> Bool {
+
+		guard hasChangesOtherThanUpdates else {
+			return false
+		}
+
+		collectionView.performBatchUpdates({
+			collectionView.deleteSections(IndexSet(sections.removals.map { $0.index }))
+			collectionView.insertSections(IndexSet(sections.insertions.map { $0.index }))
+			sections.moves.forEach {
+				collectionView.moveSection($0.oldIndex, toSection: $0.newIndex)
+			}
+			collectionView.deleteItems(at: removals)
+			collectionView.insertItems(at: insertions)
+			moves.forEach {
+				collectionView.moveItem(at: $0.oldIndexPath, to: $0.newIndexPath)
+			}
+		}, completion: completion)
+
+		return true
+	}
+
+	/// Same as `applyReloadsAfter(tableView:...)`, but for a collection view.
+	@discardableResult
+	public func applyReloadsAfter(
+		collectionView: UICollectionView,
+		completion: ((_ finished: Bool) -> Void)? = nil
+	) -> Bool {
+
+		guard !sections.updates.isEmpty || !updates.isEmpty else {
+			return false
+		}
+
+		collectionView.performBatchUpdates({
+			collectionView.reloadSections(IndexSet(sections.updates.map { $0.newIndex }))
+			collectionView.reloadItems(at: reloadedItemsAfter)
+		}, completion: completion)
+
+		return true
+	}
+
+	#endif
+
+	private var hasChangesOtherThanUpdates: Bool {
+		return !sections.removals.isEmpty || !sections.insertions.isEmpty || !sections.moves.isEmpty
+			|| !removals.isEmpty || !insertions.isEmpty || !moves.isEmpty
+	}
+
+	/// New index paths of the updated items, except the ones within reloaded sections, which are reloaded anyway.
+	private var reloadedItemsAfter: [IndexPath] {
+		let reloadedSections = Set(sections.updates.map { $0.newIndex })
+		return updates.map { $0.newIndexPath }.filter { !reloadedSections.contains($0[0]) }
+	}
+}
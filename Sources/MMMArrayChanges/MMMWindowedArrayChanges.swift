@@ -0,0 +1,194 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+
+#if canImport(UIKit)
+
+import UIKit
+
+#endif
+
+/**
+Changes between two huge lists prioritised for the visible part of the old one.
+
+Finding and replaying all the changes of a list with 100k elements takes time proportional to its size even though
+only a couple dozen of rows are visible. Here only the elements within the visible window are diffed right away,
+so the latency stays (roughly) constant as the list grows:
+
+- the visible window of the old list is aligned with the corresponding window of the new one via an "anchor",
+  the first visible element that is still there (found by scanning the new IDs outwards from the same position,
+  which normally stops right away, but never further than `maxAnchorDistance`);
+- `visible` holds the exact changes between these windows, so e.g. the visible cells can be updated;
+- `shift` tells how many rows appeared (or disappeared when negative) above the window, so the list can be
+  reloaded without the visible content jumping (see `reloadKeepingAnchor(tableView:indexPathForItemIndex:)`);
+- the changes for the whole list are available via `all`, computed on first access only, so they can be
+  finished lazily (e.g. on a background queue) or never if reloading is good enough.
+
+Note that batch updates of a table or collection view need the changes for the whole list,
+`visible` can't be applied as batch updates on its own.
+*/
+public final class MMMWindowedArrayChanges {
+
+	/// The visible window in the old array.
+	public let oldWindow: Range<Int>
+
+	/// The window in the new array corresponding to `oldWindow`. It is of the same length unless the new array
+	/// is too short.
+	public let newWindow: Range<Int>
+
+	/// The first element of the old window still present in the new array, if any.
+	public let anchor: (oldIndex: Int, newIndex: Int)?
+
+	/// Changes between the elements of the old and new windows, the indexes are relative to the windows.
+	public let visible: MMMArrayChanges
+
+	/// The number of elements inserted minus the number of elements removed before the window (unless the new one
+	/// has to be clamped at the bounds of the new array), i.e. `newWindow.lowerBound - oldWindow.lowerBound`.
+	public var shift: Int {
+		return newWindow.lowerBound - oldWindow.lowerBound
+	}
+
+	/// The changes between the whole arrays, found on the first access.
+	/// (Not thread-safe: make sure it's accessed from a single thread at a time.)
+	public private(set) lazy var all: MMMArrayChanges = allChanges()
+
+	private let allChanges: () -> MMMArrayChanges
+
+	private init(
+		oldWindow: Range<Int>,
+		newWindow: Range<Int>,
+		anchor: (oldIndex: Int, newIndex: Int)?,
+		visible: MMMArrayChanges,
+		allChanges: @escaping () -> MMMArrayChanges
+	) {
+		self.oldWindow = oldWindow
+		self.newWindow = newWindow
+		self.anchor = anchor
+		self.visible = visible
+		self.allChanges = allChanges
+	}
+
+	/**
+	Changes between two arrays given the IDs of their elements prioritised for the visible range of the old one.
+
+	Note that the IDs can be obtained in *O(n)* only, so for the latency to be independent of the size
+	of the list they should be at hand already, e.g. stored alongside the elements.
+
+	- Parameters:
+
+		- visibleRange: The indexes of the visible elements of the old array, e.g. from `indexPathsForVisibleRows`.
+
+		- maxAnchorDistance: How far from the start of the visible range the anchor is looked for in the new array,
+			in both directions. Past that the window is assumed to be gone and there is no anchor, so the latency
+			does not depend on the size of the list even in this case.
+
+		- isUpdated: Optional closure telling if the element at the given index of the old array should be updated
+			from its counterpart at the given index of the new one (the indexes are relative to the whole arrays).
+			It is retained until `all` is accessed.
+	*/
+	public static func between<ElementId: Hashable>(
+		oldIds: [ElementId],
+		newIds: [ElementId],
+		visibleRange: Range<Int>,
+		moveDetection: MMMArrayChanges.MoveDetection = .greedy,
+		maxAnchorDistance: Int = 1_000,
+		isUpdated: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)? = nil
+	) -> MMMWindowedArrayChanges {
+
+		precondition(
+			0 <= visibleRange.lowerBound && visibleRange.upperBound <= oldIds.count,
+			"The visible range should be within the old array"
+		)
+		precondition(maxAnchorDistance >= 0)
+
+		var windowIndexById = [ElementId: Int](minimumCapacity: visibleRange.count)
+		for i in visibleRange {
+			windowIndexById[oldIds[i]] = i
+		}
+
+		// Looking for the anchor closest to the start of the window, i.e. to where it's expected to be.
+		var anchor: (oldIndex: Int, newIndex: Int)?
+		if !windowIndexById.isEmpty && !newIds.isEmpty {
+			let start = Swift.min(visibleRange.lowerBound, newIds.count - 1)
+			let maxDistance = Swift.min(maxAnchorDistance, Swift.max(start, newIds.count - 1 - start))
+			var distance = 0
+			while anchor == nil && distance <= maxDistance {
+				let after = start + distance
+				if after < newIds.count, let oldIndex = windowIndexById[newIds[after]] {
+					anchor = (oldIndex, after)
+				}
+				let before = start - distance
+				if distance > 0 && before >= 0, let oldIndex = windowIndexById[newIds[before]] {
+					// The earliest element of the window in case there are two at the same distance.
+					if anchor == nil || oldIndex < anchor!.oldIndex {
+						anchor = (oldIndex, before)
+					}
+				}
+				distance += 1
+			}
+		}
+
+		// The new window keeps the anchor at the same position within it.
+		let length = Swift.min(visibleRange.count, newIds.count)
+		var newStart: Int = anchor.map { $0.newIndex - ($0.oldIndex - visibleRange.lowerBound) } ?? visibleRange.lowerBound
+		newStart = Swift.max(0, Swift.min(newStart, newIds.count - length))
+		let newWindow = newStart..<(newStart + length)
+
+		var isUpdatedInWindow: ((_ oldIndex: Int, _ newIndex: Int) -> Bool)?
+		if let isUpdated = isUpdated {
+			isUpdatedInWindow = { (oldIndex, newIndex) in
+				isUpdated(visibleRange.lowerBound + oldIndex, newStart + newIndex)
+			}
+		}
+		let visible = MMMArrayChanges.changes(
+			oldIds: Array(oldIds[visibleRange]),
+			newIds: Array(newIds[newWindow]),
+			moveDetection: moveDetection,
+			isUpdated: isUpdatedInWindow
+		)
+
+		return MMMWindowedArrayChanges(
+			oldWindow: visibleRange,
+			newWindow: newWindow,
+			anchor: anchor,
+			visible: visible,
+			allChanges: {
+				MMMArrayChanges.changes(oldIds: oldIds, newIds: newIds, moveDetection: moveDetection, isUpdated: isUpdated)
+			}
+		)
+	}
+}
+
+#if canImport(UIKit)
+
+extension MMMWindowedArrayChanges {
+
+	/**
+	Reloads the table view (which should be showing the new array already) keeping the anchor element at the same
+	position on the screen, so the visible content does not jump due to the rows inserted or removed above it.
+
+	- Parameters:
+
+		- indexPathForItemIndex: A closure returning an index path corresponding to the index of the element
+			either in the new or the old arrays. I.e. it can only customize the section or provide fixed shift
+			of row indexes.
+	*/
+	public func reloadKeepingAnchor(tableView: UITableView, indexPathForItemIndex: (_ itemIndex: Int) -> IndexPath) {
+
+		guard let anchor = anchor else {
+			tableView.reloadData()
+			return
+		}
+
+		let oldOffset = tableView.rectForRow(at: indexPathForItemIndex(anchor.oldIndex)).minY - tableView.contentOffset.y
+		tableView.reloadData()
+		tableView.layoutIfNeeded()
+		let newY = tableView.rectForRow(at: indexPathForItemIndex(anchor.newIndex)).minY
+		tableView.contentOffset = CGPoint(x: tableView.contentOffset.x, y: newY - oldOffset)
+	}
+}
+
+#endif
@@ -0,0 +1,116 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+#if canImport(UIKit) || canImport(AppKit)
+
+#if canImport(UIKit)
+import UIKit
+#else
+import AppKit
+#endif
+
+@available(iOS 13, macOS 10.15.1, tvOS 13, *)
+extension NSDiffableDataSourceSnapshot {
+
+	/**
+	Replays the given changes onto the items of the given section of the receiver, so the snapshot for the next
+	`apply()` of a diffable data source is derived from the current one with a few targeted edits instead of
+	being rebuilt from scratch out of all the identifiers.
+
+	Note that the data source still compares the snapshots when applying, this only avoids building one
+	from the whole list and gets the changes expressed the same way as with batch updates.
+
+	The items of the section are simply replaced with `newItems` for changes marked as a full reload (see `Budget`)
+	with all the surviving ones reloaded.
+
+	- Parameters:
+
+		- changes: Changes between the items currently in the section and `newItems`.
+
+		- section: The section to modify; it should be in the snapshot already.
+
+		- newItems: The identifiers of all the items of the section after the changes, i.e. of the new array.
+
+		- reloadUpdated: `false` to skip reloading of the updated items, e.g. when the cells observe their view models.
+	*/
+	public mutating func apply(
+		_ changes: MMMArrayChanges,
+		inSection section: SectionIdentifierType,
+		newItems: [ItemIdentifierType],
+		reloadUpdated: Bool = true
+	) {
+
+		let oldItems = itemIdentifiers(inSection: section)
+
+		if let fullReload = changes.fullReload {
+			precondition(
+				oldItems.count == fullReload.oldCount && newItems.count == fullReload.oldIndexByNewIndex.count,
+				"The changes do not correspond to the section and the new items"
+			)
+			deleteItems(oldItems)
+			appendItems(newItems, toSection: section)
+			if reloadUpdated {
+				let survivors = fullReload.oldIndexByNewIndex.indices.filter { fullReload.oldIndexByNewIndex[$0] != NSNotFound }
+				reloadItems(survivors.map { newItems[$0] })
+			}
+			return
+		}
+
+		precondition(
+			oldItems.count - changes.removals.count + changes.insertions.count == newItems.count,
+			"The changes do not correspond to the section and the new items"
+		)
+
+		deleteItems(changes.removals.map { oldItems[$0.index] })
+
+		// Moved and inserted items are placed right after their predecessors in the new array in the order of the latter,
+		// so every predecessor is in place by then and the items that simply stay are never touched.
+		var moved = [Bool](repeating: false, count: newItems.count)
+		for m in changes.moves {
+			moved[m.newIndex] = true
+		}
+		var inserted = [Bool](repeating: false, count: newItems.count)
+		for i in changes.insertions {
+			inserted[i.index] = true
+		}
+
+		var i = 0
+		while i < newItems.count {
+
+			if moved[i] {
+				let item = newItems[i]
+				if i > 0 {
+					moveItem(item, afterItem: newItems[i - 1])
+				} else if let first = itemIdentifiers(inSection: section).first, first != item {
+					moveItem(item, beforeItem: first)
+				}
+				i += 1
+			} else if inserted[i] {
+				// Consecutive insertions go as a single run.
+				var end = i + 1
+				while end < newItems.count && inserted[end] {
+					end += 1
+				}
+				let items = Array(newItems[i..<end])
+				if i > 0 {
+					insertItems(items, afterItem: newItems[i - 1])
+				} else if let first = itemIdentifiers(inSection: section).first {
+					insertItems(items, beforeItem: first)
+				} else {
+					appendItems(items, toSection: section)
+				}
+				i = end
+			} else {
+				i += 1
+			}
+		}
+
+		if reloadUpdated && !changes.updates.isEmpty {
+			reloadItems(changes.updates.map { newItems[$0.newIndex] })
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,110 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+#include "MMMArrayChangesCore.h"
+
+#include <string.h>
+
+static int MMMArrayChangesCoreBits(intptr_t oldCount, intptr_t newCount) {
+	int bits = 1;
+	while (((intptr_t)1 << bits) < 2 * (oldCount + newCount)) {
+		bits++;
+	}
+	return bits;
+}
+
+intptr_t MMMArrayChangesCoreSlotCount(intptr_t oldCount, intptr_t newCount) {
+	return (intptr_t)1 << MMMArrayChangesCoreBits(oldCount, newCount);
+}
+
+MMMArrayChangesCoreResult MMMArrayChangesCoreMatch(
+	const uint64_t *oldHashes, intptr_t oldCount,
+	const uint64_t *newHashes, intptr_t newCount,
+	MMMArrayChangesCoreEqual equal, void *context,
+	intptr_t *slots,
+	intptr_t *oldIndexByNewIndex,
+	bool *survives
+) {
+	MMMArrayChangesCoreResult result = {
+		.oldDuplicateCount = 0,
+		.firstOldDuplicate = MMMArrayChangesCoreNotFound,
+		.newDuplicateCount = 0,
+		.firstNewDuplicate = MMMArrayChangesCoreNotFound,
+		.steps = 0
+	};
+
+	const int bits = MMMArrayChangesCoreBits(oldCount, newCount);
+	const intptr_t mask = ((intptr_t)1 << bits) - 1;
+	// Fibonacci hashing: the top bits of the product are well mixed even for sequential or poorly mixed hashes.
+	const int shift = 64 - bits;
+	const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+
+	// 0 for empty slots, `i + 1` for an item of the old array with index `i`,
+	// `-(i + 1)` for an inserted item of the new array with index `i`.
+	memset(slots, 0, (mask + 1) * sizeof(intptr_t));
+
+	memset(survives, 0, oldCount * sizeof(bool));
+
+	for (intptr_t oldIndex = 0; oldIndex < oldCount; oldIndex++) {
+		intptr_t slot = (intptr_t)((oldHashes[oldIndex] * multiplier) >> shift);
+		bool duplicate = false;
+		for (;;) {
+			result.steps++;
+			const intptr_t entry = slots[slot];
+			if (entry == 0)
+				break;
+			if (oldHashes[entry - 1] == oldHashes[oldIndex] && equal(context, entry - 1, oldIndex)) {
+				duplicate = true;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		if (duplicate) {
+			// Only the first item with the same ID gets into the table.
+			if (result.oldDuplicateCount++ == 0)
+				result.firstOldDuplicate = oldIndex;
+		} else {
+			slots[slot] = oldIndex + 1;
+		}
+	}
+
+	for (intptr_t newIndex = 0; newIndex < newCount; newIndex++) {
+		const uint64_t hash = newHashes[newIndex];
+		intptr_t slot = (intptr_t)((hash * multiplier) >> shift);
+		oldIndexByNewIndex[newIndex] = MMMArrayChangesCoreNotFound;
+		for (;;) {
+			result.steps++;
+			const intptr_t entry = slots[slot];
+			if (entry == 0) {
+				// Not in the old array; recording it to catch duplicates among the inserted items.
+				slots[slot] = -(newIndex + 1);
+				break;
+			} else if (entry > 0) {
+				const intptr_t oldIndex = entry - 1;
+				if (oldHashes[oldIndex] == hash && equal(context, oldIndex, oldCount + newIndex)) {
+					if (survives[oldIndex]) {
+						// Matched by an item before already, so this one is inserted.
+						if (result.newDuplicateCount++ == 0)
+							result.firstNewDuplicate = newIndex;
+					} else {
+						survives[oldIndex] = true;
+						oldIndexByNewIndex[newIndex] = oldIndex;
+					}
+					break;
+				}
+			} else {
+				const intptr_t otherIndex = -entry - 1;
+				if (newHashes[otherIndex] == hash && equal(context, oldCount + otherIndex, oldCount + newIndex)) {
+					if (result.newDuplicateCount++ == 0)
+						result.firstNewDuplicate = newIndex;
+					break;
+				}
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	return result;
+}
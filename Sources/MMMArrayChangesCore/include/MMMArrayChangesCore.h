@@ -0,0 +1,87 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+#ifndef MMMArrayChangesCore_h
+#define MMMArrayChangesCore_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The core shared by the Swift and ObjC engines: matching the items of the old and new arrays by their IDs.
+ *
+ * The IDs themselves are opaque here: the engines pass the hashes of all of them (computed in a single pass)
+ * and a callback comparing two IDs, so the matching works over plain buffers of indexes with a single allocation
+ * for the hash table instead of boxing indexes into dictionaries and sets.
+ */
+
+/** Marks the items of the new array without a counterpart in the old one, the same as `NSNotFound`. */
+#define MMMArrayChangesCoreNotFound INTPTR_MAX
+
+/**
+ * Tells if two IDs are equal. The indexes are in the joint index space of both arrays: the items of the old array
+ * go first, then the ones of the new array, i.e. the index of the item `i` of the new array is `oldCount + i`.
+ */
+typedef bool (*MMMArrayChangesCoreEqual)(void *context, intptr_t a, intptr_t b);
+
+/** Duplicate IDs found while matching. */
+typedef struct {
+
+	/** The number of items of the old array having the same ID as one of the items before them. */
+	intptr_t oldDuplicateCount;
+
+	/** The index of the first such item of the old array or MMMArrayChangesCoreNotFound. */
+	intptr_t firstOldDuplicate;
+
+	/** Same for the items of the new array. */
+	intptr_t newDuplicateCount;
+	intptr_t firstNewDuplicate;
+
+	/** The number of slots of the hash table probed in total. */
+	intptr_t steps;
+
+} MMMArrayChangesCoreResult;
+
+/**
+ * The number of slots the table passed to `MMMArrayChangesCoreMatch()` should have for arrays of the given sizes:
+ * a power of 2 keeping the table at most half full.
+ */
+intptr_t MMMArrayChangesCoreSlotCount(intptr_t oldCount, intptr_t newCount);
+
+/**
+ * Matches the items of both arrays by their IDs.
+ *
+ * Duplicates do not break the matching: only the first item of the old array with the same ID can have
+ * a counterpart in the new array (the other ones are treated as removed) and only the first item of the new array
+ * with the same ID is matched (the other ones are treated as inserted). They are counted in the result, so the engine
+ * can choose what to do about them.
+ *
+ * @param oldHashes The hashes of the IDs of the items of the old array. Equal IDs must have equal hashes.
+ * @param newHashes Same for the new array.
+ * @param slots Scratch storage for the hash table with `MMMArrayChangesCoreSlotCount()` values, does not need
+ *   to be initialized.
+ * @param oldIndexByNewIndex Receives for every item of the new array the index of the matching item
+ *   of the old array or MMMArrayChangesCoreNotFound.
+ * @param survives Receives true for the items of the old array that have a matching item in the new one.
+ */
+MMMArrayChangesCoreResult MMMArrayChangesCoreMatch(
+	const uint64_t *oldHashes, intptr_t oldCount,
+	const uint64_t *newHashes, intptr_t newCount,
+	MMMArrayChangesCoreEqual equal, void *context,
+	intptr_t *slots,
+	intptr_t *oldIndexByNewIndex,
+	bool *survives
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -12,6 +12,35 @@ NS_ASSUME_NONNULL_BEGIN
 @class MMMArrayChangesRemoval;
 @class MMMArrayChangesUpdate;
 
+/**
+ * What it took to find the changes, see `MMMArrayChanges.metricsObserver`.
+ */
+typedef struct {
+
+	/** The number of items in the old and new arrays. */
+	NSInteger oldCount;
+	NSInteger newCount;
+
+	/** How many times the ID blocks were called. */
+	NSInteger idBlockCalls;
+
+	/** The number of lookups (or insertions) in the hash tables. */
+	NSInteger lookups;
+
+	/** The number of items having the same ID as one of the items before them in the same array. */
+	NSInteger duplicateCount;
+
+	/** The number of the records found. */
+	NSInteger removalCount;
+	NSInteger insertionCount;
+	NSInteger moveCount;
+	NSInteger updateCount;
+
+	/** The time spent in total, in seconds. */
+	NSTimeInterval elapsed;
+
+} MMMArrayChangesMetrics;
+
 /**
  * Finds differences between two arrays with elements possibly of different types. (To get better autocompletion in ObjC
  * you can specify these types as parameters, e.g. `MMMArrayChanges<MyListItem *, FIRDatabaseSnapshot *>`.)
@@ -38,6 +67,9 @@ NS_SWIFT_UNAVAILABLE("Use the Swift port with the same name instead")
  *
  * The `comparisonBlock` is called for items having the same ID to figure out if any inner properties of the item have
  * changed enough to mark the corresponding item as "updated" (e.g. to require a reload of a corresponding table view cell).
+ *
+ * Duplicate IDs are tolerated: only the first item with the same ID is matched, the other ones are removed
+ * from the old array and inserted into the new one (the same as `DuplicatePolicy.keepFirst` in Swift).
  */
 + (nonnull instancetype)changesWithOldArray:(NSArray *)oldArray
 	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(OldItemType _Nonnull item))oldIdFromItemBlock
@@ -45,6 +77,20 @@ NS_SWIFT_UNAVAILABLE("Use the Swift port with the same name instead")
 	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(NewItemType _Nonnull item))newIdFromItemBlock
 	comparisonBlock:(BOOL (NS_NOESCAPE ^)(OldItemType _Nonnull oldItem, NewItemType _Nonnull newItem))comparisonBlock;
 
+/**
+ * Same as the above, but with `concurrent` set to YES the IDs are obtained and the items are compared by chunks
+ * spread across all the cores via dispatch_apply(), which pays off for very large arrays or expensive comparisons.
+ *
+ * The blocks are called concurrently then (though never for the same item twice), so they must be thread-safe.
+ * The result is exactly the same as in the serial mode.
+ */
++ (nonnull instancetype)changesWithOldArray:(NSArray *)oldArray
+	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(OldItemType _Nonnull item))oldIdFromItemBlock
+	newArray:(NSArray<NewItemType> *)newArray
+	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(NewItemType _Nonnull item))newIdFromItemBlock
+	comparisonBlock:(BOOL (NS_NOESCAPE ^)(OldItemType _Nonnull oldItem, NewItemType _Nonnull newItem))comparisonBlock
+	concurrent:(BOOL)concurrent;
+
 /** 
  * Finds UITableView-compatible differences between two arrays having elements of the same hashable type that can be 
  * compared with isEqual.
@@ -53,9 +99,28 @@ NS_SWIFT_UNAVAILABLE("Use the Swift port with the same name instead")
  */
 + (nonnull instancetype)changesWithOldArray:(NSArray<OldItemType> *)oldArray newArray:(NSArray<NewItemType> *)newArray;
 
+/**
+ * Opt-in instrumentation: when set, the block is called with the metrics of every diff (including the ones of
+ * `MMMArrayChangesContext`) synchronously on the thread finding it.
+ *
+ * Set it (as well as `emitsSignposts`) once early on, e.g. on app launch, as these are not synchronized with
+ * the diffs running on other threads. When neither is set, the only overhead is checking a flag per phase.
+ */
+@property (class, nonatomic, copy, nullable) void (^metricsObserver)(MMMArrayChangesMetrics metrics);
+
+/**
+ * When YES, every diff and its phases (ids, fastCheck, indexing, removals, insertions, updates, moves)
+ * are marked with `os_signpost` intervals (iOS 12+) under the "MMMArrayChanges" subsystem.
+ */
+@property (class, nonatomic) BOOL emitsSignposts;
+
 /** YES, if there is no difference between an old and a new arrays. */
 @property (nonatomic, readonly, getter=isEmpty) BOOL empty;
 
+/**
+ * The records are kept packed into a single block of indexes internally. The arrays of objects below are created
+ * on the first access only, so the methods applying the changes never need them.
+ */
 @property (nonatomic, readonly) NSArray<MMMArrayChangesRemoval *> *removals;
 @property (nonatomic, readonly) NSArray<MMMArrayChangesInsertion *> *insertions;
 @property (nonatomic, readonly) NSArray<MMMArrayChangesMove *> *moves;
@@ -74,7 +139,9 @@ NS_SWIFT_UNAVAILABLE("Use the Swift port with the same name instead")
  * - `newItemBlock` should be able to create a new item for the "old array" from a corresponding item of the new array;
  * - the optional `updateBlock` is called to modify an old item based on the corresponding item from the new array;
  * - the optional `removalBlock` is called for every item being removed (after it is removed from the array but before
- *   new items are added or moves made).
+ *   new items are added).
+ *
+ * (The array is rebuilt in a single O(n) pass regardless of the number of changes.)
  */
 - (void)applyToArray:(NSMutableArray *)oldArray
 	newArray:(NSArray<NewItemType> *)newArray
@@ -113,6 +180,19 @@ NS_SWIFT_UNAVAILABLE("Use the Swift port with the same name instead")
 	deletionAnimation:(UITableViewRowAnimation)deletionAnimation
 	insertionAnimation:(UITableViewRowAnimation)insertionAnimation;
 
+/**
+ * Replays removals, insertions and moves represented by the receiver onto `UICollectionView` within a single
+ * `performBatchUpdates:completion:`.
+ *
+ * Updates are not applied for the same reasons as with table views: the index paths of the updated items
+ * in the new array are returned instead, so they could be reloaded afterwards (e.g. from the completion block).
+ *
+ * Nothing is done and the completion block is not called when there are no removals, insertions or moves.
+ */
+- (NSArray<NSIndexPath *> *)applyToCollectionView:(UICollectionView *)collectionView
+	indexPathForItemIndex:(NSIndexPath* (NS_NOESCAPE ^)(NSInteger item))indexPathForItemIndex
+	completion:(void (^ __nullable)(BOOL finished))completion;
+
 #endif
 
 #pragma mark -
@@ -126,6 +206,47 @@ NS_SWIFT_UNAVAILABLE("Use the Swift port with the same name instead")
 
 @end
 
+/**
+ * Same as `+[MMMArrayChanges changesWithOldArray:...]`, but keeping the ID arrays, the hash tables and other scratch
+ * buffers between the calls instead of allocating them every time, which matters when the same lists are diffed
+ * over and over again, like on every sync. Once the buffers have grown large enough, finding no changes
+ * allocates nothing in the serial mode (except for what the ID blocks might allocate).
+ *
+ * Note that the IDs of the last diffed arrays are retained until the next call or until the context is deallocated.
+ * The context is not thread-safe: use one per list or make sure it's used from a single queue at a time.
+ */
+NS_SWIFT_UNAVAILABLE("Use the Swift port with the same name instead")
+@interface MMMArrayChangesContext<OldItemType : id, NewItemType : id> : NSObject
+
+- (id)init NS_DESIGNATED_INITIALIZER;
+
+/** See `+[MMMArrayChanges changesWithOldArray:idFromItemBlock:newArray:idFromItemBlock:comparisonBlock:concurrent:]`. */
+- (MMMArrayChanges<OldItemType, NewItemType> *)changesWithOldArray:(NSArray<OldItemType> *)oldArray
+	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(OldItemType _Nonnull item))oldIdFromItemBlock
+	newArray:(NSArray<NewItemType> *)newArray
+	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(NewItemType _Nonnull item))newIdFromItemBlock
+	comparisonBlock:(BOOL (NS_NOESCAPE ^)(OldItemType _Nonnull oldItem, NewItemType _Nonnull newItem))comparisonBlock
+	concurrent:(BOOL)concurrent;
+
+/**
+ * Same as the above, but the items are compared via cheap fingerprints first (like a hash of their fields or a version
+ * counter maintained by the backend), so the `comparisonBlock` is only called for the items whose fingerprints differ.
+ *
+ * The fingerprints of the items of the new array are retained till the next call, so they are not needed for the old
+ * array: if the IDs of the old array are the same as the IDs of the new array in the previous call (i.e. it is
+ * the same list), then its items are assumed to correspond to the ones fingerprinted last time. Otherwise (e.g. on
+ * the first call) the `comparisonBlock` is called for every pair of matching items.
+ */
+- (MMMArrayChanges<OldItemType, NewItemType> *)changesWithOldArray:(NSArray<OldItemType> *)oldArray
+	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(OldItemType _Nonnull item))oldIdFromItemBlock
+	newArray:(NSArray<NewItemType> *)newArray
+	idFromItemBlock:(_Nonnull id (NS_NOESCAPE ^)(NewItemType _Nonnull item))newIdFromItemBlock
+	fingerprintBlock:(NSUInteger (NS_NOESCAPE ^)(NewItemType _Nonnull newItem))fingerprintBlock
+	comparisonBlock:(BOOL (NS_NOESCAPE ^)(OldItemType _Nonnull oldItem, NewItemType _Nonnull newItem))comparisonBlock
+	concurrent:(BOOL)concurrent;
+
+@end
+
 /** 
  * To represent a removal of an old object. 
  */
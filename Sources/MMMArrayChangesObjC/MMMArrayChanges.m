@@ -4,12 +4,306 @@
 //
 
 #import "MMMArrayChanges.h"
+#import "MMMArrayChangesCore.h"
+
+#import <os/signpost.h>
 
 // Alias class parameters so we can use the same definitions as in the header.
 typedef id NewItemType;
 typedef id OldItemType;
 
-@implementation MMMArrayChanges
+// A Fenwick (binary indexed) tree over counters, helps to find how many elements marked in the intermediate array
+// precede the given one in O(log(n)) instead of scanning it. (See FenwickTree.swift for the Swift counterpart.)
+
+static NSInteger *MMMFenwickTreeCreate(const bool *values, NSInteger count) {
+	NSInteger *tree = calloc(count + 1, sizeof(NSInteger));
+	for (NSInteger i = 1; i <= count; i++) {
+		tree[i] += values[i - 1] ? 1 : 0;
+		NSInteger parent = i + (i & -i);
+		if (parent <= count)
+			tree[parent] += tree[i];
+	}
+	return tree;
+}
+
+static inline void MMMFenwickTreeAdd(NSInteger *tree, NSInteger count, NSInteger index, NSInteger delta) {
+	for (NSInteger i = index + 1; i <= count; i += i & -i) {
+		tree[i] += delta;
+	}
+}
+
+/** The sum of the counters with indexes in [0, index). */
+static inline NSInteger MMMFenwickTreePrefixSum(const NSInteger *tree, NSInteger index) {
+	NSInteger result = 0;
+	for (NSInteger i = index; i > 0; i -= i & -i) {
+		result += tree[i];
+	}
+	return result;
+}
+
+// Chunks smaller than this are not worth dispatching to other cores.
+static const NSInteger MMMArrayChangesMinChunkSize = 256;
+
+/**
+ * Calls the block for consecutive ranges covering [0, count), either once for the whole range or concurrently
+ * for several chunks per core via dispatch_apply(). (See MMMArrayChanges+Concurrency.swift for the Swift counterpart.)
+ */
+static void MMMArrayChangesForChunks(NSInteger count, BOOL concurrent, void (NS_NOESCAPE ^block)(NSInteger start, NSInteger end)) {
+
+	if (!concurrent || count <= MMMArrayChangesMinChunkSize) {
+		block(0, count);
+		return;
+	}
+
+	NSInteger chunkCount = 4 * [NSProcessInfo processInfo].activeProcessorCount;
+	NSInteger chunkSize = MAX(MMMArrayChangesMinChunkSize, (count + chunkCount - 1) / chunkCount);
+	NSInteger chunks = (count + chunkSize - 1) / chunkSize;
+	dispatch_apply(chunks, DISPATCH_APPLY_AUTO, ^(size_t chunk) {
+		NSInteger start = chunk * chunkSize;
+		block(start, MIN(count, start + chunkSize));
+	});
+}
+
+/** The IDs of the given items, in the same order. */
+static NSArray *MMMArrayChangesIds(NSArray *items, id (NS_NOESCAPE ^idFromItemBlock)(id item), BOOL concurrent) {
+
+	NSInteger count = items.count;
+
+	if (!concurrent || count <= MMMArrayChangesMinChunkSize) {
+		NSMutableArray *ids = [[NSMutableArray alloc] initWithCapacity:count];
+		for (id item in items) {
+			[ids addObject:idFromItemBlock(item)];
+		}
+		return ids;
+	}
+
+	// Every chunk fills its own part of a plain C array, which is safe unlike adding to a mutable array.
+	__strong id *ids = (__strong id *)calloc(count, sizeof(id));
+	MMMArrayChangesForChunks(count, YES, ^(NSInteger start, NSInteger end) {
+		for (NSInteger i = start; i < end; i++) {
+			ids[i] = idFromItemBlock(items[i]);
+		}
+	});
+	NSArray *result = [[NSArray alloc] initWithObjects:ids count:count];
+	for (NSInteger i = 0; i < count; i++) {
+		ids[i] = nil;
+	}
+	free(ids);
+
+	return result;
+}
+
+/**
+ * The IDs of the given items collected into the given reusable array, unless the concurrent mode is on,
+ * where the items are split into chunks and the IDs end up in a new array.
+ */
+static NSArray *MMMArrayChangesCollectIds(
+	NSMutableArray *ids,
+	NSArray *items,
+	id (NS_NOESCAPE ^idFromItemBlock)(id item),
+	BOOL concurrent
+) {
+	[ids removeAllObjects];
+	if (concurrent && items.count > MMMArrayChangesMinChunkSize) {
+		return MMMArrayChangesIds(items, idFromItemBlock, YES);
+	}
+	for (id item in items) {
+		[ids addObject:idFromItemBlock(item)];
+	}
+	return ids;
+}
+
+/**
+ * Makes sure the given scratch buffer can hold `count` zeroed values of the given size, growing it if needed.
+ * Returns the buffer, which might be different from the one passed.
+ */
+static void *MMMArrayChangesScratch(void *buffer, NSInteger *capacity, NSInteger count, size_t size) {
+	// Always at least one value, so the buffer is never NULL.
+	if (count + 1 > *capacity) {
+		*capacity = MAX(count + 1, 2 * *capacity);
+		free(buffer);
+		buffer = malloc(*capacity * size);
+	}
+	memset(buffer, 0, (count + 1) * size);
+	return buffer;
+}
+
+/**
+ * A growable buffer of indexes the records are packed into while they are found.
+ * (One allocation per diff instead of an object per change.)
+ */
+typedef struct {
+	NSInteger *values;
+	NSInteger count;
+	NSInteger capacity;
+} MMMArrayChangesBuffer;
+
+static inline void MMMArrayChangesBufferAppend(MMMArrayChangesBuffer *buffer, NSInteger value) {
+	if (buffer->count >= buffer->capacity) {
+		buffer->capacity = MAX(16, 2 * buffer->capacity);
+		buffer->values = realloc(buffer->values, buffer->capacity * sizeof(NSInteger));
+	}
+	buffer->values[buffer->count++] = value;
+}
+
+//
+// Instrumentation, see `MMMArrayChanges.metricsObserver`. (See MMMArrayChanges+Instrumentation.swift for the Swift
+// counterpart.)
+//
+
+static void (^MMMArrayChangesMetricsObserver)(MMMArrayChangesMetrics metrics) = nil;
+static BOOL MMMArrayChangesEmitsSignposts = NO;
+// Follows the two above, so a single flag is checked by every diff.
+static BOOL MMMArrayChangesInstrumentationEnabled = NO;
+
+/** The metrics of a diff in progress. */
+typedef struct {
+	MMMArrayChangesMetrics metrics;
+	NSTimeInterval start;
+	const char *phase;
+	// OS_SIGNPOST_ID_NULL, unless emitting signposts.
+	uint64_t signpostId;
+} MMMArrayChangesProbe;
+
+API_AVAILABLE(ios(12.0), macos(10.14), tvos(12.0), watchos(5.0))
+static os_log_t MMMArrayChangesLog(void) {
+	static os_log_t log = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		log = os_log_create("MMMArrayChanges", "MMMArrayChanges");
+	});
+	return log;
+}
+
+/** Starts measuring a diff using the given storage, returns NULL when the instrumentation is off. */
+static MMMArrayChangesProbe *MMMArrayChangesProbeBegin(MMMArrayChangesProbe *probe) {
+
+	if (!MMMArrayChangesInstrumentationEnabled)
+		return NULL;
+
+	memset(probe, 0, sizeof(*probe));
+	probe->start = [NSProcessInfo processInfo].systemUptime;
+	if (@available(iOS 12.0, macOS 10.14, tvOS 12.0, watchOS 5.0, *)) {
+		if (MMMArrayChangesEmitsSignposts) {
+			os_log_t log = MMMArrayChangesLog();
+			probe->signpostId = os_signpost_id_generate(log);
+			os_signpost_interval_begin(log, probe->signpostId, "Operation", "%{public}s", "changesWithOldArray");
+		}
+	}
+	return probe;
+}
+
+/** Ends the current phase, if any, and begins the given one (unless it's NULL). */
+static void MMMArrayChangesProbeEnter(MMMArrayChangesProbe *probe, const char *phase) {
+
+	if (!probe)
+		return;
+
+	if (@available(iOS 12.0, macOS 10.14, tvOS 12.0, watchOS 5.0, *)) {
+		if (probe->signpostId != OS_SIGNPOST_ID_NULL) {
+			os_log_t log = MMMArrayChangesLog();
+			if (probe->phase) {
+				os_signpost_interval_end(log, probe->signpostId, "Phase", "%{public}s", probe->phase);
+			}
+			if (phase) {
+				os_signpost_interval_begin(log, probe->signpostId, "Phase", "%{public}s", phase);
+			}
+		}
+	}
+	probe->phase = phase;
+}
+
+static void MMMArrayChangesProbeCount(
+	MMMArrayChangesProbe *probe,
+	NSInteger removalCount, NSInteger insertionCount, NSInteger moveCount, NSInteger updateCount
+) {
+	if (!probe)
+		return;
+	probe->metrics.removalCount = removalCount;
+	probe->metrics.insertionCount = insertionCount;
+	probe->metrics.moveCount = moveCount;
+	probe->metrics.updateCount = updateCount;
+}
+
+/** Completes the measurement and passes the metrics to the observer. */
+static void MMMArrayChangesProbeFinish(MMMArrayChangesProbe *probe) {
+
+	if (!probe)
+		return;
+
+	MMMArrayChangesProbeEnter(probe, NULL);
+	probe->metrics.elapsed = [NSProcessInfo processInfo].systemUptime - probe->start;
+	if (@available(iOS 12.0, macOS 10.14, tvOS 12.0, watchOS 5.0, *)) {
+		if (probe->signpostId != OS_SIGNPOST_ID_NULL) {
+			os_signpost_interval_end(MMMArrayChangesLog(), probe->signpostId, "Operation", "%{public}s", "changesWithOldArray");
+		}
+	}
+	void (^observer)(MMMArrayChangesMetrics metrics) = MMMArrayChangesMetricsObserver;
+	if (observer) {
+		observer(probe->metrics);
+	}
+}
+
+@interface MMMArrayChanges ()
+
+/** A shared instance representing no changes. */
++ (instancetype)zero;
+
+/**
+ * Takes ownership of the given malloc'ed buffer holding the indexes of all the removals, then insertions,
+ * then moves and updates taking 4 and 2 values per record correspondingly.
+ */
+- (id)initWithRecords:(NSInteger *)records
+	removalCount:(NSInteger)removalCount
+	insertionCount:(NSInteger)insertionCount
+	moveCount:(NSInteger)moveCount
+	updateCount:(NSInteger)updateCount NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation MMMArrayChanges {
+
+	// All the records packed into a single block, the pointers below point into it.
+	NSInteger *_records;
+
+	NSInteger *_removalIndexes;
+	NSInteger _removalCount;
+
+	NSInteger *_insertionIndexes;
+	NSInteger _insertionCount;
+
+	// oldIndex, newIndex, intermediateSourceIndex, intermediateTargetIndex for every move.
+	NSInteger *_moveRecords;
+	NSInteger _moveCount;
+
+	// oldIndex, newIndex for every update.
+	NSInteger *_updateRecords;
+	NSInteger _updateCount;
+
+	// The public arrays of objects are created only when asked for.
+	NSArray<MMMArrayChangesRemoval *> *_removals;
+	NSArray<MMMArrayChangesInsertion *> *_insertions;
+	NSArray<MMMArrayChangesMove *> *_moves;
+	NSArray<MMMArrayChangesUpdate *> *_updates;
+}
+
++ (void (^)(MMMArrayChangesMetrics))metricsObserver {
+	return MMMArrayChangesMetricsObserver;
+}
+
++ (void)setMetricsObserver:(void (^)(MMMArrayChangesMetrics))metricsObserver {
+	MMMArrayChangesMetricsObserver = [metricsObserver copy];
+	MMMArrayChangesInstrumentationEnabled = MMMArrayChangesMetricsObserver != nil || MMMArrayChangesEmitsSignposts;
+}
+
++ (BOOL)emitsSignposts {
+	return MMMArrayChangesEmitsSignposts;
+}
+
++ (void)setEmitsSignposts:(BOOL)emitsSignposts {
+	MMMArrayChangesEmitsSignposts = emitsSignposts;
+	MMMArrayChangesInstrumentationEnabled = MMMArrayChangesMetricsObserver != nil || MMMArrayChangesEmitsSignposts;
+}
 
 + (instancetype)zero {
 
@@ -45,181 +339,183 @@ typedef id OldItemType;
 	idFromItemBlock:(id (NS_NOESCAPE^)(NewItemType item))newIdFromItemBlock
 	comparisonBlock:(BOOL (NS_NOESCAPE^)(OldItemType oldItem, NewItemType newItem))comparisonBlock
 {
-	//
-	// First let's check if the arrays are the same, this should be the most common situation.
-	//
-	if (oldArray.count == newArray.count) {
-
-		NSInteger i = 0;
-		for (; i < oldArray.count; i++) {
-			if (![oldIdFromItemBlock(oldArray[i]) isEqual:newIdFromItemBlock(newArray[i])])
-				break;
-		}
-
-		if (i >= oldArray.count) {
-
-			// OK, all items have the same positions, nothing was added or removed, let's only check if their contents is the same.
-			NSMutableArray *updates = nil;
-			if (comparisonBlock) {
-				for (i = 0; i < oldArray.count; i++) {
-					if (!comparisonBlock(oldArray[i], newArray[i])) {
-						if (!updates)
-							updates = [[NSMutableArray alloc] init];
-						[updates addObject:[[MMMArrayChangesUpdate alloc] initWithOldIndex:i newIndex:i]];
-					}
-				}
-			}
-			if (!updates) {
-				// OK, all objects are the same down to their contents, no changes.
-				return [self zero];
-			} else {
-				// Only changed contents of some of the objects.
-				return [[MMMArrayChanges alloc] initWithRemovals:@[] insertions:@[] moves:@[] updates:updates];
-			}
-		}
-	}
-
-	//
-	// Now let's index all the items.
-	//
+	return [self
+		changesWithOldArray:oldArray
+		idFromItemBlock:oldIdFromItemBlock
+		newArray:newArray
+		idFromItemBlock:newIdFromItemBlock
+		comparisonBlock:comparisonBlock
+		concurrent:NO
+	];
+}
 
-	// intermediateOld[i] will be an index of the object in the oldArray at i-th place after all removals are performed.
-	NSMutableArray *intermediate = [[NSMutableArray alloc] init];
-	for (NSInteger i = 0; i < oldArray.count; i++) {
-		[intermediate addObject:@(i)];
-	}
++ (instancetype)changesWithOldArray:(NSArray *)oldArray
+	idFromItemBlock:(id (NS_NOESCAPE^)(OldItemType item))oldIdFromItemBlock
+	newArray:(NSArray<NewItemType> *)newArray
+	idFromItemBlock:(id (NS_NOESCAPE^)(NewItemType item))newIdFromItemBlock
+	comparisonBlock:(BOOL (NS_NOESCAPE^)(OldItemType oldItem, NewItemType newItem))comparisonBlock
+	concurrent:(BOOL)concurrent
+{
+	// A one-off context, its scratch storage is created as needed and released right after.
+	return [[[MMMArrayChangesContext alloc] init]
+		changesWithOldArray:oldArray
+		idFromItemBlock:oldIdFromItemBlock
+		newArray:newArray
+		idFromItemBlock:newIdFromItemBlock
+		comparisonBlock:comparisonBlock
+		concurrent:concurrent
+	];
+}
 
-	// All IDs from the old array.
-	NSMutableSet *oldIds = [[NSMutableSet alloc] init];
-	// If we detect duplicate IDs in the old array (something that should not be there),
-	// then we record the indexes of those elements here to remove the corresponding elements below.
-	NSMutableSet<NSNumber *> *oldDuplicates = nil;
-	for (NSInteger i = 0; i < oldArray.count; i++) {
+- (id)initWithRemovals:(NSArray *)removals insertions:(NSArray *)insertions moves:(NSArray *)moves updates:(NSArray *)updates {
 
-		// Getting count to detect if the item has been added or ignored as a duplicate,
-		// this way we avoid checking this explicitely.
-		NSInteger count = oldIds.count;
+	if (self = [super init]) {
 
-		[oldIds addObject:oldIdFromItemBlock(oldArray[i])];
+		[self
+			allocateRecordsWithRemovalCount:removals.count
+			insertionCount:insertions.count
+			moveCount:moves.count
+			updateCount:updates.count
+		];
 
-		if (oldIds.count == count) {
-			// It looks like there is an item with the same ID somewhere before in the old array.
-			// Technically this is not the thing we have signed up for, but well, let's remove them as an extra service.
-			if (!oldDuplicates) {
-				oldDuplicates = [[NSMutableSet alloc] init];
-			}
-			[oldDuplicates addObject:@(i)];
+		NSInteger *r = _removalIndexes;
+		for (MMMArrayChangesRemoval *removal in removals) {
+			*r++ = removal.index;
 		}
-	}
-
-	// All IDs from the new array.
-	NSMutableSet *newIds = [[NSMutableSet alloc] init];
-	for (NSInteger i = 0; i < newArray.count; i++) {
-		[newIds addObject:newIdFromItemBlock(newArray[i])];
-	}
-
-	// Removals.
-	NSMutableArray *removals = [[NSMutableArray alloc] init];
-	for (NSInteger i = oldArray.count - 1; i >= 0; i--) {
-		// Removing those items in the old array that don't have a corresponding element in the new one
-		// or are duplicates of items in the old array.
-		if (![newIds containsObject:oldIdFromItemBlock(oldArray[i])]
-			|| (oldDuplicates && [oldDuplicates containsObject:@(i)])
-		) {
-			[removals addObject:[[MMMArrayChangesRemoval alloc] initWithIndex:i]];
-			[intermediate removeObjectAtIndex:i];
+		NSInteger *i = _insertionIndexes;
+		for (MMMArrayChangesInsertion *insertion in insertions) {
+			*i++ = insertion.index;
 		}
-	}
-
-	// Insertions.
-	NSMutableArray *insertions = [[NSMutableArray alloc] init];
-	for (NSInteger i = 0; i < newArray.count; i++) {
-		// Elements of the new array that are not in the old are, well, new.
-		if (![oldIds containsObject:newIdFromItemBlock(newArray[i])]) {
-			[insertions addObject:[[MMMArrayChangesInsertion alloc] initWithIndex:i]];
+		NSInteger *m = _moveRecords;
+		for (MMMArrayChangesMove *move in moves) {
+			*m++ = move.oldIndex;
+			*m++ = move.newIndex;
+			*m++ = move.intermediateSourceIndex;
+			*m++ = move.intermediateTargetIndex;
 		}
+		NSInteger *u = _updateRecords;
+		for (MMMArrayChangesUpdate *update in updates) {
+			*u++ = update.oldIndex;
+			*u++ = update.newIndex;
+		}
+
+		// The objects are at hand already, no need to recreate them.
+		_removals = [removals copy];
+		_insertions = [insertions copy];
+		_moves = [moves copy];
+		_updates = [updates copy];
 	}
 
-	// Moves and updates.
-	NSMutableArray *moves = [[NSMutableArray alloc] init];
-	NSMutableArray *updates = [[NSMutableArray alloc] init];
+	return self;
+}
 
-	NSInteger intermediateTargetIndex = 0;
-	for (NSInteger newIndex = 0; newIndex < newArray.count; newIndex++) {
+- (id)initWithRecords:(NSInteger *)records
+	removalCount:(NSInteger)removalCount
+	insertionCount:(NSInteger)insertionCount
+	moveCount:(NSInteger)moveCount
+	updateCount:(NSInteger)updateCount
+{
+	if (self = [super init]) {
+		_records = records;
+		[self setRecordsWithRemovalCount:removalCount insertionCount:insertionCount moveCount:moveCount updateCount:updateCount];
+	}
 
-		id newItem = newArray[newIndex];
-		id newId = newIdFromItemBlock(newItem);
+	return self;
+}
 
-		if ([oldIds containsObject:newId]) {
+- (void)allocateRecordsWithRemovalCount:(NSInteger)removalCount
+	insertionCount:(NSInteger)insertionCount
+	moveCount:(NSInteger)moveCount
+	updateCount:(NSInteger)updateCount
+{
+	// At least one value, so the pointers below are never NULL.
+	_records = malloc((removalCount + insertionCount + 4 * moveCount + 2 * updateCount + 1) * sizeof(NSInteger));
+	[self setRecordsWithRemovalCount:removalCount insertionCount:insertionCount moveCount:moveCount updateCount:updateCount];
+}
 
-			NSInteger oldIndex = [intermediate[intermediateTargetIndex] integerValue];
-			id oldItem = oldArray[oldIndex];
-			id oldId = oldIdFromItemBlock(oldItem);
+- (void)setRecordsWithRemovalCount:(NSInteger)removalCount
+	insertionCount:(NSInteger)insertionCount
+	moveCount:(NSInteger)moveCount
+	updateCount:(NSInteger)updateCount
+{
+	if (!_records) {
+		_records = malloc(sizeof(NSInteger));
+	}
 
-			if ([oldId isEqual:newId]) {
+	_removalIndexes = _records;
+	_removalCount = removalCount;
+	_insertionIndexes = _removalIndexes + removalCount;
+	_insertionCount = insertionCount;
+	_moveRecords = _insertionIndexes + insertionCount;
+	_moveCount = moveCount;
+	_updateRecords = _moveRecords + 4 * moveCount;
+	_updateCount = updateCount;
 
-				// The item is at its target position already, let's only check if the contents has changed.
+	_empty = (removalCount == 0) && (insertionCount == 0) && (moveCount == 0) && (updateCount == 0);
+}
 
-				if (comparisonBlock && !comparisonBlock(oldItem, newItem)) {
-					// OK, the content has changed, let's record an update.
-					[updates addObject:[[MMMArrayChangesUpdate alloc] initWithOldIndex:oldIndex newIndex:newIndex]];
-				}
+- (void)dealloc {
+	free(_records);
+}
 
-			} else {
+// The arrays of objects are created lazily under a lock, as the receiver is immutable otherwise
+// and thus is expected to be safe to use from any thread.
 
-				// A different element here, need a movement.
+- (NSArray<MMMArrayChangesRemoval *> *)removals {
+	@synchronized (self) {
+		if (!_removals) {
+			NSMutableArray *removals = [[NSMutableArray alloc] initWithCapacity:_removalCount];
+			for (NSInteger i = 0; i < _removalCount; i++) {
+				[removals addObject:[[MMMArrayChangesRemoval alloc] initWithIndex:_removalIndexes[i]]];
+			}
+			_removals = removals;
+		}
+		return _removals;
+	}
+}
 
-				// Let's find where this element is in the old array.
-				// TODO: this reverse look up can be improved
-				NSInteger oldNewIndex = NSNotFound;
-				id oldNewItem = nil;
-				NSInteger intermediateSourceIndex = 0;
-				for (; intermediateSourceIndex < intermediate.count; intermediateSourceIndex++) {
-					oldNewIndex = [intermediate[intermediateSourceIndex] integerValue];
-					oldNewItem = oldArray[oldNewIndex];
-					if ([oldIdFromItemBlock(oldNewItem) isEqual:newId])
-						break;
-				}
-				NSAssert(oldNewIndex != NSNotFound && intermediateSourceIndex < intermediate.count, @"");
+- (NSArray<MMMArrayChangesInsertion *> *)insertions {
+	@synchronized (self) {
+		if (!_insertions) {
+			NSMutableArray *insertions = [[NSMutableArray alloc] initWithCapacity:_insertionCount];
+			for (NSInteger i = 0; i < _insertionCount; i++) {
+				[insertions addObject:[[MMMArrayChangesInsertion alloc] initWithIndex:_insertionIndexes[i]]];
+			}
+			_insertions = insertions;
+		}
+		return _insertions;
+	}
+}
 
-				// Record a move.
+- (NSArray<MMMArrayChangesMove *> *)moves {
+	@synchronized (self) {
+		if (!_moves) {
+			NSMutableArray *moves = [[NSMutableArray alloc] initWithCapacity:_moveCount];
+			for (NSInteger i = 0; i < _moveCount; i++) {
+				const NSInteger *m = _moveRecords + 4 * i;
 				[moves addObject:[[MMMArrayChangesMove alloc]
-					initWithOldIndex:oldNewIndex newIndex:newIndex
-					intermediateSourceIndex:intermediateSourceIndex intermediateTargetIndex:intermediateTargetIndex
+					initWithOldIndex:m[0] newIndex:m[1]
+					intermediateSourceIndex:m[2] intermediateTargetIndex:m[3]
 				]];
-
-				// Update the intermediate array accordingly.
-				id t = intermediate[intermediateSourceIndex];
-				[intermediate removeObjectAtIndex:intermediateSourceIndex];
-				[intermediate insertObject:t atIndex:intermediateTargetIndex];
-
-				// Check if the item has content changes as well.
-				if (comparisonBlock && !comparisonBlock(oldNewItem, newItem)) {
-					// Yes, record an update, too.
-					[updates addObject:[[MMMArrayChangesUpdate alloc] initWithOldIndex:oldNewIndex newIndex:newIndex]];
-				}
 			}
-
-			intermediateTargetIndex++;
+			_moves = moves;
 		}
+		return _moves;
 	}
-
-	return [[MMMArrayChanges alloc] initWithRemovals:removals insertions:insertions moves:moves updates:updates];
 }
 
-- (id)initWithRemovals:(NSArray *)removals insertions:(NSArray *)insertions moves:(NSArray *)moves updates:(NSArray *)updates {
-
-	if (self = [super init]) {
-
-		_removals = removals;
-		_insertions = insertions;
-		_moves = moves;
-		_updates = updates;
-
-		_empty = (_removals.count == 0) && (_insertions.count == 0) && (_moves.count == 0) && (_updates.count == 0);
+- (NSArray<MMMArrayChangesUpdate *> *)updates {
+	@synchronized (self) {
+		if (!_updates) {
+			NSMutableArray *updates = [[NSMutableArray alloc] initWithCapacity:_updateCount];
+			for (NSInteger i = 0; i < _updateCount; i++) {
+				const NSInteger *u = _updateRecords + 2 * i;
+				[updates addObject:[[MMMArrayChangesUpdate alloc] initWithOldIndex:u[0] newIndex:u[1]]];
+			}
+			_updates = updates;
+		}
+		return _updates;
 	}
-
-	return self;
 }
 
 - (NSString *)description {
@@ -228,15 +524,21 @@ typedef id OldItemType;
 		return [NSString stringWithFormat:@"<%@: empty>", self.class];
 	}
 
-	NSMutableArray *changes = [[NSMutableArray alloc] init];
-	[changes addObjectsFromArray:self.removals];
-	[changes addObjectsFromArray:self.insertions];
-	[changes addObjectsFromArray:self.moves];
-	[changes addObjectsFromArray:self.updates];
-
+	// Same as the descriptions of the corresponding record objects, but without creating them.
 	NSMutableString *changesString = [[NSMutableString alloc] init];
-	for (id c in changes) {
-		[changesString appendFormat:@"\t%@\n", c];
+	for (NSInteger i = 0; i < _removalCount; i++) {
+		[changesString appendFormat:@"\t-%ld\n", (long)_removalIndexes[i]];
+	}
+	for (NSInteger i = 0; i < _insertionCount; i++) {
+		[changesString appendFormat:@"\t+%ld\n", (long)_insertionIndexes[i]];
+	}
+	for (NSInteger i = 0; i < _moveCount; i++) {
+		const NSInteger *m = _moveRecords + 4 * i;
+		[changesString appendFormat:@"\t%ld -> %ld\n", (long)m[0], (long)m[1]];
+	}
+	for (NSInteger i = 0; i < _updateCount; i++) {
+		const NSInteger *u = _updateRecords + 2 * i;
+		[changesString appendFormat:@"\t%ld -> *%ld\n", (long)u[0], (long)u[1]];
 	}
 
 	return [NSString stringWithFormat:@"<%@: changes:\n%@>", self.class, changesString];
@@ -262,47 +564,95 @@ typedef id OldItemType;
 	updateBlock:(void (NS_NOESCAPE^)(OldItemType oldItem, NewItemType newItem))updateBlock
 	removalBlock:(void (NS_NOESCAPE^)(OldItemType oldItem))removalBlock
 {
-	// Removals have reverse order, so we don't have to adjust indexes
-	for (MMMArrayChangesRemoval *r in self.removals) {
-		id item = oldArray[r.index];
-		[oldArray removeObjectAtIndex:r.index];
-		if (removalBlock)
-			removalBlock(item);
+	// Instead of replaying every removal, move and insertion on the array (shifting its tail every time),
+	// let's figure out what ends up at every position of the new array and rebuild it in a single pass.
+
+	NSInteger oldCount = oldArray.count;
+	NSInteger newCount = oldCount - _removalCount + _insertionCount;
+
+	// YES for the items of the old array that don't simply stay, i.e. removed or moved ones.
+	BOOL *displaced = calloc(oldCount + 1, sizeof(BOOL));
+	// The old index of an item moved into every position of the new array, NSNotFound in case of an insertion
+	// or -1 for the next item that simply stays.
+	NSInteger *sources = malloc((newCount + 1) * sizeof(NSInteger));
+	for (NSInteger i = 0; i < newCount; i++) {
+		sources[i] = -1;
+	}
+
+	NSMutableArray *removed = [[NSMutableArray alloc] initWithCapacity:_removalCount];
+	for (NSInteger i = 0; i < _removalCount; i++) {
+		NSInteger index = _removalIndexes[i];
+		displaced[index] = YES;
+		[removed addObject:oldArray[index]];
+	}
+	for (NSInteger i = 0; i < _moveCount; i++) {
+		const NSInteger *m = _moveRecords + 4 * i;
+		displaced[m[0]] = YES;
+		sources[m[1]] = m[0];
+	}
+	for (NSInteger i = 0; i < _insertionCount; i++) {
+		sources[_insertionIndexes[i]] = NSNotFound;
 	}
 
-	// Now the moves, their source/target indexes are relative the current state of the array.
-	for (MMMArrayChangesMove *m in self.moves) {
-		id item = oldArray[m.intermediateSourceIndex];
-		[oldArray removeObjectAtIndex:m.intermediateSourceIndex];
-		[oldArray insertObject:item atIndex:m.intermediateTargetIndex];
+	// The items that are neither removed nor moved keep their relative order, so they fill the remaining positions
+	// in the order they appear in the old array. The new items are represented by NSNull's for now.
+	NSMutableArray *result = [[NSMutableArray alloc] initWithCapacity:newCount];
+	NSInteger next = 0;
+	for (NSInteger newIndex = 0; newIndex < newCount; newIndex++) {
+		NSInteger source = sources[newIndex];
+		if (source == NSNotFound) {
+			[result addObject:[NSNull null]];
+		} else if (source >= 0) {
+			[result addObject:oldArray[source]];
+		} else {
+			while (displaced[next])
+				next++;
+			[result addObject:oldArray[next]];
+			next++;
+		}
+	}
+
+	free(displaced);
+	free(sources);
+
+	[oldArray setArray:result];
+
+	// The removed items are not in the array anymore, but no new items have been created yet.
+	if (removalBlock) {
+		for (id item in removed) {
+			removalBlock(item);
+		}
 	}
 
 	// And finally the insertions and updates.
-	for (MMMArrayChangesInsertion *i in self.insertions) {
+	BOOL hasPlaceholders = NO;
+	for (NSInteger i = 0; i < _insertionCount; i++) {
 
-		id object = newItemBlock(newArray[i.index]);
+		NSInteger index = _insertionIndexes[i];
+		id object = newItemBlock(newArray[index]);
 
-		// It's not allowed to have nil items, but still trying to not fail in production by putting NSNull's now
+		// It's not allowed to have nil items, but still trying to not fail in production by keeping NSNull's now
 		// and removing them afterwards.
 		// Well, we could allow NSNull, but then we'll have to use something else as our placeholder that we remove below.
 		if (!object || object == (id)[NSNull null]) {
 			NSAssert(NO, @"newItemBlock cannot return nil or NSNull");
-			object = [NSNull null];
+			hasPlaceholders = YES;
+			continue;
 		}
 
-		[oldArray insertObject:object atIndex:i.index];
+		[oldArray replaceObjectAtIndex:index withObject:object];
 	}
 
-	// OK, let's make sure to filter all the NSNull's inserted above.
-	for (NSInteger i = oldArray.count - 1; i >= 0; i--) {
-		if (oldArray[i] == (id)[NSNull null])
-			[oldArray removeObjectAtIndex:i];
+	// OK, let's make sure to filter all the NSNull's left above.
+	if (hasPlaceholders) {
+		[oldArray removeObjectIdenticalTo:[NSNull null]];
 	}
 
 	if (updateBlock) {
-		for (MMMArrayChangesUpdate *u in self.updates) {
+		for (NSInteger i = 0; i < _updateCount; i++) {
 			// Note that 'newIndex' is used in both cases because the old array is the same as the new one (except for updates).
-			updateBlock(oldArray[u.newIndex], newArray[u.newIndex]);
+			NSInteger newIndex = _updateRecords[2 * i + 1];
+			updateBlock(oldArray[newIndex], newArray[newIndex]);
 		}
 	}
 }
@@ -321,27 +671,29 @@ typedef id OldItemType;
 
 	[tableView beginUpdates];
 
-	NSMutableArray *removalsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_removals.count];
-	for (MMMArrayChangesRemoval *r in _removals) {
-		[removalsIndexPaths addObject:indexPathForItemIndex(r.index)];
+	NSMutableArray *removalsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_removalCount];
+	for (NSInteger i = 0; i < _removalCount; i++) {
+		[removalsIndexPaths addObject:indexPathForItemIndex(_removalIndexes[i])];
 	}
 	[tableView deleteRowsAtIndexPaths:removalsIndexPaths withRowAnimation:deletionAnimation];
 
-	NSMutableArray *insertionsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_insertions.count];
-	for (MMMArrayChangesInsertion *i in _insertions) {
-		[insertionsIndexPaths addObject:indexPathForItemIndex(i.index)];
+	NSMutableArray *insertionsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_insertionCount];
+	for (NSInteger i = 0; i < _insertionCount; i++) {
+		[insertionsIndexPaths addObject:indexPathForItemIndex(_insertionIndexes[i])];
 	}
 	[tableView insertRowsAtIndexPaths:insertionsIndexPaths withRowAnimation:insertionAnimation];
 
-	NSMutableArray *reloadsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_updates.count];
-	for (MMMArrayChangesUpdate *update in _updates) {
-		if (update.oldIndex != update.newIndex) {
+	NSMutableArray *reloadsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_updateCount];
+	for (NSInteger i = 0; i < _updateCount; i++) {
+		NSInteger oldIndex = _updateRecords[2 * i];
+		NSInteger newIndex = _updateRecords[2 * i + 1];
+		if (oldIndex != newIndex) {
 			[tableView
-				moveRowAtIndexPath:indexPathForItemIndex(update.oldIndex)
-				toIndexPath:indexPathForItemIndex(update.newIndex)
+				moveRowAtIndexPath:indexPathForItemIndex(oldIndex)
+				toIndexPath:indexPathForItemIndex(newIndex)
 			];
 		} else {
-			[reloadsIndexPaths addObject:indexPathForItemIndex(update.newIndex)];
+			[reloadsIndexPaths addObject:indexPathForItemIndex(newIndex)];
 		}
 	}
 	
@@ -350,11 +702,407 @@ typedef id OldItemType;
 	return reloadsIndexPaths;
 }
 
+- (NSArray<NSIndexPath *> *)applyToCollectionView:(UICollectionView *)collectionView
+	indexPathForItemIndex:(NSIndexPath* (NS_NOESCAPE ^)(NSInteger item))indexPathForItemIndex
+	completion:(void (^)(BOOL finished))completion
+{
+	NSMutableArray *updatesIndexPaths = [[NSMutableArray alloc] initWithCapacity:_updateCount];
+	for (NSInteger i = 0; i < _updateCount; i++) {
+		[updatesIndexPaths addObject:indexPathForItemIndex(_updateRecords[2 * i + 1])];
+	}
+
+	if (_removalCount + _insertionCount + _moveCount == 0)
+		return updatesIndexPaths;
+
+	// The index path block cannot be used within the batch block, so preparing everything in advance.
+	NSMutableArray *removalsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_removalCount];
+	for (NSInteger i = 0; i < _removalCount; i++) {
+		[removalsIndexPaths addObject:indexPathForItemIndex(_removalIndexes[i])];
+	}
+	NSMutableArray *insertionsIndexPaths = [[NSMutableArray alloc] initWithCapacity:_insertionCount];
+	for (NSInteger i = 0; i < _insertionCount; i++) {
+		[insertionsIndexPaths addObject:indexPathForItemIndex(_insertionIndexes[i])];
+	}
+	NSMutableArray *movesFromIndexPaths = [[NSMutableArray alloc] initWithCapacity:_moveCount];
+	NSMutableArray *movesToIndexPaths = [[NSMutableArray alloc] initWithCapacity:_moveCount];
+	for (NSInteger i = 0; i < _moveCount; i++) {
+		const NSInteger *m = _moveRecords + 4 * i;
+		[movesFromIndexPaths addObject:indexPathForItemIndex(m[0])];
+		[movesToIndexPaths addObject:indexPathForItemIndex(m[1])];
+	}
+
+	[collectionView performBatchUpdates:^{
+		[collectionView deleteItemsAtIndexPaths:removalsIndexPaths];
+		[collectionView insertItemsAtIndexPaths:insertionsIndexPaths];
+		for (NSInteger i = 0; i < movesFromIndexPaths.count; i++) {
+			[collectionView moveItemAtIndexPath:movesFromIndexPaths[i] toIndexPath:movesToIndexPaths[i]];
+		}
+	} completion:completion];
+
+	return updatesIndexPaths;
+}
+
 #endif
 
 @end
 
 
+/** Compares the IDs for the core; the context is the buffer of the IDs of both arrays. */
+static bool MMMArrayChangesIdsEqual(void *context, intptr_t a, intptr_t b) {
+	__unsafe_unretained id *ids = (__unsafe_unretained id *)context;
+	return [ids[a] isEqual:ids[b]];
+}
+
+@implementation MMMArrayChangesContext {
+
+	// The scratch storage kept between the calls. The containers are created when needed for the first time,
+	// the C buffers grow as needed, see MMMArrayChangesScratch().
+
+	NSMutableArray *_oldIds;
+	NSMutableArray *_newIds;
+
+	// The IDs of both arrays (not retained, the arrays above hold them) and their hashes, see MMMArrayChangesCore.h.
+	__unsafe_unretained id *_ids;
+	NSInteger _idsCapacity;
+
+	uint64_t *_hashes;
+	NSInteger _hashesCapacity;
+
+	intptr_t *_slots;
+	NSInteger _slotsCapacity;
+
+	BOOL *_changed;
+	NSInteger _changedCapacity;
+
+	bool *_survives;
+	NSInteger _survivesCapacity;
+
+	NSInteger *_oldIndexByNewIndex;
+	NSInteger _oldIndexByNewIndexCapacity;
+
+	NSUInteger *_fingerprints;
+	NSInteger _fingerprintsCapacity;
+
+	// The IDs and the fingerprints of the items of the new array in the last call of the fingerprinting version,
+	// nil/NULL if there was no such call yet.
+	NSMutableArray *_lastIds;
+	NSUInteger *_lastFingerprints;
+	NSInteger _lastFingerprintsCapacity;
+}
+
+- (id)init {
+
+	if (self = [super init]) {
+		_oldIds = [[NSMutableArray alloc] init];
+		_newIds = [[NSMutableArray alloc] init];
+	}
+
+	return self;
+}
+
+- (void)dealloc {
+	free(_ids);
+	free(_hashes);
+	free(_slots);
+	free(_changed);
+	free(_survives);
+	free(_oldIndexByNewIndex);
+	free(_fingerprints);
+	free(_lastFingerprints);
+}
+
+- (MMMArrayChanges *)changesWithOldArray:(NSArray *)oldArray
+	idFromItemBlock:(id (NS_NOESCAPE^)(OldItemType item))oldIdFromItemBlock
+	newArray:(NSArray<NewItemType> *)newArray
+	idFromItemBlock:(id (NS_NOESCAPE^)(NewItemType item))newIdFromItemBlock
+	comparisonBlock:(BOOL (NS_NOESCAPE^)(OldItemType oldItem, NewItemType newItem))comparisonBlock
+	concurrent:(BOOL)concurrent
+{
+	MMMArrayChangesProbe probeStorage;
+	MMMArrayChangesProbe *probe = MMMArrayChangesProbeBegin(&probeStorage);
+
+	// Getting the IDs of all the items just once, all the passes of the engine work with these.
+	MMMArrayChangesProbeEnter(probe, "ids");
+	NSArray *oldIds = MMMArrayChangesCollectIds(_oldIds, oldArray, oldIdFromItemBlock, concurrent);
+	NSArray *newIds = MMMArrayChangesCollectIds(_newIds, newArray, newIdFromItemBlock, concurrent);
+	if (probe) {
+		probe->metrics.idBlockCalls = oldIds.count + newIds.count;
+	}
+
+	MMMArrayChanges *result = [self
+		changesWithOldIds:oldIds
+		newIds:newIds
+		changedBlock:!comparisonBlock ? nil : ^BOOL(NSInteger oldIndex, NSInteger newIndex) {
+			return !comparisonBlock(oldArray[oldIndex], newArray[newIndex]);
+		}
+		concurrent:concurrent
+		probe:probe
+	];
+
+	MMMArrayChangesProbeFinish(probe);
+
+	return result;
+}
+
+- (MMMArrayChanges *)changesWithOldArray:(NSArray *)oldArray
+	idFromItemBlock:(id (NS_NOESCAPE^)(OldItemType item))oldIdFromItemBlock
+	newArray:(NSArray<NewItemType> *)newArray
+	idFromItemBlock:(id (NS_NOESCAPE^)(NewItemType item))newIdFromItemBlock
+	fingerprintBlock:(NSUInteger (NS_NOESCAPE^)(NewItemType newItem))fingerprintBlock
+	comparisonBlock:(BOOL (NS_NOESCAPE^)(OldItemType oldItem, NewItemType newItem))comparisonBlock
+	concurrent:(BOOL)concurrent
+{
+	MMMArrayChangesProbe probeStorage;
+	MMMArrayChangesProbe *probe = MMMArrayChangesProbeBegin(&probeStorage);
+
+	MMMArrayChangesProbeEnter(probe, "ids");
+	NSArray *oldIds = MMMArrayChangesCollectIds(_oldIds, oldArray, oldIdFromItemBlock, concurrent);
+	NSArray *newIds = MMMArrayChangesCollectIds(_newIds, newArray, newIdFromItemBlock, concurrent);
+	if (probe) {
+		probe->metrics.idBlockCalls = oldIds.count + newIds.count;
+	}
+
+	NSInteger newCount = newArray.count;
+	_fingerprints = MMMArrayChangesScratch(_fingerprints, &_fingerprintsCapacity, newCount, sizeof(NSUInteger));
+	NSUInteger *newFingerprints = _fingerprints;
+	MMMArrayChangesForChunks(newCount, concurrent, ^(NSInteger start, NSInteger end) {
+		for (NSInteger i = start; i < end; i++) {
+			newFingerprints[i] = fingerprintBlock(newArray[i]);
+		}
+	});
+
+	// The fingerprints of the old items are the ones retained from the last call, unless the array has changed since.
+	const NSUInteger *oldFingerprints = (_lastIds && [oldIds isEqualToArray:_lastIds]) ? _lastFingerprints : NULL;
+
+	MMMArrayChanges *result = [self
+		changesWithOldIds:oldIds
+		newIds:newIds
+		changedBlock:^BOOL(NSInteger oldIndex, NSInteger newIndex) {
+			if (oldFingerprints && oldFingerprints[oldIndex] == newFingerprints[newIndex])
+				return NO;
+			return !comparisonBlock(oldArray[oldIndex], newArray[newIndex]);
+		}
+		concurrent:concurrent
+		probe:probe
+	];
+
+	// The array corresponds to the new one now, so its IDs and fingerprints are retained,
+	// while the buffer of the previous fingerprints is reused for the next call.
+	if (!_lastIds) {
+		_lastIds = [[NSMutableArray alloc] initWithCapacity:newCount];
+	}
+	[_lastIds setArray:newIds];
+	NSUInteger *fingerprints = _lastFingerprints;
+	NSInteger fingerprintsCapacity = _lastFingerprintsCapacity;
+	_lastFingerprints = _fingerprints;
+	_lastFingerprintsCapacity = _fingerprintsCapacity;
+	_fingerprints = fingerprints;
+	_fingerprintsCapacity = fingerprintsCapacity;
+
+	MMMArrayChangesProbeFinish(probe);
+
+	return result;
+}
+
+/**
+ * The engine itself.
+ * The `changedBlock` tells if the item at the given index of the old array should be updated from its counterpart
+ * at the given index of the new one; nil when the contents is not compared.
+ * The `probe` collects the metrics, NULL when the instrumentation is off.
+ */
+- (MMMArrayChanges *)changesWithOldIds:(NSArray *)oldIds
+	newIds:(NSArray *)newIds
+	changedBlock:(BOOL (NS_NOESCAPE ^)(NSInteger oldIndex, NSInteger newIndex))changedBlock
+	concurrent:(BOOL)concurrent
+	probe:(MMMArrayChangesProbe *)probe
+{
+	NSInteger oldCount = oldIds.count;
+	NSInteger newCount = newIds.count;
+
+	if (probe) {
+		probe->metrics.oldCount = oldCount;
+		probe->metrics.newCount = newCount;
+	}
+	MMMArrayChangesProbeEnter(probe, "fastCheck");
+
+	//
+	// First let's check if the arrays are the same, this should be the most common situation.
+	//
+	if (oldCount == newCount) {
+
+		NSInteger i = 0;
+		for (; i < oldCount; i++) {
+			if (![oldIds[i] isEqual:newIds[i]])
+				break;
+		}
+
+		if (i >= oldCount) {
+
+			// OK, all items have the same positions, nothing was added or removed, let's only check if their contents is the same.
+			MMMArrayChangesBuffer updates = { NULL, 0, 0 };
+			if (changedBlock) {
+				MMMArrayChangesProbeEnter(probe, "updates");
+				BOOL *changed = _changed = MMMArrayChangesScratch(_changed, &_changedCapacity, oldCount, sizeof(BOOL));
+				MMMArrayChangesForChunks(oldCount, concurrent, ^(NSInteger start, NSInteger end) {
+					for (NSInteger i = start; i < end; i++) {
+						changed[i] = changedBlock(i, i);
+					}
+				});
+				for (i = 0; i < oldCount; i++) {
+					if (changed[i]) {
+						MMMArrayChangesBufferAppend(&updates, i);
+						MMMArrayChangesBufferAppend(&updates, i);
+					}
+				}
+			}
+			MMMArrayChangesProbeCount(probe, 0, 0, 0, updates.count / 2);
+			if (updates.count == 0) {
+				// OK, all objects are the same down to their contents, no changes.
+				return [MMMArrayChanges zero];
+			} else {
+				// Only changed contents of some of the objects.
+				return [[MMMArrayChanges alloc]
+					initWithRecords:updates.values
+					removalCount:0 insertionCount:0 moveCount:0 updateCount:updates.count / 2
+				];
+			}
+		}
+	}
+
+	//
+	// Now let's index all the items.
+	//
+	MMMArrayChangesProbeEnter(probe, "indexing");
+
+	// The IDs of both arrays in the joint index space of the core along with their hashes, computed once.
+	__unsafe_unretained id *ids = _ids = (__unsafe_unretained id *)MMMArrayChangesScratch(
+		(void *)_ids, &_idsCapacity, oldCount + newCount, sizeof(id)
+	);
+	[oldIds getObjects:ids range:NSMakeRange(0, oldCount)];
+	[newIds getObjects:ids + oldCount range:NSMakeRange(0, newCount)];
+	uint64_t *hashes = _hashes = MMMArrayChangesScratch(_hashes, &_hashesCapacity, oldCount + newCount, sizeof(uint64_t));
+	for (NSInteger i = 0; i < oldCount + newCount; i++) {
+		hashes[i] = [ids[i] hash];
+	}
+
+	// 1 for the items of the old array that stay, 0 for removed ones.
+	bool *survives = _survives = MMMArrayChangesScratch(_survives, &_survivesCapacity, oldCount, sizeof(bool));
+	// For every item of the new array the index of the corresponding item in the old one or NSNotFound.
+	NSInteger *oldIndexByNewIndex = _oldIndexByNewIndex = MMMArrayChangesScratch(
+		_oldIndexByNewIndex, &_oldIndexByNewIndexCapacity, newCount, sizeof(NSInteger)
+	);
+	_slots = MMMArrayChangesScratch(_slots, &_slotsCapacity, MMMArrayChangesCoreSlotCount(oldCount, newCount), sizeof(intptr_t));
+
+	// If there are items with the same ID in the old array (something that should not be there), then only the first
+	// of them is matched and the rest are removed; only the first of the duplicates in the new array is matched as well
+	// and the rest are inserted. Technically this is not the thing we have signed up for, but well, an extra service.
+	_Static_assert(sizeof(NSInteger) == sizeof(intptr_t) && NSNotFound == MMMArrayChangesCoreNotFound, "");
+	MMMArrayChangesCoreResult match = MMMArrayChangesCoreMatch(
+		hashes, oldCount,
+		hashes + oldCount, newCount,
+		MMMArrayChangesIdsEqual, (void *)ids,
+		_slots,
+		(intptr_t *)oldIndexByNewIndex,
+		survives
+	);
+	if (probe) {
+		probe->metrics.lookups += match.steps;
+		probe->metrics.duplicateCount += match.oldDuplicateCount + match.newDuplicateCount;
+	}
+
+	// All the records are packed into this one as they are found: removals, insertions, moves and then updates.
+	MMMArrayChangesBuffer records = { NULL, 0, 0 };
+
+	// Removals: the items in the old array that don't have a corresponding element in the new one
+	// or are duplicates of items in the old array.
+	MMMArrayChangesProbeEnter(probe, "removals");
+	for (NSInteger i = oldCount - 1; i >= 0; i--) {
+		if (!survives[i]) {
+			MMMArrayChangesBufferAppend(&records, i);
+		}
+	}
+
+	NSInteger removalCount = records.count;
+
+	// Insertions: elements of the new array that are not in the old are, well, new.
+	MMMArrayChangesProbeEnter(probe, "insertions");
+	for (NSInteger i = 0; i < newCount; i++) {
+		if (oldIndexByNewIndex[i] == NSNotFound) {
+			MMMArrayChangesBufferAppend(&records, i);
+		}
+	}
+	NSInteger insertionCount = records.count - removalCount;
+
+	// Comparing contents of the items that are not new in advance, so it can be done concurrently.
+	BOOL *changed = _changed = MMMArrayChangesScratch(_changed, &_changedCapacity, newCount, sizeof(BOOL));
+	if (changedBlock) {
+		MMMArrayChangesProbeEnter(probe, "updates");
+		MMMArrayChangesForChunks(newCount, concurrent, ^(NSInteger start, NSInteger end) {
+			for (NSInteger i = start; i < end; i++) {
+				NSInteger oldIndex = oldIndexByNewIndex[i];
+				changed[i] = oldIndex != NSNotFound && changedBlock(oldIndex, i);
+			}
+		});
+	}
+
+	// Moves.
+	MMMArrayChangesProbeEnter(probe, "moves");
+
+	// We don't maintain the intermediate array (the old one after all the removals and the moves so far) explicitly.
+	// Its first `intermediateTargetIndex` items are in place already, while the rest are the items that are not
+	// at their target positions yet, and these always keep their relative order from the old array.
+	// So marking the latter by their old indexes, the number of marked items preceding an item
+	// tells its position in the intermediate array.
+	NSInteger *pending = MMMFenwickTreeCreate(survives, oldCount);
+
+	NSInteger intermediateTargetIndex = 0;
+	for (NSInteger newIndex = 0; newIndex < newCount; newIndex++) {
+
+		NSInteger oldNewIndex = oldIndexByNewIndex[newIndex];
+
+		if (oldNewIndex != NSNotFound) {
+
+			// Let's find where this item is in the intermediate array.
+			NSInteger intermediateSourceIndex = intermediateTargetIndex + MMMFenwickTreePrefixSum(pending, oldNewIndex);
+
+			if (intermediateSourceIndex != intermediateTargetIndex) {
+				// A different element here, need a movement.
+				MMMArrayChangesBufferAppend(&records, oldNewIndex);
+				MMMArrayChangesBufferAppend(&records, newIndex);
+				MMMArrayChangesBufferAppend(&records, intermediateSourceIndex);
+				MMMArrayChangesBufferAppend(&records, intermediateTargetIndex);
+			}
+
+			// Either way it's in place now, which also updates the intermediate array accordingly.
+			MMMFenwickTreeAdd(pending, oldCount, oldNewIndex, -1);
+
+			intermediateTargetIndex++;
+		}
+	}
+
+	free(pending);
+
+	NSInteger moveCount = (records.count - removalCount - insertionCount) / 4;
+
+	// Updates, for the moved items as well as for the ones staying in place, in the order of the new array.
+	for (NSInteger newIndex = 0; newIndex < newCount; newIndex++) {
+		if (changed[newIndex]) {
+			MMMArrayChangesBufferAppend(&records, oldIndexByNewIndex[newIndex]);
+			MMMArrayChangesBufferAppend(&records, newIndex);
+		}
+	}
+	NSInteger updateCount = (records.count - removalCount - insertionCount - 4 * moveCount) / 2;
+	MMMArrayChangesProbeCount(probe, removalCount, insertionCount, moveCount, updateCount);
+
+	return [[MMMArrayChanges alloc]
+		initWithRecords:records.values
+		removalCount:removalCount insertionCount:insertionCount moveCount:moveCount updateCount:updateCount
+	];
+}
+
+@end
+
+
 //
 //
 //
@@ -0,0 +1,197 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+import MMMArrayChanges
+import XCTest
+
+// A plain model coming from the API layer, its composite string ID is built every time it's asked for,
+// which is not unusual in real apps and makes every extra call of the ID closures visible.
+private struct Cookie {
+
+	let id: Int
+	let name: String
+
+	var compositeId: String { return "cookie-\(id)" }
+}
+
+// A "fat" model we want to preserve between updates.
+private final class CookieViewModel {
+
+	let id: String
+	private(set) var name: String
+
+	init(cookie: Cookie) {
+		self.id = cookie.compositeId
+		self.name = cookie.name
+	}
+
+	func update(cookie: Cookie) -> Bool {
+		guard name != cookie.name else {
+			return false
+		}
+		name = cookie.name
+		return true
+	}
+}
+
+/// Performance tests for the diff engines over typical workloads, see `Workload`.
+///
+/// They are skipped unless `MMM_BENCHMARKS` environment variable is set, e.g.:
+///
+/// 	MMM_BENCHMARKS=1 swift test -c release --filter MMMArrayChangesBenchmarks
+///
+/// The `measure`-based tests work with `MMM_BENCHMARK_SIZE` elements (10000 by default), so baselines can be recorded
+/// in Xcode for every size of interest. The `testScaling()` goes through all the engines and workloads for 1k, 10k and
+/// 100k elements printing time and the number of calls of the ID closures per element for each.
+class MMMArrayChangesBenchmarks: XCTestCase {
+
+	private static let size: Int = ProcessInfo.processInfo.environment["MMM_BENCHMARK_SIZE"].flatMap { Int($0) } ?? 10_000
+
+	override func setUpWithError() throws {
+		try XCTSkipUnless(
+			ProcessInfo.processInfo.environment["MMM_BENCHMARKS"] != nil,
+			"Set MMM_BENCHMARKS environment variable to run the benchmarks"
+		)
+	}
+
+	/// One of the ways to find and apply the differences between two arrays.
+	fileprivate struct Engine {
+
+		let name: String
+
+		/// Prepares the arrays with the given IDs and returns a block to measure,
+		/// which in turn returns the number of calls of the ID closures it has made.
+		let prepare: (_ old: [Int], _ new: [Int]) -> () -> Int
+	}
+
+	private static let engines: [Engine] = [.byUpdatingArray, .betweenSimpleArrays, .diffUpdate]
+
+	private func benchmark(_ engine: Engine, _ workload: Workload) {
+
+		let (old, new) = workload.ids(MMMArrayChangesBenchmarks.size)
+		let block = engine.prepare(old, new)
+
+		var calls = 0
+		#if canImport(ObjectiveC)
+		if #available(macOS 10.15, iOS 13, tvOS 13, watchOS 6, *) {
+			measure(metrics: [XCTClockMetric(), XCTMemoryMetric()]) {
+				calls = block()
+			}
+		} else {
+			measure {
+				calls = block()
+			}
+		}
+		#else
+		measure {
+			calls = block()
+		}
+		#endif
+
+		print("\(engine.name), \(workload.name), \(MMMArrayChangesBenchmarks.size) elements: \(calls) calls of ID closures")
+	}
+
+	func testByUpdatingArrayNoOp() { benchmark(.byUpdatingArray, .noOp) }
+	func testByUpdatingArrayAppendOnly() { benchmark(.byUpdatingArray, .appendOnly) }
+	func testByUpdatingArrayInsertRemove() { benchmark(.byUpdatingArray, .insertRemove) }
+	func testByUpdatingArrayShuffle() { benchmark(.byUpdatingArray, .shuffle) }
+	func testByUpdatingArrayReverse() { benchmark(.byUpdatingArray, .reverse) }
+
+	func testBetweenSimpleArraysNoOp() { benchmark(.betweenSimpleArrays, .noOp) }
+	func testBetweenSimpleArraysAppendOnly() { benchmark(.betweenSimpleArrays, .appendOnly) }
+	func testBetweenSimpleArraysInsertRemove() { benchmark(.betweenSimpleArrays, .insertRemove) }
+	func testBetweenSimpleArraysShuffle() { benchmark(.betweenSimpleArrays, .shuffle) }
+	func testBetweenSimpleArraysReverse() { benchmark(.betweenSimpleArrays, .reverse) }
+
+	func testDiffUpdateNoOp() { benchmark(.diffUpdate, .noOp) }
+	func testDiffUpdateAppendOnly() { benchmark(.diffUpdate, .appendOnly) }
+	func testDiffUpdateInsertRemove() { benchmark(.diffUpdate, .insertRemove) }
+	func testDiffUpdateShuffle() { benchmark(.diffUpdate, .shuffle) }
+	func testDiffUpdateReverse() { benchmark(.diffUpdate, .reverse) }
+
+	func testScaling() {
+		for workload in Workload.all {
+			for engine in MMMArrayChangesBenchmarks.engines {
+				var line = "\(engine.name), \(workload.name):"
+				for size in [1_000, 10_000, 100_000] {
+					let (old, new) = workload.ids(size)
+					let block = engine.prepare(old, new)
+					let start = DispatchTime.now().uptimeNanoseconds
+					let calls = block()
+					let elapsed = Double(DispatchTime.now().uptimeNanoseconds - start) / 1e6
+					line += " \(size / 1000)k: \((elapsed * 10).rounded() / 10)ms"
+						+ " (\((Double(calls) / Double(size) * 100).rounded() / 100) ID calls per element);"
+				}
+				print(line)
+			}
+		}
+	}
+}
+
+extension MMMArrayChangesBenchmarks.Engine {
+
+	fileprivate static let byUpdatingArray = Engine(name: "byUpdatingArray") { old, new in
+		let models = old.map { CookieViewModel(cookie: Cookie(id: $0, name: "Cookie #\($0)")) }
+		let cookies = new.map { Cookie(id: $0, name: "Cookie #\($0)") }
+		return {
+			var calls = 0
+			var array = models
+			_ = MMMArrayChanges.byUpdatingArray(
+				&array,
+				elementId: { (model: CookieViewModel) -> String in
+					calls += 1
+					return model.id
+				},
+				sourceArray: cookies,
+				sourceElementId: { (cookie: Cookie) -> String in
+					calls += 1
+					return cookie.compositeId
+				},
+				update: { (model, _, cookie, _) -> Bool in
+					return model.update(cookie: cookie)
+				},
+				transform: { (cookie, _) -> CookieViewModel in
+					return CookieViewModel(cookie: cookie)
+				}
+			)
+			return calls
+		}
+	}
+
+	fileprivate static let betweenSimpleArrays = Engine(name: "betweenSimpleArrays") { old, new in
+		return {
+			_ = MMMArrayChanges.betweenSimpleArrays(oldArray: old, newArray: new)
+			return 0
+		}
+	}
+
+	fileprivate static let diffUpdate = Engine(name: "diffUpdate") { old, new in
+		let models = old.map { CookieViewModel(cookie: Cookie(id: $0, name: "Cookie #\($0)")) }
+		let cookies = new.map { Cookie(id: $0, name: "Cookie #\($0)") }
+		return {
+			var calls = 0
+			var array = models
+			array.diffUpdate(
+				elementId: { (model) -> String in
+					calls += 1
+					return model.id
+				},
+				sourceArray: cookies,
+				sourceElementId: { (cookie) -> String in
+					calls += 1
+					return cookie.compositeId
+				},
+				transform: { (cookie) -> CookieViewModel in
+					return CookieViewModel(cookie: cookie)
+				},
+				update: { (model, cookie) -> Bool in
+					return model.update(cookie: cookie)
+				}
+			)
+			return calls
+		}
+	}
+}
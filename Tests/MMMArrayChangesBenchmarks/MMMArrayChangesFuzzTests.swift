@@ -0,0 +1,210 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+import Foundation
+import MMMArrayChanges
+import XCTest
+
+/// Property-based checks of every diff engine over random arrays of growing sizes and a guard against accidental
+/// quadratic behavior in any of them.
+///
+/// Unlike the benchmarks these run by default. The arrays are generated from fixed seeds, so a failure can be
+/// reproduced by the size and the iteration printed with it. The maximum slope allowed by `testScaling()`
+/// can be overridden via `MMM_SCALING_MAX_SLOPE` environment variable.
+class MMMArrayChangesFuzzTests: XCTestCase {
+
+	/// One of the ways to find the changes between two arrays of unique IDs.
+	private struct Engine {
+
+		let name: String
+
+		/// The move detection the changes should be the same as with `betweenSimpleArrays()` for.
+		let moveDetection: MMMArrayChanges.MoveDetection
+
+		let changes: (_ old: [Int], _ new: [Int]) -> MMMArrayChanges
+	}
+
+	private static let engines: [Engine] = {
+
+		var engines: [Engine] = []
+
+		for moveDetection in [MMMArrayChanges.MoveDetection.greedy, .minimal] {
+
+			engines.append(Engine(name: "integer IDs, \(moveDetection)", moveDetection: moveDetection) { old, new in
+				return MMMArrayChanges.betweenSimpleArrays(oldArray: old, newArray: new, moveDetection: moveDetection)
+			})
+
+			engines.append(Engine(name: "generic IDs, \(moveDetection)", moveDetection: moveDetection) { old, new in
+				var array = old
+				return MMMArrayChanges.byUpdatingArray(
+					&array, elementId: { String($0) },
+					sourceArray: new, sourceElementId: { String($0) },
+					moveDetection: moveDetection,
+					transform: { (element, _) in element }
+				)
+			})
+
+			engines.append(Engine(name: "concurrent, \(moveDetection)", moveDetection: moveDetection) { old, new in
+				var array = old
+				return MMMArrayChanges.byUpdatingArray(
+					&array, elementId: { $0 },
+					sourceArray: new, sourceElementId: { $0 },
+					moveDetection: moveDetection,
+					concurrent: true,
+					transform: { (element, _) in element }
+				)
+			})
+
+			// Reused between the calls, so the scratch storage left from the previous ones is exercised as well.
+			let context = MMMArrayChangesContext<Int>(moveDetection: moveDetection)
+			engines.append(Engine(name: "context, \(moveDetection)", moveDetection: moveDetection) { old, new in
+				var array = old
+				return context.byUpdatingArray(
+					&array, elementId: { $0 },
+					sourceArray: new, sourceElementId: { $0 },
+					transform: { (element, _) in element }
+				)
+			})
+
+			engines.append(Engine(name: "diffUpdateRecordingChanges, \(moveDetection)", moveDetection: moveDetection) { old, new in
+				var array = old
+				return array.diffUpdateRecordingChanges(
+					elementId: { $0 },
+					sourceArray: new, sourceElementId: { $0 },
+					moveDetection: moveDetection,
+					transform: { $0 }
+				)
+			})
+
+			engines.append(Engine(name: "composition, \(moveDetection)", moveDetection: moveDetection) { old, new in
+				// Going through all the elements of both arrays in order.
+				let middle = Array(Set(old).union(new)).sorted()
+				return MMMArrayChanges.betweenSimpleArrays(oldArray: old, newArray: middle)
+					.composed(with: MMMArrayChanges.betweenSimpleArrays(oldArray: middle, newArray: new), moveDetection: moveDetection)
+			})
+		}
+
+		return engines
+	}()
+
+	/// Random old and new arrays of unique IDs: some of the old elements removed, some new ones inserted
+	/// and some of the rest moved.
+	private func randomArrays(size: Int, _ random: inout PseudoRandomSequence) -> (old: [Int], new: [Int]) {
+
+		let old = Array(0..<size).shuffled(using: &random)
+		guard size > 0 else {
+			return (old, Array(0..<Int.random(in: 0...2, using: &random)))
+		}
+
+		// Varying the intensity of the changes, so both small edits and complete rewrites are covered.
+		let removalRatio = Int.random(in: 0...4, using: &random)
+		var new = old.filter { _ in Int.random(in: 0..<5, using: &random) >= removalRatio }
+
+		for _ in 0..<Int.random(in: 0...(size / 2 + 1), using: &random) where !new.isEmpty {
+			let element = new.remove(at: Int.random(in: 0..<new.count, using: &random))
+			new.insert(element, at: Int.random(in: 0...new.count, using: &random))
+		}
+
+		for id in size..<(size + Int.random(in: 0...(size / 2 + 1), using: &random)) {
+			new.insert(id, at: Int.random(in: 0...new.count, using: &random))
+		}
+
+		return (old, new)
+	}
+
+	/// Checks that the changes describe the transition between the arrays regardless of how they were found.
+	private func check(_ changes: MMMArrayChanges, _ old: [Int], _ new: [Int], _ message: @autoclosure () -> String) {
+
+		var array = old
+		var removed: [Int] = []
+		changes.applyToArray(
+			&array,
+			sourceArray: new,
+			remove: { removed.append($0) },
+			transform: { $0 },
+			update: { (_, _) in }
+		)
+		XCTAssertEqual(array, new, message())
+		XCTAssertEqual(Set(removed), Set(old).subtracting(new), message())
+
+		// The records are ordered the way table views expect them.
+		XCTAssertTrue(zip(changes.removals, changes.removals.dropFirst()).allSatisfy { $0.index > $1.index }, message())
+		XCTAssertTrue(zip(changes.insertions, changes.insertions.dropFirst()).allSatisfy { $0.index < $1.index }, message())
+		XCTAssertTrue(changes.moves.allSatisfy { old[$0.oldIndex] == new[$0.newIndex] }, message())
+		XCTAssertTrue(changes.updates.isEmpty, message())
+	}
+
+	func testReplay() {
+
+		var random = PseudoRandomSequence(seed: 2019)
+
+		for size in [0, 1, 2, 3, 5, 8, 13, 21, 50, 100, 300, 1_000, 3_000] {
+			// Less iterations for larger arrays, as they cover more cases at once anyway.
+			for iteration in 0..<Swift.max(2, 3_000 / Swift.max(size, 1)) {
+
+				let (old, new) = randomArrays(size: size, &random)
+				let expected = [MMMArrayChanges.MoveDetection.greedy, .minimal].map {
+					MMMArrayChanges.betweenSimpleArrays(
+						oldArray: old.map { String($0) },
+						newArray: new.map { String($0) },
+						moveDetection: $0
+					)
+				}
+
+				for engine in MMMArrayChangesFuzzTests.engines {
+					let message = "\(engine.name), size \(size), iteration \(iteration)"
+					let changes = engine.changes(old, new)
+					check(changes, old, new, message)
+					XCTAssertEqual(changes, expected[engine.moveDetection == .greedy ? 0 : 1], message)
+				}
+
+				// The minimal move detection is not allowed to move more than the greedy one.
+				XCTAssertLessThanOrEqual(expected[1].moves.count, expected[0].moves.count, "size \(size), iteration \(iteration)")
+			}
+		}
+	}
+
+	func testScaling() {
+
+		let maxSlope = ProcessInfo.processInfo.environment["MMM_SCALING_MAX_SLOPE"].flatMap { Double($0) } ?? 1.5
+		let sizes = [4_000, 8_000, 16_000, 32_000]
+
+		for workload in Workload.all {
+			for engine in MMMArrayChangesFuzzTests.engines {
+
+				// Every point is the best of a few runs of the block repeated long enough for the clock to be reliable,
+				// so a single hiccup does not bend the curve.
+				let times: [Double] = sizes.map { size in
+					let (old, new) = workload.ids(size)
+					return (0..<3).map { _ in
+						var iterations = 0
+						let start = DispatchTime.now().uptimeNanoseconds
+						var elapsed: UInt64 = 0
+						repeat {
+							_ = engine.changes(old, new)
+							iterations += 1
+							elapsed = DispatchTime.now().uptimeNanoseconds - start
+						} while elapsed < 2_000_000
+						return Double(elapsed) / Double(iterations) / 1e6
+					}.min()!
+				}
+
+				// The slope of the least squares fit of the log-log curve: about 1 for linear or n log n growth,
+				// 2 for quadratic.
+				let xs = sizes.map { log2(Double($0)) }
+				let ys = times.map { log2($0) }
+				let meanX = xs.reduce(0, +) / Double(xs.count)
+				let meanY = ys.reduce(0, +) / Double(ys.count)
+				let slope = zip(xs, ys).map { ($0 - meanX) * ($1 - meanY) }.reduce(0, +)
+					/ xs.map { ($0 - meanX) * ($0 - meanX) }.reduce(0, +)
+
+				let curve = zip(sizes, times).map { "\($0 / 1000)k: \(($1 * 100).rounded() / 100)ms" }
+				print("\(engine.name), \(workload.name): \(curve.joined(separator: ", ")); slope \((slope * 100).rounded() / 100)")
+
+				XCTAssertLessThan(slope, maxSlope, "\(engine.name), \(workload.name) grows faster than expected")
+			}
+		}
+	}
+}
@@ -0,0 +1,31 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+/// This is copied from the example app (which in turn copied it from our own `MMMTemple`), so the workloads
+/// are reproducible between runs without depending on the corresponding library.
+class PseudoRandomSequence: RandomNumberGenerator {
+
+	private var last: UInt64
+
+	public init(seed: Int) {
+
+		self.last = UInt64(seed)
+
+		// Discard a few values, so we don't begin too close to the seed.
+		for _ in 1...7 {
+			let _ = next()
+		}
+	}
+
+	private func _next() -> UInt32 {
+		// The multiplier and increment are from Turbo Pascal, see https://en.wikipedia.org/wiki/Linear_congruential_generator
+		last = 134775813 &* last &+ 1
+		return UInt32(truncatingIfNeeded: last >> 32)
+	}
+
+	public func next() -> UInt64 {
+		return UInt64((UInt64(_next()) << 32) | UInt64(_next()))
+	}
+}
@@ -0,0 +1,57 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+/// A typical situation for a diff: the IDs of the elements of the old and the new arrays of the given size.
+struct Workload {
+
+	let name: String
+
+	let ids: (_ size: Int) -> (old: [Int], new: [Int])
+
+	static let all: [Workload] = [.noOp, .appendOnly, .insertRemove, .shuffle, .reverse]
+
+	/// Nothing has changed, the most common case when syncing periodically.
+	static let noOp = Workload(name: "no-op") { size in
+		let old = Array(0..<size)
+		return (old, old)
+	}
+
+	/// 10% of new elements at the end.
+	static let appendOnly = Workload(name: "append-only") { size in
+		let old = Array(0..<size)
+		return (old, old + Array(size..<(size + size / 10)))
+	}
+
+	/// About 10% of the elements removed and about as many inserted at random positions.
+	static let insertRemove = Workload(name: "insert/remove") { size in
+		let random = PseudoRandomSequence(seed: size)
+		var new: [Int] = []
+		new.reserveCapacity(size + size / 10)
+		var nextId = size
+		for id in 0..<size {
+			if random.next() % 10 == 0 {
+				new.append(nextId)
+				nextId += 1
+			}
+			if random.next() % 10 != 0 {
+				new.append(id)
+			}
+		}
+		return (Array(0..<size), new)
+	}
+
+	/// The same elements in a random order.
+	static let shuffle = Workload(name: "shuffle") { size in
+		var random = PseudoRandomSequence(seed: size)
+		let old = Array(0..<size)
+		return (old, old.shuffled(using: &random))
+	}
+
+	/// The same elements in the reverse order.
+	static let reverse = Workload(name: "reverse") { size in
+		let old = Array(0..<size)
+		return (old, Array(old.reversed()))
+	}
+}
@@ -0,0 +1,115 @@
+//
+// MMMArrayChanges.
+// Copyright (C) 2019 MediaMonks. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <MMMArrayChanges/MMMArrayChanges.h>
+
+/**
+ * Performance tests for the ObjC engine over the same workloads as the Swift ones in `MMMArrayChangesBenchmarks`.
+ * Skipped unless `MMM_BENCHMARKS` environment variable is set, the number of elements is taken from `MMM_BENCHMARK_SIZE`
+ * (10000 by default).
+ */
+@interface MMMArrayChangesBenchmarks : XCTestCase
+@end
+
+@implementation MMMArrayChangesBenchmarks {
+	NSInteger _size;
+}
+
+- (void)setUp {
+
+	[super setUp];
+
+	XCTSkipUnless(
+		[[NSProcessInfo processInfo].environment objectForKey:@"MMM_BENCHMARKS"] != nil,
+		@"Set MMM_BENCHMARKS environment variable to run the benchmarks"
+	);
+
+	NSString *size = [[NSProcessInfo processInfo].environment objectForKey:@"MMM_BENCHMARK_SIZE"];
+	_size = size ? [size integerValue] : 10000;
+}
+
+- (NSArray<NSString *> *)idsFrom:(NSInteger)from to:(NSInteger)to {
+	NSMutableArray *result = [[NSMutableArray alloc] initWithCapacity:to - from];
+	for (NSInteger i = from; i < to; i++) {
+		[result addObject:[NSString stringWithFormat:@"cookie-%ld", (long)i]];
+	}
+	return result;
+}
+
+- (void)benchmarkWithOldArray:(NSArray *)oldArray newArray:(NSArray *)newArray name:(NSString *)name {
+
+	__block NSInteger calls = 0;
+
+	[self measureBlock:^{
+		calls = 0;
+		[MMMArrayChanges
+			changesWithOldArray:oldArray
+			idFromItemBlock:^id(NSString *item) {
+				calls++;
+				return item;
+			}
+			newArray:newArray
+			idFromItemBlock:^id(NSString *item) {
+				calls++;
+				return item;
+			}
+			comparisonBlock:^BOOL(NSString *oldItem, NSString *newItem) {
+				return [oldItem isEqualToString:newItem];
+			}
+		];
+	}];
+
+	NSLog(@"changesWithOldArray:, %@, %ld elements: %ld calls of ID blocks", name, (long)_size, (long)calls);
+}
+
+- (void)testNoOp {
+	NSArray *old = [self idsFrom:0 to:_size];
+	[self benchmarkWithOldArray:old newArray:[old copy] name:@"no-op"];
+}
+
+- (void)testAppendOnly {
+	NSArray *old = [self idsFrom:0 to:_size];
+	NSArray *new = [old arrayByAddingObjectsFromArray:[self idsFrom:_size to:_size + _size / 10]];
+	[self benchmarkWithOldArray:old newArray:new name:@"append-only"];
+}
+
+- (void)testInsertRemove {
+	// The same "about 10% removed and about as many inserted" as in the Swift version, but using a simple LCG here.
+	uint64_t random = _size;
+	NSArray *old = [self idsFrom:0 to:_size];
+	NSMutableArray *new = [[NSMutableArray alloc] init];
+	NSInteger nextId = _size;
+	for (NSString *item in old) {
+		random = 134775813 * random + 1;
+		if ((random >> 32) % 10 == 0) {
+			[new addObject:[NSString stringWithFormat:@"cookie-%ld", (long)nextId++]];
+		}
+		random = 134775813 * random + 1;
+		if ((random >> 32) % 10 != 0) {
+			[new addObject:item];
+		}
+	}
+	[self benchmarkWithOldArray:old newArray:new name:@"insert/remove"];
+}
+
+- (void)testShuffle {
+	uint64_t random = _size;
+	NSArray *old = [self idsFrom:0 to:_size];
+	NSMutableArray *new = [old mutableCopy];
+	for (NSInteger i = new.count - 1; i > 0; i--) {
+		random = 134775813 * random + 1;
+		[new exchangeObjectAtIndex:i withObjectAtIndex:(NSInteger)((random >> 32) % (uint64_t)(i + 1))];
+	}
+	[self benchmarkWithOldArray:old newArray:new name:@"shuffle"];
+}
+
+- (void)testReverse {
+	NSArray *old = [self idsFrom:0 to:_size];
+	[self benchmarkWithOldArray:old newArray:[[old reverseObjectEnumerator] allObjects] name:@"reverse"];
+}
+
+@end
@@ -5,6 +5,11 @@
 
 import XCTest
 import MMMArrayChanges
+#if canImport(UIKit)
+import UIKit
+#elseif canImport(AppKit)
+import AppKit
+#endif
 
 // Let say we have a list of rich (as opposed to [anemic](https://martinfowler.com/bliki/AnemicDomainModel.html))
 // models for cookies. This is a sketch for a single element of such a list.
@@ -82,6 +87,15 @@ private struct CookieFromAPI {
 	let name: String
 }
 
+// The same plain models, identifiable and versioned this time.
+@available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *)
+private struct VersionedCookie: MMMDiffable {
+	let id: Int
+	let name: String
+	let version: Int
+	var contentVersion: Int { return version }
+}
+
 class MMMArrayChangesTestCaseSwift : XCTestCase {
 
 	func testBasics() {
@@ -96,6 +110,1002 @@ class MMMArrayChangesTestCaseSwift : XCTestCase {
 		)
 	}
 
+	func testMoves() {
+
+		// The intermediate indexes of the moves are part of the contract, they should not change with optimizations.
+		XCTAssertEqual(
+			MMMArrayChanges.betweenSimpleArrays(oldArray: [1, 2, 3, 4, 5], newArray: [5, 4, 3, 2, 1]),
+			MMMArrayChanges(
+				removals: [],
+				insertions: [],
+				moves: [.init(4, 0, 4, 0), .init(3, 1, 4, 1), .init(2, 2, 4, 2), .init(1, 3, 4, 3)],
+				updates: []
+			)
+		)
+		XCTAssertEqual(
+			MMMArrayChanges.betweenSimpleArrays(oldArray: [1, 2, 3, 4, 5, 6], newArray: [6, 2, 7, 5, 1, 3]),
+			MMMArrayChanges(
+				removals: [.init(3)],
+				insertions: [.init(2)],
+				moves: [.init(5, 0, 4, 0), .init(1, 1, 2, 1), .init(4, 3, 4, 2)],
+				updates: []
+			)
+		)
+
+		// And replaying them should lead to the new array.
+		let oldArray = [1, 2, 3, 4, 5, 6]
+		let newArray = [6, 2, 7, 5, 1, 3]
+		var array = oldArray
+		MMMArrayChanges.betweenSimpleArrays(oldArray: oldArray, newArray: newArray).applyToArray(
+			&array,
+			sourceArray: newArray,
+			remove: { _ in },
+			transform: { $0 },
+			update: { _, _ in }
+		)
+		XCTAssertEqual(array, newArray)
+	}
+
+	func testMinimalMoves() {
+
+		// Moving the first element to the end is n - 1 moves for the default detection mode...
+		let oldArray = [1, 2, 3, 4, 5]
+		let newArray = [2, 3, 4, 5, 1]
+		XCTAssertEqual(MMMArrayChanges.betweenSimpleArrays(oldArray: oldArray, newArray: newArray).moves.count, 4)
+
+		// ...but only one in the minimal one.
+		let changes = MMMArrayChanges.betweenSimpleArrays(oldArray: oldArray, newArray: newArray, moveDetection: .minimal)
+		XCTAssertEqual(changes, MMMArrayChanges(removals: [], insertions: [], moves: [.init(0, 4, 0, 4)], updates: []))
+
+		// The moves should still be replayable.
+		for (oldArray, newArray) in [
+			([1, 2, 3, 4, 5, 6], [6, 2, 7, 5, 1, 3]),
+			([1, 2, 3, 4, 5, 6, 7, 8], [8, 3, 1, 9, 2, 7, 6, 4])
+		] {
+			var array = oldArray
+			MMMArrayChanges.betweenSimpleArrays(oldArray: oldArray, newArray: newArray, moveDetection: .minimal).applyToArray(
+				&array,
+				sourceArray: newArray,
+				remove: { _ in },
+				transform: { $0 },
+				update: { _, _ in }
+			)
+			XCTAssertEqual(array, newArray)
+		}
+	}
+
+	func testPrecomputedIds() {
+
+		// The IDs are requested exactly once per element.
+		var elementIdCalls = 0
+		var sourceElementIdCalls = 0
+		var array: [CookieFromAPI] = [.init(id: 1, name: "Oreo"), .init(id: 2, name: "Biscotti")]
+		let sourceArray: [CookieFromAPI] = [.init(id: 2, name: "Biscotti"), .init(id: 3, name: "Macaron")]
+		let changes = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { (c: CookieFromAPI) -> Int in elementIdCalls += 1; return c.id },
+			sourceArray: sourceArray, sourceElementId: { (c: CookieFromAPI) -> Int in sourceElementIdCalls += 1; return c.id },
+			transform: { (c, _) in c }
+		)
+		XCTAssertEqual(elementIdCalls, 2)
+		XCTAssertEqual(sourceElementIdCalls, 2)
+		XCTAssertEqual(array.map { $0.id }, [2, 3])
+
+		// And the same changes can be found when the IDs are known already.
+		var array2: [CookieFromAPI] = [.init(id: 1, name: "Oreo"), .init(id: 2, name: "Biscotti")]
+		XCTAssertEqual(
+			MMMArrayChanges.byUpdatingArray(
+				&array2, oldIds: [1, 2],
+				sourceArray: sourceArray, newIds: [2, 3],
+				transform: { (c, _) in c }
+			),
+			changes
+		)
+		XCTAssertEqual(array2.map { $0.id }, [2, 3])
+	}
+
+	func testAccumulator() {
+
+		// Let's mirror every edit of a "live" array in the accumulator.
+		let oldArray = [1, 2, 3, 4, 5, 6]
+		var array = oldArray
+		var accumulator = MMMArrayChanges.Accumulator(count: array.count)
+
+		array.insert(7, at: 2); accumulator.insert(at: 2)
+		array.remove(at: 0); accumulator.remove(at: 0)
+		array.insert(array.remove(at: 4), at: 0); accumulator.move(from: 4, to: 0)
+		array.insert(8, at: 3); accumulator.insert(at: 3)
+		array.remove(at: 3); accumulator.remove(at: 3)
+		array.insert(array.remove(at: 1), at: 5); accumulator.move(from: 1, to: 5)
+		accumulator.update(at: 0)
+		XCTAssertFalse(accumulator.isEmpty)
+
+		let changes = accumulator.flush()
+		XCTAssertEqual(Array(changes.removals), [.init(0)])
+		XCTAssertEqual(Array(changes.insertions), [.init(1)])
+		XCTAssertEqual(Array(changes.moves), [.init(4, 0, 3, 0), .init(1, 5, 1, 4)])
+		XCTAssertEqual(Array(changes.updates), [.init(4, 0)])
+
+		// Replaying the changes should lead to the same array.
+		var replayed = oldArray
+		changes.applyToArray(&replayed, sourceArray: array, remove: { _ in }, transform: { $0 }, update: { _, _ in })
+		XCTAssertEqual(replayed, array)
+
+		// The edits cancelling each other out should not be reported at all.
+		XCTAssertTrue(accumulator.isEmpty)
+		accumulator.insert(at: 1)
+		accumulator.move(from: 0, to: 3)
+		accumulator.remove(at: 0)
+		accumulator.move(from: 2, to: 0)
+		XCTAssertTrue(accumulator.isEmpty)
+		XCTAssertEqual(accumulator.flush(), MMMArrayChanges(removals: [], insertions: [], moves: [], updates: []))
+	}
+
+	func testComposition() {
+
+		// Composed changes should be the same as the ones between the first and the last arrays directly.
+		let a = [1, 2, 3, 4, 5, 6]
+		let b = [6, 2, 7, 5, 1, 3]
+		let c = [7, 3, 8, 2, 1, 9]
+		for moveDetection in [MMMArrayChanges.MoveDetection.greedy, .minimal] {
+			XCTAssertEqual(
+				MMMArrayChanges.betweenSimpleArrays(oldArray: a, newArray: b)
+					.composed(with: MMMArrayChanges.betweenSimpleArrays(oldArray: b, newArray: c), moveDetection: moveDetection),
+				MMMArrayChanges.betweenSimpleArrays(oldArray: a, newArray: c, moveDetection: moveDetection)
+			)
+		}
+
+		// Updates are merged and follow their elements, those of the removed elements are dropped.
+		let first = MMMArrayChanges(removals: [], insertions: [], moves: [], updates: [.init(0, 0), .init(2, 2)])
+		let second = MMMArrayChanges(removals: [.init(0)], insertions: [], moves: [.init(3, 0, 2, 0)], updates: [.init(1, 1)])
+		XCTAssertEqual(
+			first.composed(with: second),
+			MMMArrayChanges(removals: [.init(0)], insertions: [], moves: [.init(3, 0, 2, 0)], updates: [.init(1, 1), .init(2, 2)])
+		)
+	}
+
+	func testPipeline() {
+
+		let pipeline = MMMArrayChangesPipeline<CookieFromAPI, CookieFromAPI, Int>(
+			elementId: { $0.id },
+			sourceElementId: { $0.id },
+			isUpdated: { $0.name != $1.name }
+		)
+
+		let oldArray: [CookieFromAPI] = [.init(id: 1, name: "Oreo"), .init(id: 2, name: "Biscotti")]
+
+		// The first submission is superseded by the second one right away, so only the latter should be delivered.
+		pipeline.submit(oldArray: oldArray, newArray: [.init(id: 3, name: "Macaron")]) { _ in
+			XCTFail("Superseded computations should not be delivered")
+		}
+
+		let delivered = expectation(description: "Changes are delivered on the main thread")
+		let newArray: [CookieFromAPI] = [.init(id: 2, name: "Biscotti"), .init(id: 1, name: "Oreo!")]
+		pipeline.submit(oldArray: oldArray, newArray: newArray) { changes in
+			XCTAssert(Thread.isMainThread)
+			XCTAssertEqual(
+				changes,
+				MMMArrayChanges(removals: [], insertions: [], moves: [.init(1, 0, 1, 0)], updates: [.init(0, 1)])
+			)
+			delivered.fulfill()
+		}
+
+		wait(for: [delivered], timeout: 5)
+	}
+
+	#if compiler(>=5.7)
+	@available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *)
+	@MainActor
+	func testPipelineTaskCancellation() async {
+
+		let pipeline = MMMArrayChangesPipeline<Int, Int, Int>(elementId: { $0 }, sourceElementId: { $0 })
+
+		// Cancelling the calling task should be enough to get the computation cancelled.
+		let task = Task { @MainActor in
+			try await pipeline.changes(oldArray: [1, 2], newArray: [2, 1])
+		}
+		task.cancel()
+		do {
+			_ = try await task.value
+			XCTFail("The changes should not be delivered to a cancelled task")
+		} catch {
+			XCTAssert(error is CancellationError)
+		}
+
+		// While the submissions that follow are not affected.
+		let changes = try? await pipeline.changes(oldArray: [1, 2], newArray: [2, 1])
+		XCTAssertEqual(changes, MMMArrayChanges.betweenSimpleArrays(oldArray: [1, 2], newArray: [2, 1]))
+	}
+	#endif
+
+	func testConcurrent() {
+
+		// Large enough to be split into chunks: every 7th element removed, the rest reordered, every 3rd one updated.
+		let oldArray = Array(0..<5000)
+		let newArray = oldArray.map { ($0 * 7919) % 5000 }.filter { $0 % 7 != 0 }
+
+		func changes(concurrent: Bool) -> (MMMArrayChanges, [Int]) {
+			var array = oldArray
+			let changes = MMMArrayChanges.byUpdatingArray(
+				&array, elementId: { $0 },
+				sourceArray: newArray, sourceElementId: { $0 },
+				concurrent: concurrent,
+				update: { (element, _, _, _) in element % 3 == 0 },
+				transform: { (element, _) in element }
+			)
+			return (changes, array)
+		}
+
+		let (serial, serialArray) = changes(concurrent: false)
+		let (concurrent, concurrentArray) = changes(concurrent: true)
+		XCTAssertEqual(concurrent, serial)
+		XCTAssertEqual(concurrentArray, newArray)
+		XCTAssertEqual(serialArray, newArray)
+	}
+
+	func testSectioned() {
+
+		struct Shelf {
+			let id: String
+			let cookies: [Int]
+		}
+
+		let changes = MMMSectionedArrayChanges.between(
+			oldSections: [Shelf(id: "A", cookies: [1, 2, 3]), Shelf(id: "B", cookies: [4, 5]), Shelf(id: "C", cookies: [6])],
+			newSections: [Shelf(id: "B", cookies: [5, 4, 1]), Shelf(id: "D", cookies: [7]), Shelf(id: "A", cookies: [3, 8])],
+			sectionId: { $0.id },
+			items: { $0.cookies },
+			itemId: { $0 },
+			isItemUpdated: { (old, _) in old == 3 }
+		)
+
+		XCTAssertEqual(
+			changes.sections,
+			MMMArrayChanges(removals: [.init(2)], insertions: [.init(1)], moves: [.init(1, 0, 1, 0)], updates: [])
+		)
+		// The items of the removed and inserted sections are not mentioned.
+		XCTAssertEqual(changes.removals, [IndexPath(indexes: [0, 1])])
+		XCTAssertEqual(changes.insertions, [IndexPath(indexes: [2, 1])])
+		// Cookie #1 jumps into another section instead of being removed and inserted.
+		XCTAssertEqual(changes.moves, [
+			.init(IndexPath(indexes: [1, 1]), IndexPath(indexes: [0, 0])),
+			.init(IndexPath(indexes: [0, 0]), IndexPath(indexes: [0, 2]))
+		])
+		XCTAssertEqual(changes.updates, [.init(IndexPath(indexes: [0, 2]), IndexPath(indexes: [2, 0]))])
+	}
+
+	func testCompactStorage() {
+
+		let changes = MMMArrayChanges.betweenSimpleArrays(oldArray: [1, 2, 3, 4, 5], newArray: [5, 2, 6, 4, 1])
+
+		// The records are read lazily from the packed storage, but should look and compare like the arrays.
+		XCTAssertEqual(changes.removals.count, 1)
+		XCTAssertEqual(changes.removals[0].index, 2)
+		XCTAssertEqual(changes.insertions.map { $0.index }, [2])
+		XCTAssertEqual(
+			changes,
+			MMMArrayChanges(
+				removals: Array(changes.removals),
+				insertions: Array(changes.insertions),
+				moves: Array(changes.moves),
+				updates: Array(changes.updates)
+			)
+		)
+		XCTAssertEqual(changes.moves.description, "[\(changes.moves.map { $0.description }.joined(separator: ", "))]")
+
+		// An instance made from scratch packs the same way.
+		let manual = MMMArrayChanges(
+			removals: [.init(3)],
+			insertions: [],
+			moves: [.init(0, 1, 0, 1)],
+			updates: [.init(1, 0)]
+		)
+		XCTAssertEqual(manual.description, "MMMArrayChanges(-3, 0 -> 1, 1/0)")
+		XCTAssertEqual(Array(manual.updates), [.init(1, 0)])
+		XCTAssertTrue(manual.insertions.isEmpty)
+		XCTAssertTrue(MMMArrayChanges(removals: [], insertions: [], moves: [], updates: []).isEmpty)
+	}
+
+	func testIntegerIds() {
+
+		// The dedicated engine for integer-like IDs should agree with the generic one,
+		// which is used here for the same IDs wrapped into strings.
+		var seed: UInt64 = 1
+		func random(_ range: Int) -> Int {
+			seed = seed &* 6364136223846793005 &+ 1442695040888963407
+			return Int(seed >> 33) % range
+		}
+
+		for _ in 0..<200 {
+			let oldArray = (0..<random(40)).map { $0 * 1_000_003 }.filter { _ in random(4) != 0 }.shuffled()
+			var newArray = oldArray.filter { _ in random(5) != 0 }
+			for _ in 0..<random(8) {
+				// Quite a few collisions in the table for the IDs that differ in the high bits only.
+				newArray.insert(Int.max - random(5) << 40 - newArray.count, at: random(newArray.count + 1))
+			}
+
+			for moveDetection in [MMMArrayChanges.MoveDetection.greedy, .minimal] {
+				XCTAssertEqual(
+					MMMArrayChanges.betweenSimpleArrays(oldArray: oldArray, newArray: newArray, moveDetection: moveDetection),
+					MMMArrayChanges.betweenSimpleArrays(
+						oldArray: oldArray.map { String($0) },
+						newArray: newArray.map { String($0) },
+						moveDetection: moveDetection
+					)
+				)
+			}
+		}
+
+		let uuids = (0..<10).map { _ in UUID() }
+		XCTAssertEqual(
+			MMMArrayChanges.betweenSimpleArrays(oldArray: uuids, newArray: Array(uuids.reversed().dropFirst())),
+			MMMArrayChanges.betweenSimpleArrays(oldArray: Array(0..<10), newArray: Array((0..<10).reversed().dropFirst()))
+		)
+	}
+
+	func testContext() {
+
+		// The same context should give the same results as the one-off calls while reusing its storage.
+		let context = MMMArrayChangesContext<String>(moveDetection: .minimal)
+		let snapshots = [[1, 2, 3, 4], [1, 2, 3, 4], [4, 1, 5, 3], [4, 1, 5, 3], [], [6, 4, 1]]
+		var array = snapshots[0].map { String($0) }
+		var previous = snapshots[0]
+		for snapshot in snapshots {
+			let expected = MMMArrayChanges.betweenSimpleArrays(
+				oldArray: previous.map { String($0) },
+				newArray: snapshot.map { String($0) },
+				moveDetection: .minimal
+			)
+			let changes = context.byUpdatingArray(
+				&array, elementId: { $0 },
+				sourceArray: snapshot, sourceElementId: { String($0) },
+				transform: { (element, _) in String(element) }
+			)
+			XCTAssertEqual(changes, expected)
+			XCTAssertEqual(array, snapshot.map { String($0) })
+			XCTAssertEqual(changes.isEmpty, previous == snapshot)
+			previous = snapshot
+		}
+
+		XCTAssertEqual(
+			context.changes(oldIds: ["a", "b"], newIds: ["a", "b"], isUpdated: { (oldIndex, _) in oldIndex == 1 }),
+			MMMArrayChanges(removals: [], insertions: [], moves: [], updates: [.init(1, 1)])
+		)
+	}
+
+	func testFingerprints() {
+
+		let context = MMMArrayChangesContext<String>()
+		var cookies: [Cookie] = []
+		var updateCalls = 0
+
+		func sync(_ apiModels: [CookieFromAPI]) -> MMMArrayChanges {
+			return context.byUpdatingArray(
+				&cookies, elementId: { $0.id },
+				sourceArray: apiModels, sourceElementId: { "\($0.id)" },
+				fingerprint: { $0.name.hashValue },
+				update: { (cookie, _, apiModel, _) in
+					updateCalls += 1
+					return cookie.update(apiModel: apiModel)
+				},
+				transform: { (apiModel, _) in Cookie(apiModel: apiModel) }
+			)
+		}
+
+		let apiModels: [CookieFromAPI] = [.init(id: 1, name: "Oreo"), .init(id: 2, name: "Biscotti")]
+		XCTAssertFalse(sync(apiModels).isEmpty)
+		XCTAssertEqual(updateCalls, 0)
+
+		// The fingerprints of the elements are known now, so the unchanged ones are not compared.
+		XCTAssertTrue(sync(apiModels).isEmpty)
+		XCTAssertEqual(updateCalls, 0)
+
+		// Only the changed ones are.
+		let changes = sync([.init(id: 2, name: "Biscotti"), .init(id: 1, name: "Double Oreo")])
+		XCTAssertEqual(updateCalls, 1)
+		XCTAssertEqual(Array(changes.updates), [.init(0, 1)])
+		XCTAssertEqual(cookies.map { $0.name }, ["Biscotti", "Double Oreo"])
+
+		// When the array is modified elsewhere, the retained fingerprints cannot be trusted anymore.
+		updateCalls = 0
+		cookies.removeLast()
+		XCTAssertFalse(sync(apiModels).isEmpty)
+		XCTAssertEqual(updateCalls, 1)
+		XCTAssertEqual(cookies.map { $0.name }, ["Oreo", "Biscotti"])
+	}
+
+	func testWindowed() {
+
+		// A huge list scrolled somewhere to the middle, with a few elements inserted far above the visible rows
+		// and one of the visible ones removed.
+		let oldIds = (0..<1000).map { "\($0)" }
+		var newIds = oldIds
+		newIds.remove(at: 505)
+		newIds.insert(contentsOf: ["a", "b", "c"], at: 10)
+		newIds.remove(at: 900)
+
+		let changes = MMMWindowedArrayChanges.between(oldIds: oldIds, newIds: newIds, visibleRange: 500..<520)
+		XCTAssertEqual(changes.oldWindow, 500..<520)
+		XCTAssertEqual(changes.newWindow, 503..<523)
+		XCTAssertEqual(changes.shift, 3)
+		XCTAssertEqual(changes.anchor?.oldIndex, 500)
+		XCTAssertEqual(changes.anchor?.newIndex, 503)
+		// The window in the new list gets one more element from below as the removed one.
+		XCTAssertEqual(Array(changes.visible.removals), [.init(5)])
+		XCTAssertEqual(Array(changes.visible.insertions), [.init(19)])
+		XCTAssertEqual(changes.all, MMMArrayChanges.betweenSimpleArrays(oldArray: oldIds, newArray: newIds))
+
+		// When the whole window is gone, it stays where it was.
+		let gone = MMMWindowedArrayChanges.between(oldIds: oldIds, newIds: Array(oldIds[20...]), visibleRange: 0..<20)
+		XCTAssertNil(gone.anchor)
+		XCTAssertEqual(gone.newWindow, 0..<20)
+		XCTAssertEqual(gone.visible.removals.count, 20)
+		XCTAssertEqual(gone.visible.insertions.count, 20)
+
+		// Same when the window has moved further than the anchor is looked for.
+		let far = MMMWindowedArrayChanges.between(
+			oldIds: oldIds,
+			newIds: (0..<50).map { "new \($0)" } + oldIds,
+			visibleRange: 500..<520,
+			maxAnchorDistance: 49
+		)
+		XCTAssertNil(far.anchor)
+		XCTAssertEqual(far.newWindow, 500..<520)
+		XCTAssertEqual(
+			MMMWindowedArrayChanges.between(
+				oldIds: oldIds,
+				newIds: (0..<50).map { "new \($0)" } + oldIds,
+				visibleRange: 500..<520,
+				maxAnchorDistance: 50
+			).anchor?.newIndex,
+			550
+		)
+	}
+
+	func testBudget() {
+
+		// Within the budget the changes are found as usual.
+		let budget = MMMArrayChanges.Budget(maxChangeRatio: 0.5, maxMoves: 2)
+		var array = ["1", "2", "3", "4", "5", "6"]
+		let small = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { $0 },
+			sourceArray: [2, 1, 3, 4, 5, 7], sourceElementId: { String($0) },
+			budget: budget,
+			transform: { (element, _) in String(element) }
+		)
+		XCTAssertFalse(small.isFullReload)
+		XCTAssertEqual(small, MMMArrayChanges.betweenSimpleArrays(oldArray: [1, 2, 3, 4, 5, 6], newArray: [2, 1, 3, 4, 5, 7]))
+
+		// Too many moves.
+		var updated: [String] = []
+		let newArray = [5, 4, 3, 2, 1, 7]
+		let moves = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { $0 },
+			sourceArray: newArray, sourceElementId: { String($0) },
+			budget: budget,
+			update: { (element, _, _, _) in
+				updated.append(element)
+				return false
+			},
+			transform: { (element, _) in String(element) }
+		)
+		XCTAssertTrue(moves.isFullReload)
+		XCTAssertFalse(moves.isEmpty)
+		XCTAssertTrue(moves.moves.isEmpty)
+		// The array is still updated properly, the surviving elements are compared as usual.
+		XCTAssertEqual(array, newArray.map { String($0) })
+		XCTAssertEqual(updated.sorted(), ["1", "2", "3", "4", "5", "7"])
+
+		// Too many insertions and removals, same with the integer engine.
+		let oldArray = Array(0..<10)
+		let replaced = Array(5..<15)
+		var strings = oldArray.map { String($0) }
+		let reload = MMMArrayChanges.byUpdatingArray(
+			&strings, oldIds: oldArray.map { String($0) },
+			sourceArray: replaced, newIds: replaced.map { String($0) },
+			budget: budget,
+			transform: { (element, _) in String(element) }
+		)
+		XCTAssertTrue(reload.isFullReload)
+		XCTAssertEqual(strings, replaced.map { String($0) })
+		var ints = oldArray
+		XCTAssertTrue(
+			MMMArrayChanges.byUpdatingArray(
+				&ints, elementId: { $0 },
+				sourceArray: replaced, sourceElementId: { $0 },
+				budget: budget,
+				transform: { (element, _) in element }
+			).isFullReload
+		)
+		XCTAssertEqual(ints, replaced)
+
+		// Replaying and composing full reloads works as well.
+		var replayed = oldArray
+		reload.applyToArray(&replayed, sourceArray: replaced, remove: { _ in }, transform: { $0 }, update: { _, _ in })
+		XCTAssertEqual(replayed, replaced)
+		let next = MMMArrayChanges.betweenSimpleArrays(oldArray: replaced, newArray: Array(replaced.dropFirst()))
+		let composed = reload.composed(with: next)
+		XCTAssertTrue(composed.isFullReload)
+		replayed = oldArray
+		composed.applyToArray(&replayed, sourceArray: Array(replaced.dropFirst()), remove: { _ in }, transform: { $0 }, update: { _, _ in })
+		XCTAssertEqual(replayed, Array(replaced.dropFirst()))
+	}
+
+	func testMetrics() {
+
+		var reported: [MMMArrayChanges.Metrics] = []
+		MMMArrayChanges.metricsObserver = { reported.append($0) }
+		defer { MMMArrayChanges.metricsObserver = nil }
+
+		var array = ["1", "2", "3"]
+		let changes = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { $0 },
+			sourceArray: [3, 4, 1], sourceElementId: { String($0) },
+			transform: { (element, _) in String(element) }
+		)
+		// Only the outermost operation is reported.
+		XCTAssertEqual(reported.count, 1)
+		let metrics = reported[0]
+		XCTAssertEqual(metrics.operation, .byUpdatingArray)
+		XCTAssertEqual(metrics.oldCount, 3)
+		XCTAssertEqual(metrics.newCount, 3)
+		XCTAssertEqual(metrics.idCalls, 6)
+		XCTAssertGreaterThan(metrics.lookups, 0)
+		XCTAssertEqual(metrics.removals, changes.removals.count)
+		XCTAssertEqual(metrics.insertions, changes.insertions.count)
+		XCTAssertEqual(metrics.moves, changes.moves.count)
+		XCTAssertNotNil(metrics.durations[.indexing])
+		XCTAssertNotNil(metrics.durations[.replay])
+		XCTAssertGreaterThanOrEqual(metrics.elapsed, metrics.durations.values.reduce(0, +) * 0.99)
+
+		var items = [1, 2, 3]
+		items.diffUpdate(elementId: { $0 }, sourceArray: [2, 3, 4], sourceElementId: { $0 }, transform: { $0 })
+		XCTAssertEqual(reported.count, 2)
+		XCTAssertEqual(reported[1].operation, .diffUpdate)
+		XCTAssertEqual(reported[1].removals, 1)
+		XCTAssertEqual(reported[1].insertions, 1)
+
+		// Nothing is collected when the instrumentation is off.
+		MMMArrayChanges.metricsObserver = nil
+		_ = MMMArrayChanges.betweenSimpleArrays(oldArray: [1, 2], newArray: [2, 1])
+		XCTAssertEqual(reported.count, 2)
+	}
+
+	func testDuplicates() {
+
+		// Only the first element with the same ID is matched, the rest are removed and inserted.
+		var array = ["a", "b", "a", "c"]
+		let source = ["c", "a", "a", "b", "c"]
+		let changes = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { $0 },
+			sourceArray: source, sourceElementId: { $0 },
+			duplicates: .keepFirst,
+			transform: { (element, _) in element }
+		)
+		XCTAssertEqual(array, source)
+		XCTAssertEqual(changes.removals.map { $0.index }, [2])
+		XCTAssertEqual(changes.insertions.map { $0.index }, [2, 4])
+
+		var numbers = [1, 2, 1, 3]
+		let sourceNumbers = [3, 1, 1, 2, 3]
+		_ = MMMArrayChanges.byUpdatingArray(
+			&numbers, elementId: { $0 },
+			sourceArray: sourceNumbers, sourceElementId: { $0 },
+			duplicates: .keepFirst,
+			transform: { (element, _) in element }
+		)
+		XCTAssertEqual(numbers, sourceNumbers)
+	}
+
+	func testCollections() {
+
+		let models = [0, 1, 2, 3, 4, 5]
+
+		// Slices don't start at 0 and lazy maps are not backed by arrays, neither has to be copied.
+		var array = ["1", "2", "3"]
+		var expected = array
+		let changes = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { $0 },
+			sourceArray: models[2...].lazy.map { String($0) }, sourceElementId: { $0 },
+			transform: { (element, _) in element }
+		)
+		XCTAssertEqual(array, ["2", "3", "4", "5"])
+		changes.applyToArray(
+			&expected, sourceArray: models[2...],
+			remove: { _ in }, transform: { String($0) }, update: { _, _ in }
+		)
+		XCTAssertEqual(expected, array)
+
+		// A single pass sequence is enough for `diffUpdate()`.
+		var items = [1, 2, 3]
+		var iterator = models.reversed().makeIterator()
+		items.diffUpdate(
+			elementId: { $0 },
+			sourceArray: AnySequence { AnyIterator { iterator.next() } }, sourceElementId: { $0 },
+			transform: { $0 }
+		)
+		XCTAssertEqual(items, [5, 4, 3, 2, 1, 0])
+	}
+
+	func testIdSnapshot() {
+
+		struct Model {
+			let id: String
+			let version: Int
+		}
+		let cached = [Model(id: "a", version: 1), Model(id: "b", version: 1), Model(id: "c", version: 1)]
+		let stored = MMMArrayChangesIdSnapshot(cached, elementId: { $0.id }, fingerprint: { $0.version }).data
+
+		guard let snapshot = MMMArrayChangesIdSnapshot<String>(data: stored) else {
+			XCTFail("Could not restore the snapshot")
+			return
+		}
+		XCTAssertEqual(snapshot.ids, ["a", "b", "c"])
+		XCTAssertEqual(snapshot.fingerprints, [1, 1, 1])
+		XCTAssertNil(MMMArrayChangesIdSnapshot<String>(data: stored.prefix(stored.count - 1)))
+		XCTAssertNil(MMMArrayChangesIdSnapshot<UUID>(data: stored))
+		// The last byte belongs to the last ID, which becomes invalid UTF-8.
+		var damaged = stored
+		damaged[damaged.count - 1] = 0xFF
+		XCTAssertNil(MMMArrayChangesIdSnapshot<String>(data: damaged))
+
+		let fresh = [Model(id: "c", version: 1), Model(id: "d", version: 1), Model(id: "a", version: 2)]
+		var restored: [Int] = []
+		var array: [String] = []
+		let changes = snapshot.byUpdatingArray(
+			&array,
+			sourceArray: fresh, sourceElementId: { $0.id },
+			fingerprint: { $0.version },
+			restore: { (oldIndex, model, _) in
+				restored.append(oldIndex)
+				return "\(cached[oldIndex].id)\(model.version)"
+			},
+			transform: { (model, _) in "\(model.id)\(model.version)" }
+		)
+		// Only the surviving elements are restored.
+		XCTAssertEqual(restored, [2, 0])
+		XCTAssertEqual(array, ["c1", "d1", "a2"])
+		XCTAssertEqual(changes.removals.map { $0.index }, [1])
+		XCTAssertEqual(changes.insertions.map { $0.index }, [1])
+		XCTAssertEqual(changes.updates.map { $0.oldIndex }, [0])
+	}
+
+	func testDiffUpdateRecordingChanges() {
+
+		let pairs: [([Int], [Int])] = [
+			([1, 2, 3], [1, 2, 3]),
+			([1, 2, 3], [1, 2]),
+			([1, 2, 3], [3, 10, 1, 4]),
+			([0, 1, 2, 3, 4, 5, 6], [4, 10, 3, 11, 0, 1, 5]),
+			([], [1, 2]),
+			([1, 2], [])
+		]
+		for (old, new) in pairs {
+			var array = old
+			var removed: [Int] = []
+			let changes = array.diffUpdateRecordingChanges(
+				elementId: { $0 },
+				sourceArray: new, sourceElementId: { $0 },
+				transform: { $0 },
+				update: { (element, _) in element % 2 == 0 },
+				remove: { removed.append($0) }
+			)
+			XCTAssertEqual(array, new)
+
+			var expected = old
+			let expectedChanges = MMMArrayChanges.byUpdatingArray(
+				&expected, elementId: { $0 },
+				sourceArray: new, sourceElementId: { $0 },
+				update: { (element, _, _, _) in element % 2 == 0 },
+				transform: { (element, _) in element }
+			)
+			XCTAssertEqual(changes, expectedChanges)
+			XCTAssertEqual(Set(removed), Set(old).subtracting(new))
+		}
+	}
+
+	func testIdentifiable() {
+
+		guard #available(iOS 13, macOS 10.15, tvOS 13, watchOS 6, *) else {
+			return
+		}
+
+		let old = [
+			VersionedCookie(id: 1, name: "Almond biscuit", version: 1),
+			VersionedCookie(id: 2, name: "Animal cracker", version: 1),
+			VersionedCookie(id: 3, name: "Anzac biscuit", version: 1)
+		]
+		let new = [
+			VersionedCookie(id: 3, name: "Anzac biscuit", version: 1),
+			VersionedCookie(id: 4, name: "Biscotti", version: 1),
+			VersionedCookie(id: 1, name: "Almond biscuits", version: 2)
+		]
+
+		// Only the elements with different versions are updated.
+		var array = old
+		var updated: [Int] = []
+		let changes = MMMArrayChanges.byUpdatingArray(
+			&array,
+			sourceArray: new,
+			update: { (element, _, _, _) in updated.append(element.id) },
+			transform: { (cookie, _) in cookie }
+		)
+		XCTAssertEqual(array.map { $0.id }, new.map { $0.id })
+		XCTAssertEqual(updated, [1])
+
+		var expected = old
+		let expectedChanges = MMMArrayChanges.byUpdatingArray(
+			&expected, elementId: { $0.id },
+			sourceArray: new, sourceElementId: { $0.id },
+			update: { (element, _, sourceElement, _) in element.version != sourceElement.version },
+			transform: { (cookie, _) in cookie }
+		)
+		XCTAssertEqual(changes, expectedChanges)
+		XCTAssertEqual(MMMArrayChanges.betweenSimpleArrays(oldArray: old, newArray: new), expectedChanges)
+
+		array = old
+		XCTAssertTrue(array.diffUpdate(sourceArray: new, transform: { $0 }))
+		XCTAssertEqual(array.map { $0.id }, new.map { $0.id })
+		XCTAssertFalse(array.diffUpdate(sourceArray: new, transform: { $0 }))
+	}
+
+	func testPublisher() {
+
+		let snapshots = [
+			[1, 2, 3, 4, 5, 6],
+			[6, 2, 7, 5, 1, 3],
+			[7, 3, 8, 2, 1, 9],
+			[9, 1, 2, 10],
+			[10, 11, 1]
+		]
+		let publisher = MMMArrayChangesPublisher<Int, Int>(elementId: { $0 }, capacity: 2, snapshot: snapshots[0])
+
+		// Every subscriber replays what it gets onto its own copy of the list.
+		final class Consumer {
+			let queue: DispatchQueue
+			var array: [Int]
+			var calls = 0
+			var subscription: MMMArrayChangesPublisher<Int, Int>.Subscription?
+			init(_ label: String, _ publisher: MMMArrayChangesPublisher<Int, Int>) {
+				queue = DispatchQueue(label: label)
+				array = publisher.current.snapshot
+				subscription = publisher.subscribe(queue: queue) { [unowned self] (changes, snapshot) in
+					changes.applyToArray(
+						&self.array, sourceArray: snapshot,
+						remove: { _ in }, transform: { $0 }, update: { (_, _) in }
+					)
+					XCTAssertEqual(self.array, snapshot)
+					self.calls += 1
+				}
+			}
+			var result: (array: [Int], calls: Int) {
+				return queue.sync { (array, calls) }
+			}
+		}
+
+		let fast = Consumer("fast", publisher)
+		let slow = Consumer("slow", publisher)
+
+		// The slow one catches up via the composed changes.
+		slow.queue.suspend()
+		for snapshot in snapshots[1...2] {
+			publisher.publish(snapshot)
+			_ = fast.result
+		}
+		slow.queue.resume()
+		XCTAssertTrue(fast.result == (snapshots[2], 2))
+		XCTAssertTrue(slow.result == (snapshots[2], 1))
+
+		XCTAssertEqual(
+			publisher.changes(since: 0),
+			MMMArrayChanges.betweenSimpleArrays(oldArray: snapshots[0], newArray: snapshots[2])
+		)
+
+		// And it's diffed directly after falling out of the buffer.
+		slow.queue.suspend()
+		for snapshot in [snapshots[3], snapshots[4], snapshots[1]] {
+			publisher.publish(snapshot)
+		}
+		XCTAssertNil(publisher.changes(since: 2))
+		slow.queue.resume()
+		XCTAssertTrue(slow.result == (snapshots[1], 2))
+		XCTAssertEqual(fast.result.array, snapshots[1])
+
+		slow.queue.sync { slow.subscription?.cancel() }
+		publisher.publish(snapshots[0])
+		XCTAssertEqual(fast.result.array, snapshots[0])
+		XCTAssertEqual(slow.result.array, snapshots[1])
+		XCTAssertEqual(publisher.current.version, 6)
+	}
+
+	func testBatchReplay() {
+
+		// Removes the elements at the given indexes keeping the order of the rest.
+		func removing(_ indexes: [Int], from array: [Int]) -> [Int] {
+			let set = Set(indexes)
+			return array.enumerated().filter { !set.contains($0.offset) }.map { $0.element }
+		}
+
+		var seed: UInt64 = 1
+		func random(_ range: Int) -> Int {
+			seed = seed &* 6364136223846793005 &+ 1442695040888963407
+			return Int(seed >> 33) % range
+		}
+
+		var pairs: [([Int], [Int])] = [
+			([1, 2, 3], [1, 2, 3]),
+			([1, 2, 3], [3, 10, 1, 4]),
+			([1, 2, 3, 4, 5], [5, 4, 3, 2, 1]),
+			([1, 2, 3, 4, 5, 6], [6, 2, 7, 5, 1, 3]),
+			([0, 1, 2, 3, 4, 5, 6], [4, 10, 3, 11, 0, 1, 5]),
+			([], [1, 2]),
+			([1, 2], [])
+		]
+		for _ in 0..<100 {
+			let old = (0..<random(60)).filter { _ in random(4) != 0 }.shuffled()
+			var new = old.filter { _ in random(5) != 0 }.shuffled()
+			for id in 100..<(100 + random(10)) {
+				new.insert(id, at: random(new.count + 1))
+			}
+			pairs.append((old, new))
+		}
+
+		for (old, new) in pairs {
+			for moveDetection in [MMMArrayChanges.MoveDetection.greedy, .minimal] {
+				let changes = MMMArrayChanges.betweenSimpleArrays(oldArray: old, newArray: new, moveDetection: moveDetection)
+				for maxBatchSize in [1, 2, 3, 100] {
+
+					var replay = MMMArrayChanges.BatchReplay(
+						changes: changes, oldItems: old, newItems: new, maxBatchSize: maxBatchSize
+					)
+					var batches = 0
+					var previous = replay.items
+					while let batch = replay.next() {
+
+						// Every batch takes the list from one consistent state to another.
+						let current = replay.items
+						switch batch {
+						case .removals(let indexes):
+							XCTAssertLessThanOrEqual(indexes.count, maxBatchSize)
+							XCTAssertEqual(indexes, indexes.sorted(by: >))
+							XCTAssertEqual(current, removing(indexes, from: previous))
+						case let .moves(sources, targets):
+							XCTAssertLessThanOrEqual(sources.count, maxBatchSize)
+							XCTAssertEqual(current.count, previous.count)
+							XCTAssertEqual(zip(sources, targets).map { current[$1] }, sources.map { previous[$0] })
+							XCTAssertEqual(removing(targets, from: current), removing(sources, from: previous))
+						case .insertions(let indexes):
+							XCTAssertLessThanOrEqual(indexes.count, maxBatchSize)
+							XCTAssertEqual(indexes, indexes.sorted())
+							XCTAssertEqual(indexes.map { current[$0] }, indexes.map { new[$0] })
+							XCTAssertEqual(removing(indexes, from: current), previous)
+						}
+
+						previous = current
+						batches += 1
+					}
+
+					XCTAssertTrue(replay.isFinished)
+					XCTAssertEqual(replay.items, new)
+					let count = changes.removals.count + changes.moves.count + changes.insertions.count
+					XCTAssertGreaterThanOrEqual(batches, (count + maxBatchSize - 1) / maxBatchSize)
+				}
+			}
+		}
+	}
+
+	func testVisibleUpdatedRows() {
+
+		// The even elements are updated; 3 is removed, 10 is inserted, while 8 and 9 move to the top.
+		var array = Array(0..<10)
+		let new = [8, 9, 0, 1, 2, 10, 4, 5, 6, 7]
+		let changes = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { $0 },
+			sourceArray: new, sourceElementId: { $0 },
+			update: { (element, _, _, _) in element % 2 == 0 },
+			transform: { (element, _) in element }
+		)
+
+		// The rows 2 to 5 of the old array are on screen, in the second section.
+		let indexPath = { (index: Int) in IndexPath(indexes: [1, index]) }
+		let rows = changes.visibleUpdatedRows(
+			visibleIndexPaths: (2...5).map(indexPath),
+			indexPathForItemIndex: indexPath
+		)
+		XCTAssertEqual(rows.updates.map { $0.oldIndex }, [2, 4])
+		XCTAssertEqual(rows.oldIndexPaths, [indexPath(2), indexPath(4)])
+		XCTAssertEqual(rows.newIndexPaths, [indexPath(4), indexPath(6)])
+
+		XCTAssertTrue(changes.visibleUpdatedRows(visibleIndexPaths: [], indexPathForItemIndex: indexPath).updates.isEmpty)
+		// Rows of other sections don't count.
+		XCTAssertTrue(
+			changes.visibleUpdatedRows(
+				visibleIndexPaths: (0..<10).map { IndexPath(indexes: [0, $0]) },
+				indexPathForItemIndex: indexPath
+			).updates.isEmpty
+		)
+	}
+
+	#if canImport(UIKit) || canImport(AppKit)
+	func testDiffableSnapshot() {
+
+		guard #available(iOS 13, macOS 10.15.1, tvOS 13, *) else {
+			return
+		}
+
+		var seed: UInt64 = 1
+		func random(_ range: Int) -> Int {
+			seed = seed &* 6364136223846793005 &+ 1442695040888963407
+			return Int(seed >> 33) % range
+		}
+
+		// Replays the changes onto a snapshot with another section around, which should not be affected.
+		func check(_ changes: MMMArrayChanges, _ old: [Int], _ new: [Int], reloaded: [Int]) {
+			var snapshot = NSDiffableDataSourceSnapshot<Int, Int>()
+			snapshot.appendSections([0, 1])
+			snapshot.appendItems(old, toSection: 0)
+			snapshot.appendItems([-1, -2], toSection: 1)
+			snapshot.apply(changes, inSection: 0, newItems: new)
+			XCTAssertEqual(snapshot.itemIdentifiers(inSection: 0), new, "\(old) -> \(new)")
+			XCTAssertEqual(snapshot.itemIdentifiers(inSection: 1), [-1, -2], "\(old) -> \(new)")
+			if #available(iOS 15, macOS 12, tvOS 15, *) {
+				XCTAssertEqual(Set(snapshot.reloadedItemIdentifiers), Set(reloaded), "\(old) -> \(new)")
+			}
+		}
+
+		var pairs: [([Int], [Int])] = [
+			([1, 2, 3], [1, 2, 3]),
+			([1, 2, 3], [3, 10, 1, 4]),
+			([1, 2, 3, 4, 5], [5, 4, 3, 2, 1]),
+			([1, 2, 3], [10, 11, 1, 2, 3]),
+			([1, 2, 3, 4], [4, 10, 1, 2, 3]),
+			([], [1, 2]),
+			([1, 2], [])
+		]
+		for _ in 0..<100 {
+			let old = (0..<random(40)).filter { _ in random(4) != 0 }.shuffled()
+			var new = old.filter { _ in random(5) != 0 }.shuffled()
+			for id in 100..<(100 + random(10)) {
+				new.insert(id, at: random(new.count + 1))
+			}
+			pairs.append((old, new))
+		}
+
+		for (old, new) in pairs {
+			for moveDetection in [MMMArrayChanges.MoveDetection.greedy, .minimal] {
+
+				check(
+					MMMArrayChanges.betweenSimpleArrays(oldArray: old, newArray: new, moveDetection: moveDetection),
+					old, new, reloaded: []
+				)
+
+				// Every third element is updated.
+				var array = old
+				let changes = MMMArrayChanges.byUpdatingArray(
+					&array, elementId: { $0 },
+					sourceArray: new, sourceElementId: { $0 },
+					moveDetection: moveDetection,
+					update: { (element, _, _, _) in element % 3 == 0 },
+					transform: { (element, _) in element }
+				)
+				check(changes, old, new, reloaded: new.filter { $0 % 3 == 0 && old.contains($0) })
+			}
+		}
+
+		// All the surviving items are reloaded in case of a full reload.
+		let old = [1, 2, 3, 4, 5, 6]
+		let new = [6, 7, 5, 1]
+		var array = old
+		let reload = MMMArrayChanges.byUpdatingArray(
+			&array, elementId: { $0 },
+			sourceArray: new, sourceElementId: { $0 },
+			budget: MMMArrayChanges.Budget(maxChangeRatio: 0),
+			transform: { (element, _) in element }
+		)
+		XCTAssertTrue(reload.isFullReload)
+		check(reload, old, new, reloaded: [6, 5, 1])
+	}
+	#endif
+
 	func testDiffUpdate() {
 
 		// Imagine we are somewhere in a "thick" model representing a list of cookies.
@@ -155,6 +1165,12 @@ class MMMArrayChangesTestCaseSwift : XCTestCase {
 		XCTAssert(items.count == 2)
 		XCTAssert(items[0].name == "Oreo")
 		XCTAssert(items[1] === animalCracker)
+
+		// The case when only the elements in the end are gone.
+		let oreo = items[0]
+		XCTAssertTrue(self.diffUpdate(items: &items, apiResponse: [CookieFromAPI(id: 3, name: "Oreo")]))
+		XCTAssert(items.count == 1 && items[0] === oreo)
+		XCTAssert(animalCracker.isRemoved && !oreo.isRemoved)
 	}
 
 	private func diffUpdate(items: inout [Cookie], apiResponse: [CookieFromAPI]) -> Bool {
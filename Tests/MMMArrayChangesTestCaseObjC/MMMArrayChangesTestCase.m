@@ -58,4 +58,122 @@
 	];
 }
 
+- (void)testConcurrent {
+
+	// Large enough to be split into chunks: every 7th item removed, the rest reordered, every 3rd one updated.
+	NSMutableArray *oldArray = [[NSMutableArray alloc] init];
+	NSMutableArray *newArray = [[NSMutableArray alloc] init];
+	for (NSInteger i = 0; i < 5000; i++) {
+		[oldArray addObject:@(i)];
+		NSInteger j = (i * 7919) % 5000;
+		if (j % 7 != 0) {
+			[newArray addObject:@(j)];
+		}
+	}
+
+	MMMArrayChanges * (^changes)(BOOL) = ^(BOOL concurrent){
+		return [MMMArrayChanges
+			changesWithOldArray:oldArray
+			idFromItemBlock:^id(id item) {
+				return item;
+			}
+			newArray:newArray
+			idFromItemBlock:^id(id item) {
+				return item;
+			}
+			comparisonBlock:^BOOL(NSNumber *oldItem, NSNumber *newItem) {
+				return [oldItem integerValue] % 3 != 0;
+			}
+			concurrent:concurrent
+		];
+	};
+
+	XCTAssertEqualObjects([changes(YES) description], [changes(NO) description]);
+}
+
+- (void)testContext {
+
+	MMMArrayChangesContext *context = [[MMMArrayChangesContext alloc] init];
+	NSArray *snapshots = @[ @[ @1, @2, @3 ], @[ @1, @2, @3 ], @[ @3, @4, @1 ], @[], @[ @5 ] ];
+	NSArray *previous = snapshots.firstObject;
+	for (NSArray *snapshot in snapshots) {
+		id (^idBlock)(id) = ^id(id item) {
+			return item;
+		};
+		BOOL (^comparisonBlock)(id, id) = ^BOOL(id oldItem, id newItem) {
+			return YES;
+		};
+		MMMArrayChanges *changes = [context
+			changesWithOldArray:previous idFromItemBlock:idBlock
+			newArray:snapshot idFromItemBlock:idBlock
+			comparisonBlock:comparisonBlock
+			concurrent:NO
+		];
+		MMMArrayChanges *expected = [MMMArrayChanges
+			changesWithOldArray:previous idFromItemBlock:idBlock
+			newArray:snapshot idFromItemBlock:idBlock
+			comparisonBlock:comparisonBlock
+		];
+		XCTAssertEqualObjects([changes description], [expected description]);
+		previous = snapshot;
+	}
+}
+
+- (void)testMetrics {
+
+	__block NSMutableArray<NSValue *> *reported = [[NSMutableArray alloc] init];
+	MMMArrayChanges.metricsObserver = ^(MMMArrayChangesMetrics metrics) {
+		[reported addObject:[NSValue valueWithBytes:&metrics objCType:@encode(MMMArrayChangesMetrics)]];
+	};
+
+	MMMArrayChanges *changes = [MMMArrayChanges changesWithOldArray:@[ @1, @2, @3 ] newArray:@[ @3, @4, @1 ]];
+
+	MMMArrayChanges.metricsObserver = nil;
+	[MMMArrayChanges changesWithOldArray:@[ @1 ] newArray:@[ @2 ]];
+
+	XCTAssertEqual(reported.count, 1);
+	MMMArrayChangesMetrics metrics;
+	[reported.firstObject getValue:&metrics];
+	XCTAssertEqual(metrics.oldCount, 3);
+	XCTAssertEqual(metrics.newCount, 3);
+	XCTAssertEqual(metrics.idBlockCalls, 6);
+	XCTAssertGreaterThan(metrics.lookups, 0);
+	XCTAssertEqual(metrics.duplicateCount, 0);
+	XCTAssertEqual(metrics.removalCount, changes.removals.count);
+	XCTAssertEqual(metrics.insertionCount, changes.insertions.count);
+	XCTAssertEqual(metrics.moveCount, changes.moves.count);
+	XCTAssertEqual(metrics.updateCount, changes.updates.count);
+	XCTAssertGreaterThanOrEqual(metrics.elapsed, 0);
+}
+
+- (void)testDuplicates {
+	// Only the first item with the same ID is matched: the other ones are removed from the old array
+	// and inserted into the new one.
+	[self
+		verifyApplyWithOldArray:@[ @1, @2, @1, @3 ]
+		newArray:@[ @3, @1, @1 ]
+	];
+	MMMArrayChanges *changes = [MMMArrayChanges changesWithOldArray:@[ @1, @2, @1 ] newArray:@[ @2, @1, @2 ]];
+	XCTAssertEqual(changes.removals.count, 1);
+	XCTAssertEqual(changes.insertions.count, 1);
+}
+
+- (void)testLazyRecords {
+
+	MMMArrayChanges *changes = [MMMArrayChanges changesWithOldArray:@[ @1, @2, @3, @4 ] newArray:@[ @4, @2, @5, @1 ]];
+
+	// The objects created lazily from the packed records should describe the very same changes.
+	MMMArrayChanges *copy = [[MMMArrayChanges alloc]
+		initWithRemovals:changes.removals
+		insertions:changes.insertions
+		moves:changes.moves
+		updates:changes.updates
+	];
+	XCTAssertEqualObjects([copy description], [changes description]);
+	XCTAssertEqual(changes.removals.count, 1);
+	XCTAssertEqual(changes.removals[0].index, 2);
+	XCTAssertEqual(changes.insertions[0].index, 2);
+	XCTAssertTrue([[MMMArrayChanges changesWithOldArray:@[ @1 ] newArray:@[ @1 ]] isEmpty]);
+}
+
 @end